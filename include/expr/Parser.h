@@ -20,6 +20,7 @@ namespace llvm {
 }
 
 namespace klee {
+  class ArrayCache;
   class ExprBuilder;
 
 namespace expr {
@@ -230,6 +231,14 @@ namespace expr {
     /// expressions.
     static Parser *Create(const std::string Name, const llvm::MemoryBuffer *MB,
                           ExprBuilder *Builder, bool ClearArrayAfterQuery);
+
+    /// CreateParser - Create a parser implementation which creates its
+    /// arrays in \arg TheArrayCache, so that they are shared with other
+    /// parsers using the same cache. The cache must outlive the parsed
+    /// expressions.
+    static Parser *Create(const std::string Name, const llvm::MemoryBuffer *MB,
+                          ExprBuilder *Builder, ArrayCache *TheArrayCache,
+                          bool ClearArrayAfterQuery);
   };
 }
 }
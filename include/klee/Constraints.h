@@ -12,12 +12,15 @@
 
 #include "klee/Expr.h"
 
+#include <memory>
+
 // FIXME: Currently we use ConstraintManager for two things: to pass
 // sets of constraints around, and to optimize constraints. We should
 // move the first usage into a separate data structure
 // (ConstraintSet?) which ConstraintManager could embed if it likes.
 namespace klee {
 
+class ConstraintFactors;
 class ExprVisitor;
   
 class ConstraintManager {
@@ -26,14 +29,16 @@ public:
   typedef constraints_ty::iterator iterator;
   typedef constraints_ty::const_iterator const_iterator;
 
-  ConstraintManager() {}
+  ConstraintManager() : factored(true) {}
 
   // create from constraints with no optimization
   explicit
   ConstraintManager(const std::vector< ref<Expr> > &_constraints) :
-    constraints(_constraints) {}
+    constraints(_constraints), factored(_constraints.empty()) {}
 
-  ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {}
+  ConstraintManager(const ConstraintManager &cs)
+    : constraints(cs.constraints), factors(cs.factors),
+      factored(cs.factored) {}
 
   typedef std::vector< ref<Expr> >::const_iterator constraint_iterator;
 
@@ -43,11 +48,23 @@ public:
 
   void clear() {
     constraints.clear();
+    factors.reset();
+    factored = true;
   }
 
   ref<Expr> simplifyExpr(ref<Expr> e) const;
 
   void addConstraint(ref<Expr> e);
+
+  /// Collect, in order, the constraints which share array bytes with \p e,
+  /// directly or through other constraints. This is the factor the
+  /// independent solver needs for a query on \p e, read off the partition
+  /// kept up to date by addConstraint.
+  ///
+  /// \return false if no partition is available (the manager was created
+  /// from a raw constraint vector), in which case \p result is untouched.
+  bool getRelatedConstraints(ref<Expr> e,
+                             std::vector< ref<Expr> > &result) const;
   
   bool empty() const {
     return constraints.empty();
@@ -74,10 +91,19 @@ public:
 private:
   std::vector< ref<Expr> > constraints;
 
+  // Partition of the constraints into independent factors. Copies share it,
+  // and a change copies only the factors and array tables it touches.
+  std::shared_ptr<ConstraintFactors> factors;
+  // false if constraints were supplied without going through addConstraint
+  bool factored;
+
   // returns true iff the constraints were modified
   bool rewriteConstraints(ExprVisitor &visitor);
 
   void addConstraintInternal(ref<Expr> e);
+
+  ConstraintFactors &getWriteableFactors();
+  void pushConstraint(ref<Expr> e);
 };
 
 }
@@ -13,6 +13,7 @@
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/Internal/ADT/TreeStream.h"
+#include "klee/Internal/Module/Cell.h"
 #include "klee/MergeHandler.h"
 #include "klee/Internal/ADT/ImmutableSet.h"
 #include "klee/util/GetExprSymbols.h"
@@ -26,6 +27,7 @@
 #include <llvm/Analysis/LoopInfo.h>
 
 #include <map>
+#include <memory>
 #include <regex>
 #include <set>
 #include <vector>
@@ -33,12 +35,13 @@
 namespace llvm {
   class Function;
   class BasicBlock;
+  class GlobalValue;
+  class Module;
 }
 
 namespace klee {
 class Array;
 class CallPathNode;
-struct Cell;
 struct KFunction;
 struct KInstruction;
 class MemoryObject;
@@ -54,7 +57,17 @@ struct StackFrame {
   CallPathNode *callPathNode;
 
   std::vector<const MemoryObject *> allocas;
-  Cell *locals;
+
+private:
+  /// The registers of the function, allocated by the first write and shared
+  /// between the copies of a frame made by forks until one of them writes a
+  /// register.
+  std::shared_ptr<Cell> locals;
+
+  /// What registers read as before the first write.
+  static const Cell noLocal;
+
+public:
 
   /// Minimum distance to an uncovered instruction once the function
   /// returns. This is not a good place for this but is used to
@@ -71,8 +84,22 @@ struct StackFrame {
   MemoryObject *varargs;
 
   StackFrame(KInstIterator caller, KFunction *kf);
-  StackFrame(const StackFrame &s);
-  ~StackFrame();
+
+  const Cell &getLocal(unsigned index) const {
+    return locals ? locals.get()[index] : noLocal;
+  }
+
+  /// Get register \a index for writing, first allocating the registers or
+  /// taking a private copy of them if they are still shared with another
+  /// frame.
+  Cell &getWriteableLocal(unsigned index) {
+    if (!locals || locals.use_count() > 1)
+      copyLocals();
+    return locals.get()[index];
+  }
+
+private:
+  void copyLocals();
 };
 
 struct FunctionAlias {
@@ -82,6 +109,16 @@ struct FunctionAlias {
   std::string alias;
 };
 
+/// The function aliases of a state, shared by the states forked from it
+/// until one of them adds or removes an alias.
+struct FunctionAliasTable {
+  std::vector<FunctionAlias> aliases;
+
+  /// Globals already looked up in \ref aliases, mapped to the global calls
+  /// to them go to (themselves if they have no alias).
+  std::map<const llvm::GlobalValue *, llvm::GlobalValue *> resolved;
+};
+
 struct FieldDescr {
   Expr::Width width;
   std::string type;
@@ -95,6 +132,9 @@ struct FieldDescr {
 
   bool sameInvocationValue(const FieldDescr& other) const;
   bool eq(const FieldDescr& other) const;
+  /// Hashes agreeing with eq() and sameInvocationValue() respectively.
+  unsigned hash() const;
+  unsigned invocationHash() const;
 };
 
 struct CallArg {
@@ -107,6 +147,8 @@ struct CallArg {
 
   bool eq(const CallArg& other) const;
   bool sameInvocationValue(const CallArg& other) const;
+  unsigned hash() const;
+  unsigned invocationHash() const;
 };
 
 struct RetVal {
@@ -117,6 +159,7 @@ struct RetVal {
   FieldDescr pointee;
 
   bool eq(const RetVal& other) const;
+  unsigned hash() const;
 };
 
 struct CallExtraPtr {
@@ -129,6 +172,7 @@ struct CallExtraPtr {
 
   bool sameInvocationValue(const CallExtraPtr& other) const;
   bool eq(const CallExtraPtr& other) const;
+  unsigned hash() const;
 };
 
 //TODO: Store assumptions increment as well. it is an important part of the call
@@ -146,7 +190,51 @@ struct CallInfo {
   CallArg* getCallArgPtrp(ref<Expr> ptr);
   bool eq(const CallInfo& other) const;
   bool sameInvocation(const CallInfo* other) const;
+  /// Structural hashes: calls that are eq() (resp. the same invocation)
+  /// hash the same.
+  unsigned hash() const;
+  unsigned invocationHash() const;
   SymbolSet computeRetSymbolSet() const;
+  /// Whether the output value of every traced pointer argument, and of the
+  /// traced fields of its pointee, is known. Call paths are written up to
+  /// the first call for which it is not.
+  bool hasAllOutValues() const;
+};
+
+/// @brief The calls traced along a path, kept as a persistent list: a
+/// branched state shares the calls made before the fork with its parent and
+/// only allocates the ones it makes afterwards.
+///
+/// Only the last call can be modified; it is copied first if another state
+/// still shares it.
+class CallPath {
+  struct Node {
+    std::shared_ptr<Node> prev;
+    CallInfo info;
+  };
+
+  std::shared_ptr<Node> last;
+  size_t length;
+
+public:
+  CallPath() : length(0) {}
+  CallPath(const CallPath &) = default;
+  CallPath &operator=(const CallPath &) = default;
+  ~CallPath();
+
+  bool empty() const { return !last; }
+  size_t size() const { return length; }
+
+  const CallInfo &back() const {
+    assert(last && "empty call path");
+    return last->info;
+  }
+  CallInfo &back();
+
+  void push_back(const CallInfo &info);
+
+  /// The calls in the order they were made.
+  std::vector<const CallInfo *> getCalls() const;
 };
 
 struct HavocInfo {
@@ -174,6 +262,9 @@ private:
   bool lastRoundUpdated;
   //Owner for the bitarrays.
   StateByteMask changedBytes;
+  /// The writes recorded in the header state on behalf of the enclosing
+  /// loop analysis, handed back once this loop is done.
+  MemoryObjectSet enclosingWrites;
   //std::set<const MemoryObject *> changedObjects;
 
   ExecutionState *makeRestartState();
@@ -203,9 +294,14 @@ private:
   // unsupported, use copy constructor
   ExecutionState &operator=(const ExecutionState &);
 
-  std::vector<FunctionAlias> fnAliases;
-  std::map<uint64_t, std::string> readsIntercepts;
-  std::map<uint64_t, std::string> writesIntercepts;
+  /// Null while the state has no aliases.
+  std::shared_ptr<FunctionAliasTable> fnAliases;
+
+  std::vector<FunctionAlias> &editFnAliases();
+  /// Interceptors by object address, applied to the objects bound at these
+  /// addresses. The executor looks at the ones on the ObjectState.
+  std::map<uint64_t, llvm::Function *> readsIntercepts;
+  std::map<uint64_t, llvm::Function *> writesIntercepts;
 
 public:
   // Execution - Control Flow specific
@@ -306,7 +402,7 @@ public:
   /// @brief Set of used array names for this state.  Used to avoid collisions.
   std::set<std::string> arrayNames;
 
-  std::vector<CallInfo> callPath;
+  CallPath callPath;
   SymbolSet relevantSymbols;
 
   /// @brief: a flag indicating that the state is genuine and not
@@ -318,15 +414,19 @@ public:
   bool condoneUndeclaredHavocs;
 
 
-  std::string getFnAlias(std::string fn);
+  std::string getFnAlias(const std::string &fn) const;
+  /// The global that calls to \p gv go to: \p gv itself if it has no alias,
+  /// or null if its alias does not name a global of \p module.
+  llvm::GlobalValue *resolveFnAlias(llvm::GlobalValue *gv,
+                                    llvm::Module *module);
   void addFnAlias(std::string old_fn, std::string new_fn);
   void addFnRegexAlias(std::string fn_regex, std::string new_fn);
   void removeFnAlias(std::string fn);
 
-  std::string getInterceptReader(uint64_t addr);
-  std::string getInterceptWriter(uint64_t addr);
-  void addReadsIntercept(uint64_t addr, std::string reader);
-  void addWritesIntercept(uint64_t addr, std::string writer);
+  llvm::Function *getInterceptReader(uint64_t addr) const;
+  llvm::Function *getInterceptWriter(uint64_t addr) const;
+  void addReadsIntercept(uint64_t addr, llvm::Function *reader);
+  void addWritesIntercept(uint64_t addr, llvm::Function *writer);
 
   // The objects handling the klee_open_merge calls this state ran through
   std::vector<ref<MergeHandler> > openMergeStack;
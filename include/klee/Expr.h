@@ -10,6 +10,7 @@
 #ifndef KLEE_EXPR_H
 #define KLEE_EXPR_H
 
+#include "klee/Config/config.h"
 #include "klee/util/Bits.h"
 #include "klee/util/Ref.h"
 
@@ -19,6 +20,7 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
 #include <sstream>
 #include <set>
 #include <vector>
@@ -38,6 +40,15 @@ class ObjectState;
 
 template<class T> class ref;
 
+#ifdef KLEE_THREADSAFE_EXPR
+/// Reference counts of expressions and update nodes. They are only atomic
+/// when KLEE is configured with ENABLE_THREADSAFE_EXPR, so the single
+/// threaded tools do not pay for a locked update on every ref copy.
+typedef std::atomic<unsigned> ExprRefCount;
+#else
+typedef unsigned ExprRefCount;
+#endif
+
 
 /// Class representing symbolic expressions.
 /**
@@ -89,7 +100,13 @@ Todo: Shouldn't bool \c Xor just be written as not equal?
 
 class Expr {
 public:
-  static unsigned count;
+  static ExprRefCount count;
+  /// Whether threads may share expressions, see ExprRefCount.
+#ifdef KLEE_THREADSAFE_EXPR
+  static const bool threadSafe = true;
+#else
+  static const bool threadSafe = false;
+#endif
   static const unsigned MAGIC_HASH_CONSTANT = 39;
 
   /// The type of an expression is simply its width, in bits. 
@@ -172,7 +189,7 @@ public:
     CmpKindLast=Sge
   };
 
-  unsigned refCount;
+  ExprRefCount refCount;
 
 protected:  
   unsigned hashValue;
@@ -449,7 +466,7 @@ public:
 class UpdateNode {
   friend class UpdateList;  
 
-  mutable unsigned refCount;
+  mutable ExprRefCount refCount;
   // cache instead of recalc
   unsigned hashValue;
 
@@ -86,6 +86,14 @@ namespace klee {
   ///
   /// Base - The base builder to use when constructing expressions.
   ExprBuilder *createSimplifyingExprBuilder(ExprBuilder *Base);
+
+  /// createHashConsingExprBuilder - Create an expression builder which
+  /// returns the same object for structurally equal expressions, by keeping a
+  /// unique table of everything it built. Use a single instance to share
+  /// expressions across everything built with it.
+  ///
+  /// Base - The base builder to use when constructing expressions.
+  ExprBuilder *createHashConsingExprBuilder(ExprBuilder *Base);
 }
 
 #endif
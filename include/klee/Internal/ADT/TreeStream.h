@@ -30,6 +30,8 @@ namespace klee {
     std::string path;
     std::ofstream *output;
     unsigned ids;
+    // size of the file at the last flush()
+    unsigned long flushedSize;
 
     void write(TreeOStream &os, const char *s, unsigned size);
     void flushBuffer();
@@ -45,6 +47,11 @@ namespace klee {
 
     void flush();
 
+    /// Continue writing in a copy of the file, as of the last flush(), at
+    /// \p newPath. Used by a forked process, which must not write to the
+    /// file it shares with its parent.
+    bool continueIn(const std::string &newPath);
+
     // hack, to be replace by proper stream capabilities
     void readStream(TreeStreamID id,
                     std::vector<unsigned char> &out);
@@ -31,6 +31,22 @@ class ExecutionState;
 class Interpreter;
 class TreeStreamWriter;
 
+/// Hands out output file ids that are unique over all the worker processes
+/// of a split search.
+class WorkerIds {
+public:
+  enum Kind { TestCase, CallPath, CallPrefix, NumKinds };
+
+  virtual ~WorkerIds() {}
+
+  /// Mark the ids up to \p used as taken. Only valid before any worker
+  /// was started.
+  virtual void reserve(Kind kind, unsigned used) = 0;
+
+  /// Return the next free id of the given kind.
+  virtual unsigned next(Kind kind) = 0;
+};
+
 class InterpreterHandler {
 public:
   InterpreterHandler() {}
@@ -47,6 +63,26 @@ public:
                                const char *err, 
                                const char *suffix) = 0;
   virtual void processCallPath(const ExecutionState &state) = 0;
+
+  /// Called with \p workerId 0 before the first workers of a split search
+  /// are started, then in every new worker right after it was started. From
+  /// then on output file ids are taken from \p ids, so that the workers never
+  /// write the same file.
+  virtual void setWorkerId(unsigned workerId, WorkerIds &ids) {}
+
+  /// Write out any output still queued. Called before the process forks the
+  /// workers of a split search and before a worker exits.
+  virtual void finishPendingOutput() {}
+
+  /// Called in a worker other than worker 0 right before it exits, to write
+  /// the output that is otherwise written once the run is over.
+  virtual void finishWorker() { finishPendingOutput(); }
+
+  virtual unsigned getNumPathsExplored() { return 0; }
+  virtual unsigned getNumTestCases() { return 0; }
+
+  /// Account for the paths and test cases produced by another worker.
+  virtual void addWorkerResults(unsigned pathsExplored, unsigned testCases) {}
 };
 
 struct HavocedLocation {
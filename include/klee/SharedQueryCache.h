@@ -0,0 +1,55 @@
+//===-- SharedQueryCache.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SHAREDQUERYCACHE_H
+#define KLEE_SHAREDQUERYCACHE_H
+
+#include "klee/IncompleteSolver.h"
+
+#include <memory>
+
+namespace klee {
+  class ConstraintManager;
+
+  /// SharedQueryCache - The (partial) validity of queries, as remembered by
+  /// the caching solver. Several caching solvers, each in the solver chain
+  /// of a different thread, can share one cache.
+  ///
+  /// Entries are spread over a fixed number of shards by hash, each behind
+  /// its own lock, so that threads working on different queries rarely wait
+  /// for each other.
+  class SharedQueryCache {
+    struct Shard;
+
+    std::unique_ptr<Shard[]> shards;
+    unsigned numShards;
+
+    Shard &getShard(unsigned hash) const;
+
+  public:
+    /// \param numShards - Number of independently locked shards; one is
+    /// enough for a cache used by a single thread.
+    explicit SharedQueryCache(unsigned numShards = 64);
+    ~SharedQueryCache();
+
+    /// Look up the validity of \p query under \p constraints. \p query
+    /// should be canonical with respect to negation.
+    bool lookup(const ConstraintManager &constraints, const ref<Expr> &query,
+                IncompleteSolver::PartialValidity &result) const;
+
+    /// Remember the validity of \p query under \p constraints, unless the
+    /// cache already knows something about it.
+    void insert(const ConstraintManager &constraints, const ref<Expr> &query,
+                IncompleteSolver::PartialValidity result);
+
+    void clear();
+  };
+}
+
+#endif
@@ -18,6 +18,7 @@
 namespace klee {
   class ConstraintManager;
   class Expr;
+  class SharedQueryCache;
   class SolverImpl;
 
   struct Query {
@@ -187,6 +188,13 @@ namespace klee {
                           const std::vector<const Array*> &objects,
                           std::vector< std::vector<unsigned char> > &result);
 
+    /// Like getInitialValues, but sets \a hasSolution instead of failing
+    /// when there is no satisfying assignment.
+    bool getInitialValues(const Query&,
+                          const std::vector<const Array*> &objects,
+                          std::vector< std::vector<unsigned char> > &result,
+                          bool &hasSolution);
+
     /// getRange - Compute a tight range of possible values for a given
     /// expression.
     ///
@@ -226,6 +234,22 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCachingSolver(Solver *s);
 
+  /// createCachingSolver - Create a solver which caches the queries in
+  /// \a cache, which may be shared with caching solvers on other threads.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param cache - The cache to use, which must outlive the solver.
+  Solver *createCachingSolver(Solver *s, SharedQueryCache *cache);
+
+  /// createPersistentCachingSolver - Create a solver which caches validity
+  /// results and values in the file at \a path, so that they are shared
+  /// with later runs and with other processes using the same file. Queries
+  /// are identified by a hash that ignores the names of their arrays.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, created if it does not exist.
+  Solver *createPersistentCachingSolver(Solver *s, const std::string &path);
+
   /// createCexCachingSolver - Create a counterexample caching solver. This is a
   /// more sophisticated cache which records counterexamples for a constraint
   /// set and uses subset/superset relations among constraints to try and
@@ -259,6 +283,17 @@ namespace klee {
                                     int minQueryTimeToLog);
 
 
+  /// createPortfolioSolver - Create a solver which races the given core
+  /// solvers, each in a forked process, and answers with the first result.
+  /// It keeps per query shape statistics of the winners, and once one
+  /// backend reliably wins a shape, sends such queries only to that backend,
+  /// in process.
+  ///
+  /// \param solvers - The core solvers to race, owned by the new solver.
+  /// \param names - Their names, for the statistics.
+  Solver *createPortfolioSolver(const std::vector<Solver *> &solvers,
+                                const std::vector<std::string> &names);
+
   /// createDummySolver - Create a dummy solver implementation which always
   /// fails.
   Solver *createDummySolver();
@@ -16,6 +16,8 @@ namespace klee {
 namespace stats {
 
   extern Statistic cexCacheTime;
+  extern Statistic portfolioRaces;
+  extern Statistic portfolioShortcuts;
   extern Statistic queries;
   extern Statistic queriesInvalid;
   extern Statistic queriesValid;
@@ -26,6 +28,10 @@ namespace stats {
   extern Statistic queryConstructTime;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
+  extern Statistic queryIncrementalFallbacks;
+  extern Statistic queryIncrementalReused;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
   extern Statistic queryTime;
   
 #ifdef KLEE_ARRAY_DEBUG
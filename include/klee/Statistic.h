@@ -33,10 +33,14 @@ namespace klee {
     unsigned id;
     const std::string name;
     const std::string shortName;
+    /// Whether several threads may increment the statistic. Only shared
+    /// statistics pay for an atomic update.
+    const bool shared;
 
   public:
     Statistic(const std::string &_name, 
-              const std::string &_shortName);
+              const std::string &_shortName,
+              bool _shared = false);
     ~Statistic();
 
     /// getID - Get the unique statistic ID.
@@ -45,6 +45,17 @@ namespace klee {
     uint64_t *indexedStats;
     StatisticRecord *contextStats;
     unsigned index;
+    unsigned totalIndices;
+
+    /// Whether each index changed since trackIndexChanges(), null when
+    /// changes are not tracked.
+    char *changedFlags;
+    std::vector<unsigned> changedIndices;
+    /// The values of the changed indices when tracking started, one row of
+    /// getNumStatistics() values per entry of changedIndices.
+    std::vector<uint64_t> changedBase;
+
+    void saveIndex(unsigned i);
 
   public:
     StatisticManager();
@@ -55,18 +66,40 @@ namespace klee {
     StatisticRecord *getContext();
     void setContext(StatisticRecord *sr); /* null to reset */
 
-    void setIndex(unsigned i) { index = i; }
+    void setIndex(unsigned i) {
+      index = i;
+      if (changedFlags && !changedFlags[i])
+        saveIndex(i);
+    }
     unsigned getIndex() { return index; }
     unsigned getNumStatistics() { return stats.size(); }
+    unsigned getNumIndices() { return indexedStats ? totalIndices : 0; }
     Statistic &getStatistic(unsigned i) { return *stats[i]; }
     
     void registerStatistic(Statistic &s);
     void incrementStatistic(Statistic &s, uint64_t addend);
     uint64_t getValue(const Statistic &s) const;
+    /// Add to the global value only, bypassing the indexed and context
+    /// records (used when merging statistics gathered elsewhere).
+    void incrementGlobalValue(const Statistic &s, uint64_t addend);
     void incrementIndexedValue(const Statistic &s, unsigned index, 
-                               uint64_t addend) const;
+                               uint64_t addend);
     uint64_t getIndexedValue(const Statistic &s, unsigned index) const;
     void setIndexedValue(const Statistic &s, unsigned index, uint64_t value);
+
+    /// Start recording which indices are changed through setIndex() and
+    /// incrementIndexedValue(), forgetting earlier changes. Values stored with
+    /// setIndexedValue() at other indices are not recorded.
+    void trackIndexChanges();
+    /// The indices changed since trackIndexChanges().
+    const std::vector<unsigned> &getChangedIndices() const {
+      return changedIndices;
+    }
+    /// The value \arg s had when tracking started at the \arg i-th changed
+    /// index.
+    uint64_t getChangedBaseValue(const Statistic &s, unsigned i) const {
+      return changedBase[i*stats.size() + s.id];
+    }
     int getStatisticID(const std::string &name) const;
     Statistic *getStatisticByName(const std::string &name) const;
   };
@@ -76,7 +109,13 @@ namespace klee {
   inline void StatisticManager::incrementStatistic(Statistic &s, 
                                                    uint64_t addend) {
     if (enabled) {
-      globalStats[s.id] += addend;
+      // Solver chains on several threads update the same global solver
+      // counters. Indexed and context statistics belong to the executor,
+      // which is single threaded.
+      if (s.shared)
+        __atomic_fetch_add(&globalStats[s.id], addend, __ATOMIC_RELAXED);
+      else
+        globalStats[s.id] += addend;
       if (indexedStats) {
         indexedStats[index*stats.size() + s.id] += addend;
         if (contextStats)
@@ -133,9 +172,16 @@ namespace klee {
     return globalStats[s.id];
   }
 
+  inline void StatisticManager::incrementGlobalValue(const Statistic &s,
+                                                     uint64_t addend) {
+    globalStats[s.id] += addend;
+  }
+
   inline void StatisticManager::incrementIndexedValue(const Statistic &s, 
                                                       unsigned index,
-                                                      uint64_t addend) const {
+                                                      uint64_t addend) {
+    if (changedFlags && !changedFlags[index])
+      saveIndex(index);
     indexedStats[index*stats.size() + s.id] += addend;
   }
 
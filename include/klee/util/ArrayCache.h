@@ -22,6 +22,7 @@
 #define unordered_set std::tr1::unordered_set
 #endif
 
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -73,6 +74,9 @@ private:
   ArrayHashMap cachedSymbolicArrays;
   typedef std::vector<const Array *> ArrayPtrVec;
   ArrayPtrVec concreteArrays;
+  /// Arrays may be created from several threads, e.g. by parsers running
+  /// concurrently on a shared cache.
+  std::mutex lock;
 };
 }
 
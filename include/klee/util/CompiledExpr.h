@@ -0,0 +1,74 @@
+//===-- CompiledExpr.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COMPILEDEXPR_H
+#define KLEE_COMPILEDEXPR_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+  class Assignment;
+
+  /// CompiledExpr - An expression flattened into a straight-line program over
+  /// 64-bit values, for evaluating the same expression under many concrete
+  /// assignments.
+  ///
+  /// Evaluation gives the same result as Assignment::evaluate, but does not
+  /// allocate and visits every shared subexpression once. Expressions with
+  /// values wider than 64 bits are not compiled.
+  class CompiledExpr {
+    struct Inst {
+      Expr::Kind kind;
+      Expr::Width width;
+      /// Operand slots. For reads: the index slot, the array number and the
+      /// first update in \ref updates.
+      unsigned ops[3];
+      /// The value of a constant, the offset of an extract, or the number of
+      /// updates of a read.
+      uint64_t imm;
+    };
+
+    struct Update {
+      unsigned index, value;
+    };
+
+    std::vector<Inst> insts;
+    std::vector<Update> updates;
+    std::vector<const Array*> arrays;
+
+    // Scratch space for evaluate(), which is therefore not reentrant.
+    mutable std::vector<uint64_t> values;
+    mutable std::vector<const std::vector<unsigned char>*> bytes;
+
+    CompiledExpr() {}
+
+    bool compile(const ref<Expr> &e,
+                 std::map<const Expr*, unsigned> &slots,
+                 unsigned &slot);
+
+  public:
+    /// compile - Compile \arg e, or return null if it cannot be compiled.
+    static CompiledExpr *compile(const ref<Expr> &e);
+
+    Expr::Width getWidth() const { return insts.back().width; }
+
+    /// evaluate - Evaluate the expression under \arg a.
+    ///
+    /// \return False if the result is not a constant (a division by zero was
+    /// reached, or \arg a allows free values and leaves a byte unbound); the
+    /// caller should then fall back to Assignment::evaluate.
+    bool evaluate(const Assignment &a, uint64_t &result) const;
+  };
+}
+
+#endif
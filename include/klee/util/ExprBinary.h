@@ -0,0 +1,113 @@
+//===-- ExprBinary.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRBINARY_H
+#define KLEE_EXPRBINARY_H
+
+#include "klee/Expr.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace klee {
+  class ArrayCache;
+  class ExprBuilder;
+
+  /// ExprBinaryWriter - Serializes a set of expressions into a compact
+  /// binary form: a table of the arrays they read from followed by a table
+  /// of expression and update nodes in which every kid precedes its parent.
+  /// Structurally equal subexpressions are stored once and referred to by
+  /// their position in the table.
+  ///
+  /// Integers are stored little endian with fixed width, so a reader can
+  /// decode the tables straight out of a memory mapped file.
+  class ExprBinaryWriter {
+    std::string arrayTable, nodeTable;
+    uint32_t numArrays, numNodes;
+    uint32_t numExprs, numUpdates;
+
+    std::map<const Array *, uint32_t> arrayIds;
+    std::map<const UpdateNode *, uint32_t> updateIds;
+    ExprHashMap<uint32_t> exprIds;
+
+    uint32_t addArray(const Array *array);
+    uint32_t addUpdate(const UpdateNode *un);
+
+  public:
+    /// Id standing for a null expression or an empty update list.
+    static const uint32_t NoId = ~0u;
+
+    ExprBinaryWriter();
+
+    /// Add \p e (and everything it refers to) to the tables, returning its
+    /// id, or NoId if \p e is null.
+    uint32_t addExpr(const ref<Expr> &e);
+
+    /// Write the header and both tables.
+    void write(llvm::raw_ostream &os) const;
+
+    static void writeU8(llvm::raw_ostream &os, uint8_t v);
+    static void writeU32(llvm::raw_ostream &os, uint32_t v);
+    static void writeU64(llvm::raw_ostream &os, uint64_t v);
+    static void writeString(llvm::raw_ostream &os, const std::string &s);
+  };
+
+  /// ExprBinaryReader - Decodes the tables written by ExprBinaryWriter from
+  /// a memory buffer, and then any data the client appended after them.
+  ///
+  /// All read methods return false once the buffer is exhausted or found to
+  /// be malformed; the reader stays in that state.
+  class ExprBinaryReader {
+    const char *pos, *end;
+    bool failed;
+
+    ExprBuilder *builder;
+    ArrayCache *arrayCache;
+
+    std::vector<const Array *> arrays;
+    std::vector<ref<Expr> > exprs;
+    std::vector<UpdateList> updates;
+
+    bool fail() { failed = true; return false; }
+    bool readArray();
+    bool readNode();
+    bool readKid(ref<Expr> &e);
+
+  public:
+    /// Decode from [\p begin, \p end). Expressions are created with \p
+    /// builder, arrays with \p arrayCache; both must outlive the results.
+    ExprBinaryReader(const char *begin, const char *end, ExprBuilder *builder,
+                     ArrayCache *arrayCache);
+
+    /// Whether the buffer starts with the header written by ExprBinaryWriter.
+    static bool isExprBinary(const char *begin, const char *end);
+
+    /// Read the header and both tables.
+    bool readTables();
+
+    const std::vector<const Array *> &getArrays() const { return arrays; }
+
+    bool atEnd() const { return pos == end; }
+
+    bool readU8(uint8_t &v);
+    bool readU32(uint32_t &v);
+    bool readU64(uint64_t &v);
+    bool readString(std::string &s);
+    /// Read an expression id; NoId yields a null expression.
+    bool readExpr(ref<Expr> &e);
+  };
+}
+
+#endif
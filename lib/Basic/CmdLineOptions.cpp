@@ -38,6 +38,12 @@ UseCache("use-cache",
          cl::init(true),
          cl::desc("Use validity caching (default=on)"));
 
+cl::opt<std::string>
+PersistentQueryCache("persistent-query-cache",
+                     cl::desc("Also cache solver results in this file, "
+                              "shared across runs and processes "
+                              "(default=off)"));
+
 cl::opt<bool>
 UseIndependentSolver("use-independent-solver",
                      cl::init(true),
@@ -170,10 +176,24 @@ CoreSolverToUse("solver-backend", cl::desc("Specifiy the core solver backend to
                 cl::values(clEnumValN(STP_SOLVER, "stp", "stp" STP_IS_DEFAULT_STR),
                            clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT" METASMT_IS_DEFAULT_STR),
                            clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
-                           clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR)
+                           clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+                           clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                                      "Race the backends given by "
+                                      "-portfolio-solvers (not in builds "
+                                      "with ENABLE_THREADSAFE_EXPR)")
                            KLEE_LLVM_CL_VAL_END),
                 cl::init(DEFAULT_CORE_SOLVER));
 
+cl::list<CoreSolverType>
+PortfolioSolvers("portfolio-solvers",
+                 cl::desc("Comma separated list of the backends raced by the "
+                          "portfolio solver (default=all available)"),
+                 cl::values(clEnumValN(STP_SOLVER, "stp", "stp"),
+                            clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+                            clEnumValN(Z3_SOLVER, "z3", "Z3")
+                            KLEE_LLVM_CL_VAL_END),
+                 cl::CommaSeparated);
+
 cl::opt<CoreSolverType>
 DebugCrossCheckCoreSolverWith("debug-crosscheck-core-solver",
                               cl::desc("Specifiy a solver to use for cross checking with the core solver"),
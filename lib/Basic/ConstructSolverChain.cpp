@@ -46,6 +46,9 @@ Solver *constructSolverChain(Solver *coreSolver,
   if (UseCexCache)
     solver = createCexCachingSolver(solver);
 
+  if (!PersistentQueryCache.empty())
+    solver = createPersistentCachingSolver(solver, PersistentQueryCache);
+
   if (UseCache)
     solver = createCachingSolver(solver);
 
@@ -18,20 +18,46 @@ StatisticManager::StatisticManager()
     globalStats(0),
     indexedStats(0),
     contextStats(0),
-    index(0) {
+    index(0),
+    totalIndices(0),
+    changedFlags(0) {
 }
 
 StatisticManager::~StatisticManager() {
   delete[] globalStats;
   delete[] indexedStats;
+  delete[] changedFlags;
 }
 
 void StatisticManager::useIndexedStats(unsigned totalIndices) {  
   delete[] indexedStats;
+  this->totalIndices = totalIndices;
   indexedStats = new uint64_t[totalIndices * stats.size()];
   memset(indexedStats, 0, sizeof(*indexedStats) * totalIndices * stats.size());
 }
 
+void StatisticManager::trackIndexChanges() {
+  if (!indexedStats)
+    return;
+  if (!changedFlags) {
+    changedFlags = new char[totalIndices];
+    memset(changedFlags, 0, totalIndices);
+  }
+  for (unsigned i = 0; i < changedIndices.size(); ++i)
+    changedFlags[changedIndices[i]] = 0;
+  changedIndices.clear();
+  changedBase.clear();
+  // The current index may be updated before setIndex() is called again.
+  saveIndex(index);
+}
+
+void StatisticManager::saveIndex(unsigned i) {
+  changedFlags[i] = 1;
+  changedIndices.push_back(i);
+  uint64_t *row = &indexedStats[i * stats.size()];
+  changedBase.insert(changedBase.end(), row, row + stats.size());
+}
+
 void StatisticManager::registerStatistic(Statistic &s) {
   delete[] globalStats;
   s.id = stats.size();
@@ -65,9 +91,11 @@ static StatisticManager &getStatisticManager() {
 /* *** */
 
 Statistic::Statistic(const std::string &_name, 
-                     const std::string &_shortName) 
+                     const std::string &_shortName,
+                     bool _shared) 
   : name(_name), 
-    shortName(_shortName) {
+    shortName(_shortName),
+    shared(_shared) {
   getStatisticManager().registerStatistic(*this);
 }
 
@@ -14,19 +14,246 @@
 
 #include "klee/Expr.h"
 #include "klee/TimerStatIncrementer.h"
+#include "klee/util/Bits.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
 
 using namespace klee;
 
+namespace {
+  llvm::cl::opt<bool>
+  UsePageIndex("use-page-index",
+               llvm::cl::desc("Index the address space by page to resolve "
+                              "concrete addresses quickly (default=on)"),
+               llvm::cl::init(true));
+}
+
+///
+
+namespace {
+  /// Pages are 4KiB, and the six levels of 64 slots each cover the 48 bit
+  /// addresses user space lives in.
+  const unsigned PageBits = 12;
+  const unsigned LevelBits = 6;
+  const unsigned NumLevels = 6;
+  const unsigned Fanout = 1 << LevelBits;
+
+  /// Larger objects are left to the MemoryMap, entering them would make
+  /// every copy-on-write of the object touch too many pages.
+  const uint64_t MaxIndexedPages = 1024;
+
+  /// Nodes and pages currently allocated by all indices.
+  unsigned numAllocated = 0;
+}
+
+// Updating a page of an index that shares its nodes with a copy copies the
+// whole path to it: up to six nodes of 64 slots (about 3KiB) and the page.
+// Every object state an address space copies on write goes through this
+// once per page it spans.
+
+struct PageIndex::Node {
+  unsigned refCount;
+  /// Nodes on the inner levels, pages on the last one.
+  void *slots[Fanout];
+
+  Node() : refCount(1) {
+    std::fill(slots, slots + Fanout, (void *)0);
+    ++numAllocated;
+  }
+  Node(const Node &b) : refCount(1) {
+    std::copy(b.slots, b.slots + Fanout, slots);
+    ++numAllocated;
+  }
+  ~Node() { --numAllocated; }
+};
+
+struct PageIndex::Page {
+  unsigned refCount;
+  /// The objects overlapping the page, ordered by address.
+  std::vector<ObjectPair> objects;
+
+  Page() : refCount(1) { ++numAllocated; }
+  Page(const Page &b) : refCount(1), objects(b.objects) { ++numAllocated; }
+  ~Page() { --numAllocated; }
+};
+
+unsigned PageIndex::getNumAllocated() {
+  return numAllocated;
+}
+
+void PageIndex::retain(void *slot, unsigned level) {
+  if (level < NumLevels)
+    ++static_cast<Node *>(slot)->refCount;
+  else
+    ++static_cast<Page *>(slot)->refCount;
+}
+
+void PageIndex::release(void *slot, unsigned level) {
+  if (level < NumLevels) {
+    Node *node = static_cast<Node *>(slot);
+    if (--node->refCount)
+      return;
+    for (unsigned i = 0; i < Fanout; ++i)
+      if (node->slots[i])
+        release(node->slots[i], level + 1);
+    delete node;
+  } else {
+    Page *page = static_cast<Page *>(slot);
+    if (--page->refCount == 0)
+      delete page;
+  }
+}
+
+PageIndex::Node *PageIndex::getWriteableNode(void *&slot, unsigned level) {
+  Node *node = static_cast<Node *>(slot);
+  if (!node) {
+    node = new Node();
+  } else if (node->refCount > 1) {
+    Node *copy = new Node(*node);
+    for (unsigned i = 0; i < Fanout; ++i)
+      if (copy->slots[i])
+        retain(copy->slots[i], level + 1);
+    --node->refCount;
+    node = copy;
+  }
+  slot = node;
+  return node;
+}
+
+PageIndex::PageIndex(const PageIndex &b) : root(b.root) {
+  if (root)
+    retain(root, 0);
+}
+
+PageIndex &PageIndex::operator=(const PageIndex &b) {
+  if (b.root)
+    retain(b.root, 0);
+  if (root)
+    release(root, 0);
+  root = b.root;
+  return *this;
+}
+
+PageIndex::~PageIndex() {
+  if (root)
+    release(root, 0);
+}
+
+bool PageIndex::getPageRange(const MemoryObject *mo, uint64_t &first,
+                             uint64_t &last) {
+  // Zero sized objects still occupy their address.
+  uint64_t end = mo->address + std::max(mo->size, 1u) - 1;
+  if (end < mo->address)
+    return false;
+  first = mo->address >> PageBits;
+  last = end >> PageBits;
+  return (last >> (NumLevels * LevelBits)) == 0 &&
+         last - first < MaxIndexedPages;
+}
+
+void PageIndex::updatePage(uint64_t pageNum, const MemoryObject *mo,
+                           const ObjectState *os) {
+  void **slot = &root;
+  for (unsigned level = 0; level < NumLevels; ++level) {
+    Node *node = getWriteableNode(*slot, level);
+    unsigned shift = (NumLevels - 1 - level) * LevelBits;
+    slot = &node->slots[(pageNum >> shift) & (Fanout - 1)];
+  }
+
+  Page *page = static_cast<Page *>(*slot);
+  if (!page) {
+    if (!os)
+      return;
+    page = new Page();
+    *slot = page;
+  } else if (page->refCount > 1) {
+    --page->refCount;
+    page = new Page(*page);
+    *slot = page;
+  }
+
+  std::vector<ObjectPair>::iterator it = page->objects.begin(),
+                                    ie = page->objects.end();
+  while (it != ie && it->first->address < mo->address)
+    ++it;
+  bool found = it != ie && it->first == mo;
+  if (os) {
+    if (found)
+      it->second = os;
+    else
+      page->objects.insert(it, ObjectPair(mo, os));
+  } else if (found) {
+    page->objects.erase(it);
+    if (page->objects.empty()) {
+      delete page;
+      *slot = 0;
+    }
+  }
+}
+
+void PageIndex::insert(const MemoryObject *mo, const ObjectState *os) {
+  uint64_t first, last;
+  if (getPageRange(mo, first, last))
+    for (uint64_t pageNum = first; pageNum <= last; ++pageNum)
+      updatePage(pageNum, mo, os);
+}
+
+void PageIndex::remove(const MemoryObject *mo) {
+  uint64_t first, last;
+  if (getPageRange(mo, first, last))
+    for (uint64_t pageNum = first; pageNum <= last; ++pageNum)
+      updatePage(pageNum, mo, 0);
+}
+
+bool PageIndex::lookup(uint64_t address, ObjectPair &result) const {
+  uint64_t pageNum = address >> PageBits;
+  if (pageNum >> (NumLevels * LevelBits))
+    return false;
+
+  const void *slot = root;
+  for (unsigned level = 0; level < NumLevels; ++level) {
+    if (!slot)
+      return false;
+    unsigned shift = (NumLevels - 1 - level) * LevelBits;
+    slot = static_cast<const Node *>(slot)
+               ->slots[(pageNum >> shift) & (Fanout - 1)];
+  }
+  if (!slot)
+    return false;
+
+  const Page *page = static_cast<const Page *>(slot);
+  for (std::vector<ObjectPair>::const_iterator it = page->objects.begin(),
+                                               ie = page->objects.end();
+       it != ie; ++it) {
+    const MemoryObject *mo = it->first;
+    if ((mo->size==0 && address==mo->address) ||
+        (address - mo->address < mo->size)) {
+      result = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
 ///
 
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
   assert(os->copyOnWriteOwner==0 && "object already has owner");
   os->copyOnWriteOwner = cowKey;
   objects = objects.replace(std::make_pair(mo, os));
+  if (UsePageIndex)
+    pages.insert(mo, os);
+  recordWrite(mo);
 }
 
 void AddressSpace::unbindObject(const MemoryObject *mo) {
   objects = objects.remove(mo);
+  if (UsePageIndex)
+    pages.remove(mo);
+  recordWrite(mo);
 }
 
 const ObjectState *AddressSpace::findObject(const MemoryObject *mo) const {
@@ -35,11 +262,21 @@ const ObjectState *AddressSpace::findObject(const MemoryObject *mo) const {
   return res ? res->second : 0;
 }
 
+void AddressSpace::recordChangesSince(const AddressSpace &base) {
+  for (MemoryMap::iterator it = base.objects.begin(), ie = base.objects.end();
+       it != ie; ++it) {
+    const ObjectState *os = findObject(it->first);
+    if (os != static_cast<const ObjectState *>(it->second))
+      recordWrite(it->first);
+  }
+}
+
 ObjectState *AddressSpace::allowAccess(const MemoryObject *mo,
                                const ObjectState *os) {
   assert(!os->readOnly);
   assert(!os->isAccessible());
 
+  recordWrite(mo);
   ObjectState *n;
   if (cowKey==os->copyOnWriteOwner) {
     n = const_cast<ObjectState*>(os);
@@ -47,6 +284,8 @@ ObjectState *AddressSpace::allowAccess(const MemoryObject *mo,
     n = new ObjectState(*os);
     n->copyOnWriteOwner = cowKey;
     objects = objects.replace(std::make_pair(mo, n));
+    if (UsePageIndex)
+      pages.insert(mo, n);
   }
   n->allowAccess();
   return n;
@@ -57,12 +296,15 @@ ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
   assert(!os->readOnly);
   assert(os->isAccessible());
 
+  recordWrite(mo);
   if (cowKey==os->copyOnWriteOwner) {
     return const_cast<ObjectState*>(os);
   } else {
     ObjectState *n = new ObjectState(*os);
     n->copyOnWriteOwner = cowKey;
     objects = objects.replace(std::make_pair(mo, n));
+    if (UsePageIndex)
+      pages.insert(mo, n);
     return n;
   }
 }
@@ -72,6 +314,9 @@ ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
 bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr, 
                               ObjectPair &result) const {
   uint64_t address = addr->getZExtValue();
+  if (pages.lookup(address, result))
+    return true;
+
   MemoryObject hack(address);
 
   if (const MemoryMap::value_type *res = objects.lookup_previous(&hack)) {
@@ -88,6 +333,146 @@ bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr,
   return false;
 }
 
+namespace {
+  /// Unsigned bounds on the values of an expression, whatever the path
+  /// constraints are.
+  struct ValueBounds {
+    uint64_t min, max;
+
+    ValueBounds(uint64_t _min, uint64_t _max) : min(_min), max(_max) {}
+
+    static ValueBounds full(Expr::Width width) {
+      return ValueBounds(0, width >= 64 ? ~(uint64_t)0
+                                        : bits64::maxValueOfNBits(width));
+    }
+  };
+
+  /// Bounds of the expressions seen so far. They do not depend on the
+  /// state, so one cache serves all of them; it is simply dropped when it
+  /// grows too large.
+  ExprHashMap<ValueBounds> boundsCache;
+  const size_t MaxBoundsCacheSize = 1 << 16;
+}
+
+static ValueBounds getBounds(const ref<Expr> &e) {
+  Expr::Width width = e->getWidth();
+  ValueBounds full = ValueBounds::full(width);
+  if (width > 64)
+    return full;
+
+  if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(e))
+    return ValueBounds(CE->getZExtValue(), CE->getZExtValue());
+
+  ExprHashMap<ValueBounds>::iterator it = boundsCache.find(e);
+  if (it != boundsCache.end())
+    return it->second;
+
+  ValueBounds res = full;
+  switch (e->getKind()) {
+  case Expr::ZExt:
+    res = getBounds(e->getKid(0));
+    break;
+
+  case Expr::SExt: {
+    ref<Expr> kid = e->getKid(0);
+    ValueBounds k = getBounds(kid);
+    if (kid->getWidth() <= 64 && !(k.max >> (kid->getWidth() - 1)))
+      res = k;
+    break;
+  }
+
+  case Expr::Extract: {
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    ValueBounds k = getBounds(ee->expr);
+    if (ee->offset == 0 && k.max <= full.max)
+      res = k;
+    break;
+  }
+
+  case Expr::Select: {
+    const SelectExpr *se = cast<SelectExpr>(e);
+    ValueBounds t = getBounds(se->trueExpr), f = getBounds(se->falseExpr);
+    res = ValueBounds(std::min(t.min, f.min), std::max(t.max, f.max));
+    break;
+  }
+
+  case Expr::Add: {
+    ValueBounds l = getBounds(e->getKid(0)), r = getBounds(e->getKid(1));
+    if (l.max <= full.max - r.max)
+      res = ValueBounds(l.min + r.min, l.max + r.max);
+    break;
+  }
+
+  case Expr::Sub: {
+    ValueBounds l = getBounds(e->getKid(0)), r = getBounds(e->getKid(1));
+    if (l.min >= r.max)
+      res = ValueBounds(l.min - r.max, l.max - r.min);
+    break;
+  }
+
+  case Expr::Mul: {
+    ValueBounds l = getBounds(e->getKid(0)), r = getBounds(e->getKid(1));
+    if (r.max == 0 || l.max <= full.max / r.max)
+      res = ValueBounds(l.min * r.min, l.max * r.max);
+    break;
+  }
+
+  case Expr::UDiv: {
+    ValueBounds l = getBounds(e->getKid(0)), r = getBounds(e->getKid(1));
+    if (r.min > 0)
+      res = ValueBounds(l.min / r.max, l.max / r.min);
+    break;
+  }
+
+  case Expr::URem: {
+    ValueBounds l = getBounds(e->getKid(0)), r = getBounds(e->getKid(1));
+    if (r.min > 0)
+      res = ValueBounds(0, std::min(l.max, r.max - 1));
+    break;
+  }
+
+  case Expr::And: {
+    ValueBounds l = getBounds(e->getKid(0)), r = getBounds(e->getKid(1));
+    res = ValueBounds(0, std::min(l.max, r.max));
+    break;
+  }
+
+  case Expr::Shl: {
+    const ConstantExpr *shift = dyn_cast<ConstantExpr>(e->getKid(1));
+    if (shift && shift->getZExtValue() < width) {
+      unsigned bits = shift->getZExtValue();
+      ValueBounds l = getBounds(e->getKid(0));
+      if (l.max <= (full.max >> bits))
+        res = ValueBounds(l.min << bits, l.max << bits);
+    }
+    break;
+  }
+
+  case Expr::LShr: {
+    const ConstantExpr *shift = dyn_cast<ConstantExpr>(e->getKid(1));
+    if (shift && shift->getZExtValue() < width) {
+      unsigned bits = shift->getZExtValue();
+      ValueBounds l = getBounds(e->getKid(0));
+      res = ValueBounds(l.min >> bits, l.max >> bits);
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+
+  if (boundsCache.size() >= MaxBoundsCacheSize)
+    boundsCache.clear();
+  boundsCache.insert(std::make_pair(e, res));
+  return res;
+}
+
+/// The last byte of \a mo, zero sized objects occupy their address.
+static uint64_t getLastAddress(const MemoryObject *mo) {
+  return mo->address + std::max(mo->size, 1u) - 1;
+}
+
 bool AddressSpace::resolveOne(ExecutionState &state,
                               TimingSolver *solver,
                               ref<Expr> address,
@@ -105,6 +490,11 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     if (!solver->getValue(state, address, cex))
       return false;
     uint64_t example = cex->getZExtValue();
+    if (pages.lookup(example, result)) {
+      success = true;
+      return true;
+    }
+
     MemoryObject hack(example);
     const MemoryMap::value_type *res = objects.lookup_previous(&hack);
     
@@ -117,7 +507,10 @@ bool AddressSpace::resolveOne(ExecutionState &state,
       }
     }
 
-    // didn't work, now we have to search
+    // didn't work, now we have to search. Objects that lie outside of the
+    // bounds of the address cannot be hit, which ends the search without
+    // asking the solver.
+    ValueBounds bounds = getBounds(address);
        
     MemoryMap::iterator oi = objects.upper_bound(&hack);
     MemoryMap::iterator begin = objects.begin();
@@ -127,8 +520,13 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     while (oi!=begin) {
       --oi;
       const MemoryObject *mo = oi->first;
+      if (getLastAddress(mo) < bounds.min) {
+        stats::resolveQueriesSaved += 2;
+        break;
+      }
         
       bool mayBeTrue;
+      ++stats::resolveQueries;
       if (!solver->mayBeTrue(state, 
                              mo->getBoundsCheckPointer(address), mayBeTrue))
         return false;
@@ -137,7 +535,12 @@ bool AddressSpace::resolveOne(ExecutionState &state,
         success = true;
         return true;
       } else {
+        if (mo->address <= bounds.min) {
+          ++stats::resolveQueriesSaved;
+          break;
+        }
         bool mustBeTrue;
+        ++stats::resolveQueries;
         if (!solver->mustBeTrue(state, 
                                 UgeExpr::create(address, mo->getBaseExpr()),
                                 mustBeTrue))
@@ -150,8 +553,13 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     // search forwards
     for (oi=start; oi!=end; ++oi) {
       const MemoryObject *mo = oi->first;
+      if (bounds.max < mo->address) {
+        ++stats::resolveQueriesSaved;
+        break;
+      }
 
       bool mustBeTrue;
+      ++stats::resolveQueries;
       if (!solver->mustBeTrue(state, 
                               UltExpr::create(address, mo->getBaseExpr()),
                               mustBeTrue))
@@ -161,6 +569,7 @@ bool AddressSpace::resolveOne(ExecutionState &state,
       } else {
         bool mayBeTrue;
 
+        ++stats::resolveQueries;
         if (!solver->mayBeTrue(state, 
                                mo->getBoundsCheckPointer(address),
                                mayBeTrue))
@@ -213,6 +622,7 @@ bool AddressSpace::resolve(ExecutionState &state,
       return true;
     uint64_t example = cex->getZExtValue();
     MemoryObject hack(example);
+    ValueBounds bounds = getBounds(p);
     
     MemoryMap::iterator oi = objects.upper_bound(&hack);
     MemoryMap::iterator begin = objects.begin();
@@ -233,10 +643,15 @@ bool AddressSpace::resolve(ExecutionState &state,
       const MemoryObject *mo = oi->first;
       if (timeout_us && timeout_us < timer.check())
         return true;
+      if (getLastAddress(mo) < bounds.min) {
+        stats::resolveQueriesSaved += 2;
+        break;
+      }
 
       // XXX I think there is some query wasteage here?
       ref<Expr> inBounds = mo->getBoundsCheckPointer(p);
       bool mayBeTrue;
+      ++stats::resolveQueries;
       if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
         return true;
       if (mayBeTrue) {
@@ -246,6 +661,7 @@ bool AddressSpace::resolve(ExecutionState &state,
         unsigned size = rl.size();
         if (size==1) {
           bool mustBeTrue;
+          ++stats::resolveQueries;
           if (!solver->mustBeTrue(state, inBounds, mustBeTrue))
             return true;
           if (mustBeTrue)
@@ -254,8 +670,14 @@ bool AddressSpace::resolve(ExecutionState &state,
           return true;
         }
       }
+
+      if (mo->address <= bounds.min) {
+        ++stats::resolveQueriesSaved;
+        break;
+      }
         
       bool mustBeTrue;
+      ++stats::resolveQueries;
       if (!solver->mustBeTrue(state, 
                               UgeExpr::create(p, mo->getBaseExpr()),
                               mustBeTrue))
@@ -268,8 +690,13 @@ bool AddressSpace::resolve(ExecutionState &state,
       const MemoryObject *mo = oi->first;
       if (timeout_us && timeout_us < timer.check())
         return true;
+      if (bounds.max < mo->address) {
+        ++stats::resolveQueriesSaved;
+        break;
+      }
 
       bool mustBeTrue;
+      ++stats::resolveQueries;
       if (!solver->mustBeTrue(state, 
                               UltExpr::create(p, mo->getBaseExpr()),
                               mustBeTrue))
@@ -280,6 +707,7 @@ bool AddressSpace::resolve(ExecutionState &state,
       // XXX I think there is some query wasteage here?
       ref<Expr> inBounds = mo->getBoundsCheckPointer(p);
       bool mayBeTrue;
+      ++stats::resolveQueries;
       if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
         return true;
       if (mayBeTrue) {
@@ -289,6 +717,7 @@ bool AddressSpace::resolve(ExecutionState &state,
         unsigned size = rl.size();
         if (size==1) {
           bool mustBeTrue;
+          ++stats::resolveQueries;
           if (!solver->mustBeTrue(state, inBounds, mustBeTrue))
             return true;
           if (mustBeTrue)
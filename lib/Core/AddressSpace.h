@@ -14,6 +14,7 @@
 
 #include "klee/Expr.h"
 #include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/Internal/ADT/ImmutableSet.h"
 
 namespace klee {
   class ExecutionState;
@@ -32,14 +33,69 @@ namespace klee {
   };
   
   typedef ImmutableMap<const MemoryObject*, ObjectHolder, MemoryObjectLT> MemoryMap;
+  typedef ImmutableSet<const MemoryObject*, MemoryObjectLT> MemoryObjectSet;
+
+  /// Persistent index from memory pages to the objects overlapping them,
+  /// used to resolve concrete addresses without a walk down the MemoryMap.
+  ///
+  /// It is a radix tree over page numbers. Copies share their nodes, which
+  /// are copied on the first modification through an index that does not
+  /// own them exclusively. Objects outside the covered address range or
+  /// spanning too many pages are left out, so a failed lookup does not mean
+  /// that there is no object at the address.
+  class PageIndex {
+    struct Node;
+    struct Page;
+
+    void *root;
+
+    static void retain(void *slot, unsigned level);
+    static void release(void *slot, unsigned level);
+    static Node *getWriteableNode(void *&slot, unsigned level);
+
+    static bool getPageRange(const MemoryObject *mo, uint64_t &first,
+                             uint64_t &last);
+    void updatePage(uint64_t pageNum, const MemoryObject *mo,
+                    const ObjectState *os);
+
+  public:
+    PageIndex() : root(0) {}
+    PageIndex(const PageIndex &b);
+    PageIndex &operator=(const PageIndex &b);
+    ~PageIndex();
+
+    /// Bind \a mo to \a os, replacing an earlier binding of \a mo.
+    void insert(const MemoryObject *mo, const ObjectState *os);
+
+    /// Remove the binding of \a mo.
+    void remove(const MemoryObject *mo);
+
+    /// Find the indexed object containing \a address.
+    /// \return true iff one was found.
+    bool lookup(uint64_t address, ObjectPair &result) const;
+
+    /// The number of nodes and pages allocated by all indices.
+    static unsigned getNumAllocated();
+  };
   
   class AddressSpace {
   private:
     /// Epoch counter used to control ownership of objects.
     mutable unsigned cowKey;
 
+    /// Whether bindings that change are recorded in writtenObjects.
+    bool trackWrites;
+
+    /// The bindings of objects, indexed by page. Kept in sync with objects.
+    PageIndex pages;
+
     /// Unsupported, use copy constructor
     AddressSpace &operator=(const AddressSpace&); 
+
+    void recordWrite(const MemoryObject *mo) {
+      if (trackWrites && !writtenObjects.count(mo))
+        writtenObjects = writtenObjects.insert(mo);
+    }
     
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
@@ -50,12 +106,45 @@ namespace klee {
     ///
     /// \invariant forall o in objects, o->copyOnWriteOwner <= cowKey
     MemoryMap objects;
+
+    /// The objects that were bound, unbound or handed out for writing
+    /// since startWriteTracking(). Empty while writes are not tracked.
+    MemoryObjectSet writtenObjects;
     
   public:
-    AddressSpace() : cowKey(1) {}
-    AddressSpace(const AddressSpace &b) : cowKey(++b.cowKey), objects(b.objects) { }
+    AddressSpace() : cowKey(1), trackWrites(false) {}
+    AddressSpace(const AddressSpace &b)
+      : cowKey(++b.cowKey), trackWrites(b.trackWrites), pages(b.pages),
+        objects(b.objects), writtenObjects(b.writtenObjects) { }
     ~AddressSpace() {}
 
+    /// Start recording written objects afresh, forgetting the ones
+    /// recorded so far.
+    void startWriteTracking() {
+      trackWrites = true;
+      writtenObjects = MemoryObjectSet();
+    }
+
+    /// Stop recording written objects.
+    void stopWriteTracking() {
+      trackWrites = false;
+      writtenObjects = MemoryObjectSet();
+    }
+
+    bool isTrackingWrites() const { return trackWrites; }
+
+    /// Record every object whose binding differs from the one in \a base,
+    /// as if the writes since \a base had been tracked.
+    void recordChangesSince(const AddressSpace &base);
+
+    /// Add the objects in \a written to the recorded ones, e.g. to restore
+    /// the writes of an enclosing region after a nested one was tracked.
+    void addWrittenObjects(const MemoryObjectSet &written) {
+      for (MemoryObjectSet::iterator it = written.begin(), ie = written.end();
+           it != ie; ++it)
+        recordWrite(*it);
+    }
+
     /// Resolve address to an ObjectPair in result.
     /// \return true iff an object was found.
     bool resolveOne(const ref<ConstantExpr> &address, 
@@ -17,6 +17,14 @@ namespace stats {
 
   extern Statistic allocations;
   extern Statistic resolveTime;
+
+  /// Solver queries issued while resolving symbolic pointers, and the ones
+  /// that were answered by the conservative range of the pointer instead.
+  /// The latter is a lower bound: a walk that stops early only counts the
+  /// queries of the object it stops at, not those of the objects past it.
+  extern Statistic resolveQueries;
+  extern Statistic resolveQueriesSaved;
+
   extern Statistic instructions;
   extern Statistic instructionTime;
   extern Statistic instructionRealTime;
@@ -23,9 +23,12 @@
 #include "klee/LoopAnalysis.h"
 
 #include "klee/Expr.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
 
 #include "Memory.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
 #include "llvm/DebugInfo.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
@@ -34,6 +37,7 @@
 #include <iomanip>
 #include <sstream>
 #include <cassert>
+#include <functional>
 #include <map>
 #include <regex>
 #include <set>
@@ -50,26 +54,20 @@ namespace {
 
 /***/
 
+const Cell StackFrame::noLocal;
+
 StackFrame::StackFrame(KInstIterator _caller, KFunction *_kf)
   : caller(_caller), kf(_kf), callPathNode(0),
     minDistToUncoveredOnReturn(0), varargs(0) {
-  locals = new Cell[kf->numRegisters];
-}
-
-StackFrame::StackFrame(const StackFrame &s) 
-  : caller(s.caller),
-    kf(s.kf),
-    callPathNode(s.callPathNode),
-    allocas(s.allocas),
-    minDistToUncoveredOnReturn(s.minDistToUncoveredOnReturn),
-    varargs(s.varargs) {
-  locals = new Cell[s.kf->numRegisters];
-  for (unsigned i=0; i<s.kf->numRegisters; i++)
-    locals[i] = s.locals[i];
 }
 
-StackFrame::~StackFrame() { 
-  delete[] locals; 
+void StackFrame::copyLocals() {
+  std::shared_ptr<Cell> copy(new Cell[kf->numRegisters],
+                             std::default_delete<Cell[]>());
+  if (locals)
+    for (unsigned i=0; i<kf->numRegisters; i++)
+      copy.get()[i] = locals.get()[i];
+  locals = copy;
 }
 
 /***/
@@ -241,8 +239,11 @@ void ExecutionState::addSymbolic(const MemoryObject *mo, const Array *array) {
 }
 ///
 
-std::string ExecutionState::getFnAlias(std::string fn) {
-  for (auto& candidate : fnAliases) {
+std::string ExecutionState::getFnAlias(const std::string &fn) const {
+  if (!fnAliases)
+    return "";
+
+  for (auto& candidate : fnAliases->aliases) {
     if (candidate.isRegex) {
       if (std::regex_match(fn, candidate.nameRegex)) {
         return candidate.alias;
@@ -255,6 +256,37 @@ std::string ExecutionState::getFnAlias(std::string fn) {
   return "";
 }
 
+llvm::GlobalValue *ExecutionState::resolveFnAlias(llvm::GlobalValue *gv,
+                                                  llvm::Module *module) {
+  if (!fnAliases)
+    return gv;
+
+  auto it = fnAliases->resolved.find(gv);
+  if (it != fnAliases->resolved.end())
+    return it->second;
+
+  std::string alias = getFnAlias(gv->getName().str());
+  llvm::GlobalValue *target = alias == "" ? gv : module->getNamedValue(alias);
+  if (target)
+    fnAliases->resolved[gv] = target;
+
+  return target;
+}
+
+std::vector<FunctionAlias> &ExecutionState::editFnAliases() {
+  if (!fnAliases) {
+    fnAliases = std::make_shared<FunctionAliasTable>();
+  } else if (fnAliases.use_count() > 1) {
+    auto table = std::make_shared<FunctionAliasTable>();
+    table->aliases = fnAliases->aliases;
+    fnAliases = table;
+  } else {
+    fnAliases->resolved.clear();
+  }
+
+  return fnAliases->aliases;
+}
+
 void ExecutionState::addFnAlias(std::string old_fn, std::string new_fn) {
   removeFnAlias(old_fn);
 
@@ -264,7 +296,7 @@ void ExecutionState::addFnAlias(std::string old_fn, std::string new_fn) {
     .name = old_fn,
     .alias = new_fn
   };
-  fnAliases.push_back(alias);
+  editFnAliases().push_back(alias);
 }
 
 void ExecutionState::addFnRegexAlias(std::string fn_regex, std::string new_fn) {
@@ -276,41 +308,65 @@ void ExecutionState::addFnRegexAlias(std::string fn_regex, std::string new_fn) {
     .name = fn_regex,
     .alias = new_fn
   };
-  fnAliases.push_back(alias);
+  editFnAliases().push_back(alias);
 }
 
 void ExecutionState::removeFnAlias(std::string fn) {
-  fnAliases.erase(std::remove_if(fnAliases.begin(), fnAliases.end(),
-                                 [fn](FunctionAlias candidate) {
-                                   return candidate.name == fn;
-                                 }),
-                  fnAliases.end());
+  if (!fnAliases)
+    return;
+
+  auto &aliases = fnAliases->aliases;
+  auto matches = [fn](const FunctionAlias &candidate) {
+    return candidate.name == fn;
+  };
+  if (std::find_if(aliases.begin(), aliases.end(), matches) == aliases.end())
+    return;
+
+  auto &edited = editFnAliases();
+  edited.erase(std::remove_if(edited.begin(), edited.end(), matches),
+               edited.end());
 }
 
-std::string ExecutionState::getInterceptReader(uint64_t addr) {
+llvm::Function *ExecutionState::getInterceptReader(uint64_t addr) const {
   auto it = readsIntercepts.find(addr);
   if (it == readsIntercepts.end()) {
-    return "";
+    return 0;
   }
 
   return it->second;
 }
 
-std::string ExecutionState::getInterceptWriter(uint64_t addr) {
+llvm::Function *ExecutionState::getInterceptWriter(uint64_t addr) const {
   auto it = writesIntercepts.find(addr);
   if (it == writesIntercepts.end()) {
-    return "";
+    return 0;
   }
 
   return it->second;
 }
 
-void ExecutionState::addReadsIntercept(uint64_t addr, std::string reader) {
+/// The writeable state of the object bound at exactly \p addr, if any.
+static ObjectState *getObjectAt(AddressSpace &addressSpace, uint64_t addr) {
+  ObjectPair op;
+  if (!addressSpace.resolveOne(klee::ConstantExpr::alloc(addr, Expr::Int64),
+                               op) ||
+      op.first->address != addr)
+    return 0;
+
+  return addressSpace.getWriteable(op.first, op.second);
+}
+
+void ExecutionState::addReadsIntercept(uint64_t addr, llvm::Function *reader) {
   readsIntercepts[addr] = reader;
+  if (ObjectState *os = getObjectAt(addressSpace, addr))
+    os->readInterceptor = reader;
 }
 
-void ExecutionState::addWritesIntercept(uint64_t addr, std::string writer) {
+void ExecutionState::addWritesIntercept(uint64_t addr,
+                                        llvm::Function *writer) {
   writesIntercepts[addr] = writer;
+  if (ObjectState *os = getObjectAt(addressSpace, addr))
+    os->writeInterceptor = writer;
 }
 
 /**/
@@ -458,13 +514,13 @@ bool ExecutionState::merge(const ExecutionState &b) {
     StackFrame &af = *itA;
     const StackFrame &bf = *itB;
     for (unsigned i=0; i<af.kf->numRegisters; i++) {
-      ref<Expr> &av = af.locals[i].value;
-      const ref<Expr> &bv = bf.locals[i].value;
+      const ref<Expr> &av = af.getLocal(i).value;
+      const ref<Expr> &bv = bf.getLocal(i).value;
       if (av.isNull() || bv.isNull()) {
         // if one is null then by implication (we are at same pc)
         // we cannot reuse this local, so just ignore
       } else {
-        av = SelectExpr::create(inA, av, bv);
+        af.getWriteableLocal(i).value = SelectExpr::create(inA, av, bv);
       }
     }
   }
@@ -523,7 +579,7 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
 
       out << ai->getName().str();
       // XXX should go through function
-      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].value;
+      ref<Expr> value = sf.getLocal(sf.kf->getArgRegister(index++)).value;
       if (value.get() && isa<ConstantExpr>(value))
         out << "=" << value;
     }
@@ -595,11 +651,13 @@ ref<Expr> ExecutionState::readMemoryChunk(ref<Expr> addr,
 }
 
 void ExecutionState::traceRet() {
-  if (callPath.empty() ||
-      callPath.back().returned ||
-      callPath.back().f != stack.back().kf->function) {
-    if (!callPath.empty()) {
-      SymbolSet symbols = callPath.back().computeRetSymbolSet();
+  // Look at the last call without taking a copy of it.
+  const CallPath &path = callPath;
+  if (path.empty() ||
+      path.back().returned ||
+      path.back().f != stack.back().kf->function) {
+    if (!path.empty()) {
+      SymbolSet symbols = path.back().computeRetSymbolSet();
       relevantSymbols.insert(symbols.begin(), symbols.end());
     }
     callPath.push_back(CallInfo());
@@ -1408,6 +1466,10 @@ void ExecutionState::startInvariantSearch() {
       new LoopInProcess(loop,
                         executionStateForLoopInProcess,
                         loopInProcess);
+    // This state runs the first round but has not been tracked since it
+    // left the header state behind.
+    addressSpace.startWriteTracking();
+    addressSpace.recordChangesSince(executionStateForLoopInProcess->addressSpace);
     executionStateForLoopInProcess = 0;
   } else {
     LOG_LA("Already analysed, or being analysed at this very moment");
@@ -1418,7 +1480,7 @@ void ExecutionState::induceInvariantsForThisLoop(KInstruction *target) {
   startInvariantSearch();
 
   //The return value of the intrinsic function call.
-  stack.back().locals[target->dest].value =
+  stack.back().getWriteableLocal(target->dest).value =
     ConstantExpr::create(0xffffffff, Expr::Int32);
 }
 
@@ -1564,7 +1626,7 @@ bool equalContexts(const std::vector<ref<Expr> >& a,
   for (unsigned i = 0; i < b.size(); ++i) {
     bool notFound = true;
     for (unsigned j = 0; j < a.size(); ++j) {
-      if ((*a[i]).compare(*b[j]) == 0) {
+      if ((*b[i]).compare(*a[j]) == 0) {
         notFound = false;
         break;
       }
@@ -1615,6 +1677,165 @@ bool CallInfo::sameInvocation(const CallInfo* other) const {
   return equalContexts(callContext, other->callContext);
 }
 
+static void hashCombine(unsigned &seed, unsigned value) {
+  seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+static unsigned hashExpr(const ref<Expr> &e) {
+  return e.isNull() ? 0 : e->hash();
+}
+
+static unsigned hashString(const std::string &s) {
+  return std::hash<std::string>()(s);
+}
+
+/// Agrees with equalContexts, which ignores the order and the repetitions
+/// of the constraints.
+static unsigned hashContext(const std::vector<ref<Expr> > &context) {
+  std::vector<unsigned> hashes;
+  hashes.reserve(context.size());
+  for (unsigned i = 0; i < context.size(); ++i)
+    hashes.push_back(context[i]->hash());
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+  unsigned res = context.size();
+  for (unsigned i = 0; i < hashes.size(); ++i)
+    hashCombine(res, hashes[i]);
+  return res;
+}
+
+// The nested fields are left out of the FieldDescr hashes: eq and
+// sameInvocationValue only check that the fields of one side are found on
+// the other.
+unsigned FieldDescr::hash() const {
+  unsigned res = invocationHash();
+  hashCombine(res, doTraceValueOut);
+  if (doTraceValueOut)
+    hashCombine(res, hashExpr(outVal));
+  return res;
+}
+
+unsigned FieldDescr::invocationHash() const {
+  unsigned res = width;
+  hashCombine(res, hashString(name));
+  hashCombine(res, hashString(type));
+  hashCombine(res, doTraceValueIn);
+  if (doTraceValueIn)
+    hashCombine(res, hashExpr(inVal));
+  return res;
+}
+
+unsigned CallArg::hash() const {
+  unsigned res = hashExpr(expr);
+  hashCombine(res, isPtr);
+  if (isPtr)
+    hashCombine(res, pointee.hash());
+  return res;
+}
+
+unsigned CallArg::invocationHash() const {
+  unsigned res = hashExpr(expr);
+  hashCombine(res, isPtr);
+  if (isPtr)
+    hashCombine(res, pointee.invocationHash());
+  return res;
+}
+
+unsigned RetVal::hash() const {
+  unsigned res = hashExpr(expr);
+  hashCombine(res, isPtr);
+  if (isPtr)
+    hashCombine(res, pointee.hash());
+  return res;
+}
+
+unsigned CallExtraPtr::hash() const {
+  unsigned res = ptr;
+  hashCombine(res, accessibleIn);
+  hashCombine(res, accessibleOut);
+  hashCombine(res, pointee.hash());
+  hashCombine(res, hashString(name));
+  return res;
+}
+
+unsigned CallInfo::hash() const {
+  unsigned res = std::hash<const llvm::Function *>()(f);
+  hashCombine(res, args.size());
+  for (unsigned i = 0; i < args.size(); ++i)
+    hashCombine(res, args[i].hash());
+  for (std::map<size_t, CallExtraPtr>::const_iterator i = extraPtrs.begin(),
+         e = extraPtrs.end(); i != e; ++i) {
+    hashCombine(res, i->first);
+    hashCombine(res, i->second.hash());
+  }
+  hashCombine(res, ret.hash());
+  hashCombine(res, hashContext(callContext));
+  hashCombine(res, hashContext(returnContext));
+  hashCombine(res, returned);
+  return res;
+}
+
+unsigned CallInfo::invocationHash() const {
+  unsigned res = std::hash<const llvm::Function *>()(f);
+  hashCombine(res, args.size());
+  for (unsigned i = 0; i < args.size(); ++i)
+    hashCombine(res, args[i].invocationHash());
+  hashCombine(res, hashContext(callContext));
+  return res;
+}
+
+bool CallInfo::hasAllOutValues() const {
+  for (std::vector<CallArg>::const_iterator i = args.begin(), e = args.end();
+       i != e; ++i) {
+    const FieldDescr &pointee = i->pointee;
+    if (!i->isPtr || i->funPtr ||
+        !(pointee.doTraceValueIn || pointee.doTraceValueOut))
+      continue;
+    if (pointee.doTraceValueOut && pointee.outVal.isNull())
+      return false;
+    for (std::map<int, FieldDescr>::const_iterator
+           fi = pointee.fields.begin(), fe = pointee.fields.end();
+         fi != fe; ++fi)
+      if (fi->second.doTraceValueOut && fi->second.outVal.isNull())
+        return false;
+  }
+  return true;
+}
+
+CallPath::~CallPath() {
+  // Release the nodes no other path shares one at a time; letting the
+  // shared pointers do it would recurse once per call.
+  std::shared_ptr<Node> node = std::move(last);
+  while (node && node.use_count() == 1) {
+    std::shared_ptr<Node> prev = std::move(node->prev);
+    node = std::move(prev);
+  }
+}
+
+CallInfo &CallPath::back() {
+  assert(last && "empty call path");
+  if (last.use_count() > 1)
+    last = std::make_shared<Node>(*last);
+  return last->info;
+}
+
+void CallPath::push_back(const CallInfo &info) {
+  std::shared_ptr<Node> node = std::make_shared<Node>();
+  node->prev = std::move(last);
+  node->info = info;
+  last = std::move(node);
+  ++length;
+}
+
+std::vector<const CallInfo *> CallPath::getCalls() const {
+  std::vector<const CallInfo *> calls(length);
+  size_t i = length;
+  for (const Node *node = last.get(); node; node = node->prev.get())
+    calls[--i] = &node->info;
+  assert(i == 0);
+  return calls;
+}
+
 SymbolSet CallInfo::computeRetSymbolSet() const {
   assert(returned && "incomplete");
   SymbolSet symbols;
@@ -1650,6 +1871,9 @@ LoopInProcess::LoopInProcess(const llvm::Loop *_loop,
   //TODO: this can not belong here. It has nothing to do with execution state,
   // nor with ptree node.
   restartState->ptreeNode = 0;
+  // Rounds are compared to the header state only where they wrote.
+  enclosingWrites = restartState->addressSpace.writtenObjects;
+  restartState->addressSpace.startWriteTracking();
 }
 
 LoopInProcess::~LoopInProcess() {
@@ -1737,6 +1961,10 @@ ExecutionState *LoopInProcess::makeRestartState() {
            " in the normal mode.");
     newState->loopInProcess = outer;
     newState->analysedLoops = newState->analysedLoops.insert(loop);
+    if (outer.isNull())
+      newState->addressSpace.stopWriteTracking();
+    else
+      newState->addressSpace.addWrittenObjects(enclosingWrites);
   }
   return newState;
 }
@@ -1747,20 +1975,214 @@ std::string __attribute__((weak)) numToStr(long long n) {
   return ss.str();
 }
 
+/// Stop the analysis if byte \a j of \a obj, which may differ between the
+/// loop entry (\a refOs) and the end of this round (\a os), is not allowed
+/// to change.
+static void checkChangeAllowed(const ExecutionState &state,
+                               const MemoryObject *obj,
+                               const ObjectState *refOs,
+                               const ObjectState *os,
+                               unsigned j) {
+  ref<Expr> refVal = refOs->read8(j, true);
+  ref<Expr> val = os->read8(j, true);
+  if (state.havocs.find(obj) == state.havocs.end() &&
+      !state.condoneUndeclaredHavocs) {
+    fprintf(stderr, "Obj size: %d vs. %d\n", refOs->size, os->size);
+    fflush(stderr);
+    fprintf(stderr, "%d byte before: ", j);
+    fflush(stderr);
+    refVal->dump();
+    fprintf(stderr, "%d byte after: ", j);
+    fflush(stderr);
+    val->dump();
+    fprintf(stderr, "full value before: ");
+    if (refOs->size < 100) {
+      refOs->read(0, refOs->size*8, true)->dump();
+    } else {
+      fprintf(stderr, "too long\n");
+    }
+    fprintf(stderr, "full value after: ");
+    if (os->size < 100 ) {
+      os->read(0, os->size*8, true)->dump();
+    } else {
+      fprintf(stderr, "too long\n");
+    }
+    fprintf(stderr, "Type: ");
+    fflush(stderr);
+    obj->allocSite->getType()->dump();
+    fprintf(stderr, "\n");
+    std::string metadata;
+    if (isa<llvm::Instruction>(obj->allocSite)) {
+      const llvm::Instruction *inst = dyn_cast<llvm::Instruction>(obj->allocSite);
+      if (llvm::MDNode *node = inst->getMetadata("dbg")) {
+        llvm::DILocation loc(node);
+        metadata = loc.getDirectory().str() + "/" +
+          loc.getFilename().str() + ":" +
+          numToStr(loc.getLineNumber());
+      } else {
+        const llvm::Function* fun = inst->getParent()->getParent();
+        metadata = "in function: " + fun->getName().str();
+      }
+    } else {
+      metadata = "(not an instruciton)";
+    }
+    klee_error("Unexpected memory location changed its value during invariant analysis:\n"
+               "  name: %s\n  location: %s\n"
+               "  local: %s\n  global: %s\n"
+               "  fixed: %s\n  size: %u\n"
+               "  address: 0x%lx\n  metadata: %s",
+               obj->name.c_str(),
+               obj->allocSite->getName().str().c_str(),
+               obj->isLocal ? "true" : "false",
+               obj->isGlobal ? "true" : "false",
+               obj->isFixed ? "true" : "false",
+               obj->size,
+               obj->address,
+               metadata.c_str());
+  }
+  if (state.noHavocs.find(obj) != state.noHavocs.end()) {
+    fprintf(stderr, "Obj size: %d vs. %d\n", refOs->size, os->size);
+    fflush(stderr);
+    fprintf(stderr, "%d byte before: ", j);
+    fflush(stderr);
+    refVal->dump();
+    fprintf(stderr, "%d byte after: ", j);
+    fflush(stderr);
+    val->dump();
+    fprintf(stderr, "Type: ");
+    fflush(stderr);
+    obj->allocSite->getType()->dump();
+    fprintf(stderr, "\n");
+    std::string metadata;
+    if (isa<llvm::Instruction>(obj->allocSite)) {
+      const llvm::Instruction *inst = dyn_cast<llvm::Instruction>(obj->allocSite);
+      if (llvm::MDNode *node = inst->getMetadata("dbg")) {
+        llvm::DILocation loc(node);
+        metadata = loc.getDirectory().str() + "/" +
+          loc.getFilename().str() + ":" +
+          numToStr(loc.getLineNumber());
+      } else {
+        metadata = "(unknown)";
+      }
+    } else {
+      metadata = "(not an instruciton)";
+    }
+    klee_error("Guaranteed invariant (never-havoc %s) changed during invariant analysis:\n"
+               "  name: %s\n  location: %s\n"
+               "  local: %s\n  global: %s\n"
+               "  fixed: %s\n  size: %u\n"
+               "  address: 0x%lx\n  metadata: %s",
+               (*state.noHavocs.find(obj)).second.c_str(),
+               obj->name.c_str(),
+               obj->allocSite->getName().str().c_str(),
+               obj->isLocal ? "true" : "false",
+               obj->isGlobal ? "true" : "false",
+               obj->isFixed ? "true" : "false",
+               obj->size,
+               obj->address,
+               metadata.c_str());
+  }
+}
+
+/// The most bytes of one object compared in a single solver query.
+static const unsigned MaxBytesPerDiffQuery = 256;
+
+/// Find out which of the bytes \a pending of \a os, which structurally
+/// differ from the same bytes of \a refOs, may really differ, and set them
+/// in \a bytes. \a eqs holds the equality of each pair of bytes.
+///
+/// One query asks for a solution in which not all of them are equal. There
+/// usually is none. Otherwise the solution tells some bytes that do differ,
+/// and only the remaining ones are asked about again.
+static bool updateDiffBytes(const ExecutionState &state,
+                            TimingSolver *solver,
+                            const MemoryObject *obj,
+                            const ObjectState *refOs,
+                            const ObjectState *os,
+                            std::vector<unsigned> &pending,
+                            std::vector<ref<Expr> > &eqs,
+                            BitArray *bytes) {
+  bool updated = false;
+  while (!pending.empty()) {
+    ref<Expr> allEq = eqs[0];
+    for (unsigned k = 1; k < eqs.size(); ++k)
+      allEq = AndExpr::create(allEq, eqs[k]);
+
+    std::vector<const Array *> arrays;
+    std::vector<std::vector<unsigned char> > values;
+    findSymbolicObjects(allEq, arrays);
+    solver->setTimeout(0.01);//TODO: determine a correct argument here.
+    bool mayDiffer = true;
+    bool solverRes =
+        solver->getInitialValues(state, allEq, arrays, values, mayDiffer);
+    solver->setTimeout(0);
+    if (solverRes && !mayDiffer)
+      return updated;
+
+    std::vector<unsigned> same;
+    std::vector<ref<Expr> > sameEqs;
+    if (solverRes) {
+      Assignment model(arrays, values, true);
+      for (unsigned k = 0; k < pending.size(); ++k) {
+        if (model.evaluate(eqs[k])->isFalse()) continue;
+        same.push_back(pending[k]);
+        sameEqs.push_back(eqs[k]);
+      }
+    }
+    if (!solverRes || same.size() == pending.size()) {
+      // Ask about the bytes one by one, so that a timeout only costs the
+      // byte it happened on.
+      if (pending.size() == 1)
+        return updated;
+      for (unsigned k = 0; k < pending.size(); ++k) {
+        std::vector<unsigned> single(1, pending[k]);
+        std::vector<ref<Expr> > singleEq(1, eqs[k]);
+        if (updateDiffBytes(state, solver, obj, refOs, os,
+                            single, singleEq, bytes))
+          updated = true;
+      }
+      return updated;
+    }
+    for (unsigned k = 0, m = 0; k < pending.size(); ++k) {
+      if (m < same.size() && same[m] == pending[k]) {
+        ++m;
+        continue;
+      }
+      bytes->set(pending[k]);
+      updated = true;
+      checkChangeAllowed(state, obj, refOs, os, pending[k]);
+    }
+    pending.swap(same);
+    eqs.swap(sameEqs);
+  }
+  return updated;
+}
+
 //TODO: move this into not-yet existing LoopAnalysis.cpp
 bool klee::updateDiffMask(StateByteMask* mask,
                           const AddressSpace& refValues,
                           const ExecutionState& state,
                           TimingSolver* solver) {
+  assert(state.addressSpace.isTrackingWrites() &&
+         "the writes of a state in a loop analysis must be tracked");
   bool updated = false;
-  for (MemoryMap::iterator
-         i = refValues.objects.begin(),
-         e = refValues.objects.end();
+  // Whatever was not written since the loop entry is still bound to the
+  // very ObjectState of the entry state.
+  const MemoryObjectSet &written = state.addressSpace.writtenObjects;
+  for (MemoryObjectSet::iterator
+         i = written.begin(),
+         e = written.end();
        i != e; ++i) {
-    const MemoryObject *obj = i->first;
-    const ObjectState *refOs = i->second;
+    // Objects allocated during the round have no value to compare with.
+    const MemoryMap::value_type *entry = refValues.objects.lookup(*i);
+    if (!entry) continue;
+    const MemoryObject *obj = entry->first;
+    const ObjectState *refOs = entry->second;
     const ObjectState *os = state.addressSpace.findObject(obj);
     if (refOs == os) continue;
+    if (!os)
+      klee_error("No support for freeing memory allocated before the loop "
+                 "during invariant analysis: %s", obj->name.c_str());
     if (refOs->isAccessible() != os->isAccessible()) {
       std::string inacc_msg;
       if (refOs->isAccessible()) {
@@ -1786,137 +2208,36 @@ bool klee::updateDiffMask(StateByteMask* mask,
                          new BitArray(obj->size);
     BitArray *bytes = insRez.first->second;
     assert(bytes != 0);
+    // The mask carries the bytes known to differ over from the earlier
+    // rounds; those are not compared again. Of the others, only the ones
+    // that differ structurally go to the solver, in batches.
+    std::vector<unsigned> pending;
+    std::vector<ref<Expr> > eqs;
     unsigned size = obj->size;
-    for (unsigned j = 0; j < size; ++j) {
+    for (unsigned j = 0; j <= size; ++j) {
+      if (pending.size() == MaxBytesPerDiffQuery ||
+          (j == size && !pending.empty())) {
+        if (updateDiffBytes(state, solver, obj, refOs, os,
+                            pending, eqs, bytes))
+          updated = true;
+        pending.clear();
+        eqs.clear();
+      }
+      if (j == size) break;
       if (bytes->get(j)) continue;
       ref<Expr> refVal = refOs->read8(j, true);
       ref<Expr> val = os->read8(j, true);
-      if (0 != refVal->compare(*val)) {
-        //So: this byte was not diferent on the previous round,
-        // it also differs structuraly now. It is time to make
-        // sure it can be really different.
-
-        solver->setTimeout(0.01);//TODO: determine a correct argument here.
-        bool mayDiffer = true;
-        bool solverRes = solver->mayBeFalse(state, EqExpr::create(refVal, val),
-                                            /*&*/mayDiffer);
-        solver->setTimeout(0);
-        //assert(solverRes &&
-        //       "Solver failed in computing whether a byte changed or not.");
-        if (solverRes && mayDiffer) {
-          bytes->set(j);
-          updated = true;
-
-#if 0
-        fprintf(stderr, "%p Obj size: %d vs. %d\n", obj, refOs->size, os->size);
-        fflush(stderr);
-        fprintf(stderr, "%d byte before: ", j);
-        fflush(stderr);
-        refVal->dump();
-        fprintf(stderr, "%d byte after: ", j);
-        fflush(stderr);
-        val->dump();
-#endif//0
-
-          if (state.havocs.find(obj) == state.havocs.end() &&
-              !state.condoneUndeclaredHavocs) {
-            fprintf(stderr, "Obj size: %d vs. %d\n", refOs->size, os->size);
-            fflush(stderr);
-            fprintf(stderr, "%d byte before: ", j);
-            fflush(stderr);
-            refVal->dump();
-            fprintf(stderr, "%d byte after: ", j);
-            fflush(stderr);
-            val->dump();
-            fprintf(stderr, "full value before: ");
-            if (refOs->size < 100) {
-              refOs->read(0, refOs->size*8, true)->dump();
-            } else {
-              fprintf(stderr, "too long\n");
-            }
-            fprintf(stderr, "full value after: ");
-            if (os->size < 100 ) {
-              os->read(0, os->size*8, true)->dump();
-            } else {
-              fprintf(stderr, "too long\n");
-            }
-            fprintf(stderr, "Type: ");
-            fflush(stderr);
-            obj->allocSite->getType()->dump();
-            fprintf(stderr, "\n");
-            std::string metadata;
-            if (isa<llvm::Instruction>(obj->allocSite)) {
-              const llvm::Instruction *inst = dyn_cast<llvm::Instruction>(obj->allocSite);
-              if (llvm::MDNode *node = inst->getMetadata("dbg")) {
-                llvm::DILocation loc(node);
-                metadata = loc.getDirectory().str() + "/" +
-                  loc.getFilename().str() + ":" +
-                  numToStr(loc.getLineNumber());
-              } else {
-                const llvm::Function* fun = inst->getParent()->getParent();
-                metadata = "in function: " + fun->getName().str();
-              }
-            } else {
-              metadata = "(not an instruciton)";
-            }
-            klee_error("Unexpected memory location changed its value during invariant analysis:\n"
-                       "  name: %s\n  location: %s\n"
-                       "  local: %s\n  global: %s\n"
-                       "  fixed: %s\n  size: %u\n"
-                       "  address: 0x%lx\n  metadata: %s",
-                       obj->name.c_str(),
-                       obj->allocSite->getName().str().c_str(),
-                       obj->isLocal ? "true" : "false",
-                       obj->isGlobal ? "true" : "false",
-                       obj->isFixed ? "true" : "false",
-                       obj->size,
-                       obj->address,
-                       metadata.c_str());
-          }
-          if (state.noHavocs.find(obj) != state.noHavocs.end()) {
-            fprintf(stderr, "Obj size: %d vs. %d\n", refOs->size, os->size);
-            fflush(stderr);
-            fprintf(stderr, "%d byte before: ", j);
-            fflush(stderr);
-            refVal->dump();
-            fprintf(stderr, "%d byte after: ", j);
-            fflush(stderr);
-            val->dump();
-            fprintf(stderr, "Type: ");
-            fflush(stderr);
-            obj->allocSite->getType()->dump();
-            fprintf(stderr, "\n");
-            std::string metadata;
-            if (isa<llvm::Instruction>(obj->allocSite)) {
-              const llvm::Instruction *inst = dyn_cast<llvm::Instruction>(obj->allocSite);
-              if (llvm::MDNode *node = inst->getMetadata("dbg")) {
-                llvm::DILocation loc(node);
-                metadata = loc.getDirectory().str() + "/" +
-                  loc.getFilename().str() + ":" +
-                  numToStr(loc.getLineNumber());
-              } else {
-                metadata = "(unknown)";
-              }
-            } else {
-              metadata = "(not an instruciton)";
-            }
-            klee_error("Guaranteed invariant (never-havoc %s) changed during invariant analysis:\n"
-                       "  name: %s\n  location: %s\n"
-                       "  local: %s\n  global: %s\n"
-                       "  fixed: %s\n  size: %u\n"
-                       "  address: 0x%lx\n  metadata: %s",
-                       (*state.noHavocs.find(obj)).second.c_str(),
-                       obj->name.c_str(),
-                       obj->allocSite->getName().str().c_str(),
-                       obj->isLocal ? "true" : "false",
-                       obj->isGlobal ? "true" : "false",
-                       obj->isFixed ? "true" : "false",
-                       obj->size,
-                       obj->address,
-                       metadata.c_str());
-          }
-        }
+      if (0 == refVal->compare(*val)) continue;
+      ref<Expr> eq = EqExpr::create(refVal, val);
+      if (ConstantExpr *ce = dyn_cast<ConstantExpr>(eq)) {
+        if (ce->isTrue()) continue;
+        bytes->set(j);
+        updated = true;
+        checkChangeAllowed(state, obj, refOs, os, j);
+        continue;
       }
+      pending.push_back(j);
+      eqs.push_back(eq);
     }
   }
   return updated;
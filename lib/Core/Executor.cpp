@@ -21,6 +21,7 @@
 #include "StatsTracker.h"
 #include "TimingSolver.h"
 #include "UserSearcher.h"
+#include "WorkerPool.h"
 #include "ExecutorTimerInfo.h"
 
 
@@ -95,6 +96,7 @@
 #include <sys/mman.h>
 
 #include <errno.h>
+#include <unistd.h>
 #include <cxxabi.h>
 
 using namespace llvm;
@@ -312,6 +314,20 @@ namespace {
   MaxMemoryInhibit("max-memory-inhibit",
             cl::desc("Inhibit forking at memory cap (vs. random terminate) (default=on)"),
             cl::init(true));
+
+  cl::opt<unsigned>
+  ParallelWorkers("parallel-workers",
+                  cl::desc("Split the search over this many worker processes, "
+                           "each owning a disjoint subset of the states (default=1 (off))"),
+                  cl::init(1));
+
+  cl::opt<unsigned>
+  ParallelSplitStates("parallel-split-states",
+                      cl::desc("Number of live states to reach before splitting the "
+                               "search over the workers; a worker with an idle slot "
+                               "to fill needs this many states divided by the number "
+                               "of workers (default=0 (4 per worker))"),
+                      cl::init(0));
 }
 
 
@@ -347,7 +363,7 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
       coreSolverTimeout(MaxCoreSolverTime != 0 && MaxInstructionTime != 0
                             ? std::min(MaxCoreSolverTime, MaxInstructionTime)
                             : std::max(MaxCoreSolverTime, MaxInstructionTime)),
-      debugInstFile(0), debugLogBuffer(debugBufferString) {
+      debugInstFile(0), debugLogBuffer(debugBufferString), workerPool(0) {
 
   if (coreSolverTimeout) UseForkedCoreSolver = true;
   Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
@@ -435,6 +451,7 @@ const Module *Executor::setModule(llvm::Module *module,
 }
 
 Executor::~Executor() {
+  delete workerPool;
   delete memory;
   delete externalDispatcher;
   delete processTree;
@@ -1042,8 +1059,8 @@ const Cell& Executor::eval(KInstruction *ki, unsigned index,
     return kmodule->constantTable[index];
   } else {
     unsigned index = vnumber;
-    StackFrame &sf = state.stack.back();
-    return sf.locals[index];
+    const StackFrame &sf = state.stack.back();
+    return sf.getLocal(index);
   }
 }
 
@@ -1455,15 +1472,12 @@ Function* Executor::getTargetFunction(Value *calledVal, ExecutionState &state) {
       if (!Visited.insert(gv))
         return 0;
 #endif
-      std::string alias = state.getFnAlias(gv->getName());
-      if (alias != "") {
-        llvm::Module* currModule = kmodule->module;
-        GlobalValue *old_gv = gv;
-        gv = currModule->getNamedValue(alias);
-        if (!gv) {
-          klee_error("Function %s(), alias for %s not found!\n", alias.c_str(),
-                     old_gv->getName().str().c_str());
-        }
+      GlobalValue *old_gv = gv;
+      gv = state.resolveFnAlias(gv, kmodule->module);
+      if (!gv) {
+        std::string alias = state.getFnAlias(old_gv->getName().str());
+        klee_error("Function %s(), alias for %s not found!\n", alias.c_str(),
+                   old_gv->getName().str().c_str());
       }
      
       if (Function *f = dyn_cast<Function>(gv))
@@ -2945,6 +2959,9 @@ void Executor::run(ExecutionState &initialState) {
   std::vector<ExecutionState *> newStates(states.begin(), states.end());
   searcher->update(0, newStates, std::vector<ExecutionState *>());
 
+  if (ParallelWorkers > 1)
+    workerPool = new WorkerPool(interpreterHandler, ParallelWorkers);
+
   while (!states.empty() && !haltExecution) {
     ExecutionState &state = searcher->selectState();
     KInstruction *ki = state.pc;
@@ -2956,12 +2973,78 @@ void Executor::run(ExecutionState &initialState) {
     checkMemoryUsage();
 
     updateStates(&state);
+
+    if (workerPool && canSplitStates())
+      splitStates();
   }
 
   delete searcher;
   searcher = 0;
 
   doDumpStates();
+
+  if (workerPool) {
+    if (workerPool->isMainWorker())
+      workerPool->joinWorkers();
+    else
+      workerPool->finishWorker();
+  }
+}
+
+bool Executor::canSplitStates() {
+  // This runs after every instruction and may walk all states below, so only
+  // look every few thousand instructions.
+  if ((stats::instructions & 0xFFF) != 0)
+    return false;
+  if (!workerPool->getIdleSlots())
+    return false;
+
+  unsigned threshold = ParallelSplitStates ? ParallelSplitStates.getValue()
+                                           : 4 * ParallelWorkers;
+  if (workerPool->hasSplit())
+    threshold = std::max(2u, threshold / ParallelWorkers);
+  if (states.size() < threshold)
+    return false;
+
+  // Merge groups and paused states live outside the searcher, and states
+  // taking part in a loop analysis share their LoopInProcess with each
+  // other, so none of them can be handed to different workers.
+  if (!mergeGroups.empty() || !inCloseMerge.empty() || !seedMap.empty())
+    return false;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it)
+    if (!(*it)->loopInProcess.isNull())
+      return false;
+  return true;
+}
+
+void Executor::splitStates() {
+  interpreterHandler->getInfoStream().flush();
+  if (debugInstFile)
+    debugInstFile->flush();
+
+  unsigned numShares;
+  unsigned share = workerPool->startWorkers(states.size() - 1, numShares);
+  if (numShares == 1)
+    return;
+
+  if (share != 0) {
+    if (statsTracker)
+      statsTracker->detachOutputFiles();
+    klee_message("worker %u started (pid %d) with %u of %u states",
+                 workerPool->getWorkerId(), getpid(),
+                 (unsigned) (states.size() - share + numShares - 1) / numShares,
+                 (unsigned) states.size());
+  }
+
+  // The state set is ordered by address, which is the same in every worker
+  // right after the fork, so the shares are disjoint and cover all states.
+  unsigned i = 0;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it, ++i)
+    if (i % numShares != share)
+      removedStates.push_back(*it);
+  updateStates(nullptr);
 }
 
 std::string Executor::getAddressInfo(ExecutionState &state, 
@@ -3390,6 +3473,8 @@ ObjectState *Executor::bindObjectInState(ExecutionState &state,
                                          bool isLocal,
                                          const Array *array) {
   ObjectState *os = array ? new ObjectState(mo, array) : new ObjectState(mo);
+  os->readInterceptor = state.getInterceptReader(mo->address);
+  os->writeInterceptor = state.getInterceptWriter(mo->address);
   state.addressSpace.bindObject(mo, os);
 
   // Its possible that multiple bindings of the same mo in the state
@@ -3632,16 +3717,7 @@ void Executor::executeMemoryOperation(ExecutionState &state,
 
     // check if the operation is intercepted
     if (isWrite) {
-      std::string interceptWriter = state.getInterceptWriter(mo->address);
-      if (interceptWriter != "") {
-        GlobalValue *gv = kmodule->module->getNamedValue(interceptWriter);
-        if (!gv) {
-          klee_error("Function %s(), interceptor, not found!\n", interceptWriter.c_str());
-        }
-        Function* interceptFunc;
-        if (!(interceptFunc = dyn_cast<Function>(gv))) {
-          klee_error("Interceptor is not a function\n");
-        }
+      if (Function *interceptFunc = op.second->writeInterceptor) {
         std::vector<ref<Expr>> interceptArgs;
         interceptArgs.push_back(/* address */ ConstantExpr::alloc(mo->address, 64));
         interceptArgs.push_back(/* offset */ ZExtExpr::create(offset, 32));
@@ -3651,16 +3727,7 @@ void Executor::executeMemoryOperation(ExecutionState &state,
         return;
       }
     } else {
-      std::string interceptReader = state.getInterceptReader(mo->address);
-      if (interceptReader != "") {
-        GlobalValue *gv = kmodule->module->getNamedValue(interceptReader);
-        if (!gv) {
-          klee_error("Function %s(), interceptor, not found!\n", interceptReader.c_str());
-        }
-        Function* interceptFunc;
-        if (!(interceptFunc = dyn_cast<Function>(gv))) {
-          klee_error("Interceptor is not a function\n");
-        }
+      if (Function *interceptFunc = op.second->readInterceptor) {
         std::vector<ref<Expr>> interceptArgs;
         interceptArgs.push_back(/* address */ ConstantExpr::alloc(mo->address, 64));
         interceptArgs.push_back(/* offset */ ZExtExpr::create(offset, 32));
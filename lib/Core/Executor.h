@@ -70,6 +70,7 @@ namespace klee {
   class TimingSolver;
   class TreeStreamWriter;
   class MergeHandler;
+  class WorkerPool;
   template<class T> class ref;
 
 
@@ -227,6 +228,9 @@ private:
   // @brief buffer to store logs before flushing to file
   llvm::raw_string_ostream debugLogBuffer;
 
+  /// Splits the search over several processes, see --parallel-workers.
+  WorkerPool *workerPool;
+
   void addState(ExecutionState *current,
                 ExecutionState *fresh);
 
@@ -240,6 +244,13 @@ private:
 
   void run(ExecutionState &initialState);
 
+  /// Whether some of the states may be handed to new workers at this point.
+  bool canSplitStates();
+
+  /// Start workers on the idle slots and keep only this worker's share of
+  /// the states.
+  void splitStates();
+
   // Given a concrete object in our [klee's] address space, add it to 
   // objects checked code can reference.
   MemoryObject *addExternalObject(ExecutionState &state, void *addr, 
@@ -363,12 +374,12 @@ private:
   Cell& getArgumentCell(ExecutionState &state,
                         KFunction *kf,
                         unsigned index) {
-    return state.stack.back().locals[kf->getArgRegister(index)];
+    return state.stack.back().getWriteableLocal(kf->getArgRegister(index));
   }
 
   Cell& getDestCell(ExecutionState &state,
                     KInstruction *target) {
-    return state.stack.back().locals[target->dest];
+    return state.stack.back().getWriteableLocal(target->dest);
   }
 
   void bindLocal(KInstruction *target, 
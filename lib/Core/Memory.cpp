@@ -27,6 +27,7 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <cassert>
+#include <new>
 #include <sstream>
 
 using namespace llvm;
@@ -99,15 +100,19 @@ ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
+    concreteStore(0),
     concreteMask(0),
     flushMask(0),
     knownSymbolics(0),
+    hasSymbolicSlots(false),
     updates(0, 0),
     size(mo->size),
     readOnly(false),
-    accessible(true) {
+    accessible(true),
+    readInterceptor(0),
+    writeInterceptor(0) {
   mo->refCount++;
+  allocateStorage(false);
   if (!UseConstantArrays) {
     static unsigned id = 0;
     const Array *array =
@@ -122,15 +127,19 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
+    concreteStore(0),
     concreteMask(0),
     flushMask(0),
     knownSymbolics(0),
+    hasSymbolicSlots(false),
     updates(array, 0),
     size(mo->size),
     readOnly(false),
-    accessible(true) {
+    accessible(true),
+    readInterceptor(0),
+    writeInterceptor(0) {
   mo->refCount++;
+  allocateStorage(false);
   makeSymbolic();
   memset(concreteStore, 0, size);
 }
@@ -139,34 +148,41 @@ ObjectState::ObjectState(const ObjectState &os)
   : copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
-    flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
+    concreteStore(0),
+    concreteMask(0),
+    flushMask(0),
     knownSymbolics(0),
+    hasSymbolicSlots(false),
     updates(os.updates),
     size(os.size),
     readOnly(false),
     accessible(os.accessible),
-    inaccessible_message(os.inaccessible_message) {
+    inaccessible_message(os.inaccessible_message),
+    readInterceptor(os.readInterceptor),
+    writeInterceptor(os.writeInterceptor) {
   assert(!os.readOnly && "no need to copy read only object?");
   if (object)
     object->refCount++;
 
+  // The bytes and both masks are laid out back to back, so a single copy
+  // takes care of all of them.
+  allocateStorage(os.knownSymbolics != 0);
+  memcpy(concreteStore, os.concreteStore, storageSize(size, false));
+  if (os.concreteMask)
+    concreteMask = concreteMaskWords();
+  if (os.flushMask)
+    flushMask = flushMaskWords();
+
   if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
+    knownSymbolics = symbolicSlots();
     for (unsigned i=0; i<size; i++)
       knownSymbolics[i] = os.knownSymbolics[i];
   }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
 }
 
 ObjectState::~ObjectState() {
   assert(refCount == 0);
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
+  releaseStorage();
 
   if (object)
   {
@@ -179,6 +195,82 @@ ObjectState::~ObjectState() {
   }
 }
 
+size_t ObjectState::storageSize(unsigned size, bool symbolicSlots) {
+  // Round the bytes up so that the slots behind the masks stay aligned.
+  size_t bytes = ((size_t)size + 7) & ~(size_t)7;
+  bytes += 2 * maskWords(size) * sizeof(uint32_t);
+  if (symbolicSlots)
+    bytes += size * sizeof(ref<Expr>);
+  return bytes;
+}
+
+uint32_t *ObjectState::concreteMaskWords() const {
+  return reinterpret_cast<uint32_t *>(concreteStore + ((size + 7) & ~7u));
+}
+
+uint32_t *ObjectState::flushMaskWords() const {
+  return concreteMaskWords() + maskWords(size);
+}
+
+ref<Expr> *ObjectState::symbolicSlots() const {
+  assert(hasSymbolicSlots && "no room for known symbolics");
+  return reinterpret_cast<ref<Expr> *>(flushMaskWords() + maskWords(size));
+}
+
+uint8_t *ObjectState::allocateBlock(size_t bytes) {
+  if (bytes <= sizeof(inlineStorage))
+    return reinterpret_cast<uint8_t *>(inlineStorage);
+  if (object && object->parent)
+    return static_cast<uint8_t *>(object->parent->allocateStorage(bytes));
+  return static_cast<uint8_t *>(::operator new(bytes));
+}
+
+void ObjectState::releaseBlock(uint8_t *block, size_t bytes) {
+  if (block == reinterpret_cast<uint8_t *>(inlineStorage))
+    return;
+  if (object && object->parent)
+    object->parent->releaseStorage(block, bytes);
+  else
+    ::operator delete(block);
+}
+
+void ObjectState::allocateStorage(bool withSymbolicSlots) {
+  concreteStore = allocateBlock(storageSize(size, withSymbolicSlots));
+  hasSymbolicSlots = withSymbolicSlots;
+  if (hasSymbolicSlots) {
+    ref<Expr> *slots = symbolicSlots();
+    for (unsigned i = 0; i < size; i++)
+      new (&slots[i]) ref<Expr>();
+  }
+}
+
+void ObjectState::releaseStorage() {
+  if (hasSymbolicSlots) {
+    ref<Expr> *slots = symbolicSlots();
+    for (unsigned i = 0; i < size; i++)
+      slots[i].~ref();
+  }
+  releaseBlock(concreteStore, storageSize(size, hasSymbolicSlots));
+  concreteStore = 0;
+}
+
+void ObjectState::addSymbolicSlots() {
+  assert(!hasSymbolicSlots && !knownSymbolics);
+  uint8_t *oldStore = concreteStore;
+  size_t oldBytes = storageSize(size, false);
+
+  allocateStorage(true);
+  // Both blocks are the inline storage if the slots fit in there as well.
+  if (concreteStore != oldStore) {
+    memcpy(concreteStore, oldStore, oldBytes);
+    releaseBlock(oldStore, oldBytes);
+  }
+  if (concreteMask)
+    concreteMask = concreteMaskWords();
+  if (flushMask)
+    flushMask = flushMaskWords();
+}
+
 ArrayCache *ObjectState::getArrayCache() const {
   assert(object && "object was NULL");
   return object->parent->getArrayCache();
@@ -254,9 +346,11 @@ void ObjectState::flushToConcreteStore(TimingSolver *solver,
 }
 
 void ObjectState::makeConcrete() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
+  // Keep the slots around, the object is likely to turn symbolic again.
+  if (knownSymbolics) {
+    for (unsigned i=0; i<size; i++)
+      knownSymbolics[i] = 0;
+  }
   concreteMask = 0;
   flushMask = 0;
   knownSymbolics = 0;
@@ -301,7 +395,6 @@ const Array *ObjectState::forgetAll() {
     ref<Expr> read = ReadExpr::create(ul, ConstantExpr::alloc(i, Expr::Int32));
     setKnownSymbolic(i, read.get());
   }
-  if (flushMask) delete flushMask;
   flushMask = 0;
   // llvm::errs() << "\n";
   return array;
@@ -358,6 +451,22 @@ void ObjectState::initializeToRandom() {
   }
 }
 
+static void fillMask(uint32_t *bits, unsigned words, bool value) {
+  memset(bits, value ? 0xFF : 0, words * sizeof(*bits));
+}
+
+static bool testBit(const uint32_t *bits, unsigned idx) {
+  return (bits[idx / 32] >> (idx & 0x1F)) & 1;
+}
+
+static void setBit(uint32_t *bits, unsigned idx) {
+  bits[idx / 32] |= 1 << (idx & 0x1F);
+}
+
+static void clearBit(uint32_t *bits, unsigned idx) {
+  bits[idx / 32] &= ~(1 << (idx & 0x1F));
+}
+
 /*
 Cache Invariants
 --
@@ -375,7 +484,10 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
 
 void ObjectState::flushRangeForRead(unsigned rangeBase, 
                                     unsigned rangeSize) const {
-  if (!flushMask) flushMask = new BitArray(size, true);
+  if (!flushMask) {
+    flushMask = flushMaskWords();
+    fillMask(flushMask, maskWords(size), true);
+  }
  
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
@@ -388,14 +500,17 @@ void ObjectState::flushRangeForRead(unsigned rangeBase,
                        knownSymbolics[offset]);
       }
 
-      flushMask->unset(offset);
+      clearBit(flushMask, offset);
     }
   } 
 }
 
 void ObjectState::flushRangeForWrite(unsigned rangeBase, 
                                      unsigned rangeSize) {
-  if (!flushMask) flushMask = new BitArray(size, true);
+  if (!flushMask) {
+    flushMask = flushMaskWords();
+    fillMask(flushMask, maskWords(size), true);
+  }
 
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
@@ -410,7 +525,7 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase,
         setKnownSymbolic(offset, 0);
       }
 
-      flushMask->unset(offset);
+      clearBit(flushMask, offset);
     } else {
       // flushed bytes that are written over still need
       // to be marked out
@@ -424,11 +539,11 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase,
 }
 
 bool ObjectState::isByteConcrete(unsigned offset) const {
-  return !concreteMask || concreteMask->get(offset);
+  return !concreteMask || testBit(concreteMask, offset);
 }
 
 bool ObjectState::isByteFlushed(unsigned offset) const {
-  return flushMask && !flushMask->get(offset);
+  return flushMask && !testBit(flushMask, offset);
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
@@ -437,25 +552,28 @@ bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
 
 void ObjectState::markByteConcrete(unsigned offset) {
   if (concreteMask)
-    concreteMask->set(offset);
+    setBit(concreteMask, offset);
 }
 
 void ObjectState::markByteSymbolic(unsigned offset) {
-  if (!concreteMask)
-    concreteMask = new BitArray(size, true);
-  concreteMask->unset(offset);
+  if (!concreteMask) {
+    concreteMask = concreteMaskWords();
+    fillMask(concreteMask, maskWords(size), true);
+  }
+  clearBit(concreteMask, offset);
 }
 
 void ObjectState::markByteUnflushed(unsigned offset) {
   if (flushMask)
-    flushMask->set(offset);
+    setBit(flushMask, offset);
 }
 
 void ObjectState::markByteFlushed(unsigned offset) {
   if (!flushMask) {
-    flushMask = new BitArray(size, false);
+    flushMask = flushMaskWords();
+    fillMask(flushMask, maskWords(size), false);
   } else {
-    flushMask->unset(offset);
+    clearBit(flushMask, offset);
   }
 }
 
@@ -465,7 +583,9 @@ void ObjectState::setKnownSymbolic(unsigned offset,
     knownSymbolics[offset] = value;
   } else {
     if (value) {
-      knownSymbolics = new ref<Expr>[size];
+      if (!hasSymbolicSlots)
+        addSymbolicSlots();
+      knownSymbolics = symbolicSlots();
       knownSymbolics[offset] = value;
     }
   }
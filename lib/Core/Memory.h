@@ -20,6 +20,7 @@
 #include <string>
 
 namespace llvm {
+  class Function;
   class Value;
 }
 
@@ -154,16 +155,26 @@ private:
 
   const MemoryObject *object;
 
+  /// The concrete bytes, the words of both masks and (once the object has
+  /// held a symbolic byte) the knownSymbolics slots share a single block:
+  /// inlineStorage if it fits, otherwise one from the MemoryManager pools.
+  /// The masks are null while they are not in use, but their words are
+  /// always reserved.
   uint8_t *concreteStore;
 
   // XXX cleanup name of flushMask (its backwards or something)
-  BitArray *concreteMask;
+  uint32_t *concreteMask;
 
   // mutable because may need flushed during read of const
-  mutable BitArray *flushMask;
+  mutable uint32_t *flushMask;
 
   ref<Expr> *knownSymbolics;
 
+  /// Whether the block has room for (constructed) knownSymbolics slots.
+  bool hasSymbolicSlots;
+
+  uint64_t inlineStorage[4];
+
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
 
@@ -175,6 +186,11 @@ public:
   bool accessible;
   std::string inaccessible_message;
 
+  /// Functions that reads and writes of this object are redirected to, set
+  /// with klee_intercept_reads and klee_intercept_writes.
+  llvm::Function *readInterceptor;
+  llvm::Function *writeInterceptor;
+
 public:
   /// Create a new object state for the given memory object with concrete
   /// contents. The initial contents are undefined, it is the callers
@@ -230,6 +246,19 @@ public:
   const Array *forgetAll();
 
 private:
+  static unsigned maskWords(unsigned size) { return (size + 31) / 32; }
+  static size_t storageSize(unsigned size, bool symbolicSlots);
+
+  uint32_t *concreteMaskWords() const;
+  uint32_t *flushMaskWords() const;
+  ref<Expr> *symbolicSlots() const;
+
+  uint8_t *allocateBlock(size_t bytes);
+  void releaseBlock(uint8_t *block, size_t bytes);
+  void allocateStorage(bool symbolicSlots);
+  void releaseStorage();
+  void addSymbolicSlots();
+
   const UpdateList &getUpdates() const;
 
   void makeConcrete();
@@ -17,6 +17,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/MathExtras.h"
 
+#include <cassert>
 #include <inttypes.h>
 #include <sys/mman.h>
 
@@ -56,7 +57,13 @@ llvm::cl::opt<unsigned long long> DeterministicStartAddress(
 /***/
 MemoryManager::MemoryManager(ArrayCache *_arrayCache)
     : arrayCache(_arrayCache), deterministicSpace(0), nextFreeSlot(0),
-      spaceSize(DeterministicAllocationSize.getValue() * 1024 * 1024) {
+      spaceSize(DeterministicAllocationSize.getValue() * 1024 * 1024),
+      liveStorageBlocks(0) {
+  for (unsigned i = 0; i < NumStorageClasses; ++i) {
+    storagePools[i].freeList = 0;
+    storagePools[i].slabPos = storagePools[i].slabEnd = 0;
+  }
+
   if (DeterministicAllocation) {
     // Page boundary
     void *expectedAddress = (void *)DeterministicStartAddress.getValue();
@@ -89,6 +96,12 @@ MemoryManager::~MemoryManager() {
 
   if (DeterministicAllocation)
     munmap(deterministicSpace, spaceSize);
+
+  // Object states give their blocks back through the manager, so none of
+  // them may outlive it.
+  assert(liveStorageBlocks == 0 && "object states outlive their manager");
+  for (unsigned i = 0; i < storageSlabs.size(); ++i)
+    delete[] storageSlabs[i];
 }
 
 MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
@@ -177,6 +190,53 @@ void MemoryManager::markFreed(MemoryObject *mo) {
   }
 }
 
+static const size_t StorageSlabSize = 64 * 1024;
+
+unsigned MemoryManager::getStorageShift(size_t bytes) {
+  unsigned shift = MinStorageShift;
+  while (((size_t)1 << shift) < bytes)
+    ++shift;
+  return shift;
+}
+
+void *MemoryManager::allocateStorage(size_t bytes) {
+  unsigned shift = getStorageShift(bytes);
+  if (shift > MaxStorageShift)
+    return ::operator new(bytes);
+
+  ++liveStorageBlocks;
+  StoragePool &pool = storagePools[shift - MinStorageShift];
+  if (void *block = pool.freeList) {
+    pool.freeList = *static_cast<void **>(block);
+    return block;
+  }
+
+  size_t blockSize = (size_t)1 << shift;
+  if (pool.slabPos == pool.slabEnd) {
+    char *slab = new char[StorageSlabSize];
+    storageSlabs.push_back(slab);
+    pool.slabPos = slab;
+    pool.slabEnd = slab + StorageSlabSize;
+  }
+  void *block = pool.slabPos;
+  pool.slabPos += blockSize;
+  return block;
+}
+
+void MemoryManager::releaseStorage(void *block, size_t bytes) {
+  unsigned shift = getStorageShift(bytes);
+  if (shift > MaxStorageShift) {
+    ::operator delete(block);
+    return;
+  }
+
+  assert(liveStorageBlocks > 0 && "releasing storage that was never handed out");
+  --liveStorageBlocks;
+  StoragePool &pool = storagePools[shift - MinStorageShift];
+  *static_cast<void **>(block) = pool.freeList;
+  pool.freeList = block;
+}
+
 size_t MemoryManager::getUsedDeterministicSize() {
   return nextFreeSlot - deterministicSpace;
 }
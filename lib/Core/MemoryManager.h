@@ -11,7 +11,9 @@
 #define KLEE_MEMORYMANAGER_H
 
 #include <set>
+#include <stddef.h>
 #include <stdint.h>
+#include <vector>
 
 namespace llvm {
 class Value;
@@ -31,6 +33,21 @@ private:
   char *nextFreeSlot;
   size_t spaceSize;
 
+  /// Pools backing the contents of object states, one per power of two
+  /// size class from 2^MinStorageShift to 2^MaxStorageShift bytes. Blocks are
+  /// carved out of slabs and recycled through an intrusive free list.
+  enum { MinStorageShift = 6, MaxStorageShift = 12,
+         NumStorageClasses = MaxStorageShift - MinStorageShift + 1 };
+  struct StoragePool {
+    void *freeList;
+    char *slabPos, *slabEnd;
+  };
+  StoragePool storagePools[NumStorageClasses];
+  std::vector<char *> storageSlabs;
+  size_t liveStorageBlocks;
+
+  static unsigned getStorageShift(size_t bytes);
+
 public:
   MemoryManager(ArrayCache *arrayCache);
   ~MemoryManager();
@@ -47,6 +64,12 @@ public:
   void markFreed(MemoryObject *mo);
   ArrayCache *getArrayCache() const { return arrayCache; }
 
+  /// Allocate a block of at least \p bytes for the contents of an object
+  /// state. The block is aligned for pointers and must be given back with
+  /// releaseStorage() using the same size.
+  void *allocateStorage(size_t bytes);
+  void releaseStorage(void *block, size_t bytes);
+
   /*
    * Returns the size used by deterministic allocation in bytes
    */
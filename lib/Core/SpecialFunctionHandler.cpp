@@ -812,6 +812,18 @@ void SpecialFunctionHandler::handleGetValue(ExecutionState &state,
   executor.executeGetValue(state, arguments[0], target);
 }
 
+Function *SpecialFunctionHandler::getInterceptor(const std::string &name) {
+  GlobalValue *gv = executor.kmodule->module->getNamedValue(name);
+  if (!gv) {
+    klee_error("Function %s(), interceptor, not found!\n", name.c_str());
+  }
+  Function *interceptFunc = dyn_cast<Function>(gv);
+  if (!interceptFunc) {
+    klee_error("Interceptor is not a function\n");
+  }
+  return interceptFunc;
+}
+
 void SpecialFunctionHandler::handleInterceptReads(ExecutionState &state,
                                                   KInstruction *target,
                                                   std::vector<ref<Expr> > &arguments) {
@@ -820,7 +832,7 @@ void SpecialFunctionHandler::handleInterceptReads(ExecutionState &state,
 
   uint64_t addr = cast<ConstantExpr>(arguments[0])->getZExtValue();
   std::string reader = readStringAtAddress(state, arguments[1]);
-  state.addReadsIntercept(addr, reader);
+  state.addReadsIntercept(addr, getInterceptor(reader));
 }
 
 void SpecialFunctionHandler::handleInterceptWrites(ExecutionState &state,
@@ -832,7 +844,7 @@ void SpecialFunctionHandler::handleInterceptWrites(ExecutionState &state,
   uint64_t addr = cast<ConstantExpr>(arguments[0])->getZExtValue();
   std::string writer = readStringAtAddress(state, arguments[1]);
 
-  state.addWritesIntercept(addr, writer);
+  state.addWritesIntercept(addr, getInterceptor(writer));
 }
 
 void SpecialFunctionHandler::handleDefineFixedObject(ExecutionState &state,
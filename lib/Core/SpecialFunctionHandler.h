@@ -91,6 +91,9 @@ namespace klee {
     /* Convenience routines */
 
     std::string readStringAtAddress(ExecutionState &state, ref<Expr> address);
+
+    /// The function named by klee_intercept_reads/klee_intercept_writes.
+    llvm::Function *getInterceptor(const std::string &name);
     
     /* Handlers */
 
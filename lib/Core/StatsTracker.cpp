@@ -122,7 +122,10 @@ namespace klee {
     WriteIStatsTimer(StatsTracker *_statsTracker) : statsTracker(_statsTracker) {}
     ~WriteIStatsTimer() {}
     
-    void run() { statsTracker->writeIStats(); }
+    void run() {
+      if (statsTracker->istatsFile)
+        statsTracker->writeIStats();
+    }
   };
   
   class WriteStatsTimer : public Executor::Timer {
@@ -132,7 +135,10 @@ namespace klee {
     WriteStatsTimer(StatsTracker *_statsTracker) : statsTracker(_statsTracker) {}
     ~WriteStatsTimer() {}
     
-    void run() { statsTracker->writeStatsLine(); }
+    void run() {
+      if (statsTracker->statsFile)
+        statsTracker->writeStatsLine();
+    }
   };
 
   class UpdateReachableTimer : public Executor::Timer {
@@ -276,13 +282,22 @@ void StatsTracker::done() {
   if (statsFile)
     writeStatsLine();
 
-  if (OutputIStats) {
+  if (istatsFile) {
     if (updateMinDistToUncovered)
       computeReachableUncovered();
     writeIStats();
   }
 }
 
+void StatsTracker::detachOutputFiles() {
+  // Both files are flushed after every write, so closing our copies of the
+  // descriptors cannot emit anything twice.
+  delete statsFile;
+  statsFile = 0;
+  delete istatsFile;
+  istatsFile = 0;
+}
+
 void StatsTracker::stepInstruction(ExecutionState &es) {
   if (OutputIStats) {
     if (TrackInstructionTime) {
@@ -418,6 +433,8 @@ void StatsTracker::writeStatsHeader() {
              << "'ResolveTime',"
              << "'QueryCexCacheMisses',"
              << "'QueryCexCacheHits',"
+             << "'ResolveQueries',"
+             << "'ResolveQueriesSaved',"
 #ifdef KLEE_ARRAY_DEBUG
 	     << "'ArrayHashTime',"
 #endif
@@ -450,6 +467,8 @@ void StatsTracker::writeStatsLine() {
              << "," << stats::resolveTime / 1000000.
              << "," << stats::queryCexCacheMisses
              << "," << stats::queryCexCacheHits
+             << "," << stats::resolveQueries
+             << "," << stats::resolveQueriesSaved
 #ifdef KLEE_ARRAY_DEBUG
              << "," << stats::arrayHashTime / 1000000.
 #endif
@@ -76,6 +76,10 @@ namespace klee {
     // called when execution is done and stats files should be flushed
     void done();
 
+    // called in secondary worker processes, which leave the stats files
+    // to worker 0
+    void detachOutputFiles();
+
     // process stats for a single instruction step, es is the state
     // about to be stepped
     void stepInstruction(ExecutionState &es);
@@ -125,6 +125,26 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   return success;
 }
 
+bool
+TimingSolver::getInitialValues(const ExecutionState& state, ref<Expr> expr,
+                               const std::vector<const Array*>
+                                 &objects,
+                               std::vector< std::vector<unsigned char> >
+                                 &result,
+                               bool &hasSolution) {
+  TimerStatIncrementer timer(stats::solverTime);
+
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr);
+
+  bool success = solver->getInitialValues(Query(state.constraints, expr),
+                                          objects, result, hasSolution);
+
+  state.queryCost += timer.check() / 1e6;
+
+  return success;
+}
+
 std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
   return solver->getRange(Query(state.constraints, expr));
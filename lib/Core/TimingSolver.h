@@ -63,6 +63,13 @@ namespace klee {
                           const std::vector<const Array*> &objects,
                           std::vector< std::vector<unsigned char> > &result);
 
+    /// Like getInitialValues, but in a solution under which \a expr
+    /// does not hold. \a hasSolution is false if \a expr must be true.
+    bool getInitialValues(const ExecutionState&, ref<Expr> expr,
+                          const std::vector<const Array*> &objects,
+                          std::vector< std::vector<unsigned char> > &result,
+                          bool &hasSolution);
+
     std::pair< ref<Expr>, ref<Expr> >
     getRange(const ExecutionState&, ref<Expr> query);
   };
@@ -0,0 +1,270 @@
+//===-- WorkerPool.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "WorkerPool.h"
+
+#include "klee/Interpreter.h"
+#include "klee/Statistics.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+static bool writeAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char *>(buf);
+  while (size) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool readAll(int fd, void *buf, size_t size) {
+  char *p = static_cast<char *>(buf);
+  while (size) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (n == 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+WorkerPool::WorkerPool(InterpreterHandler *_handler, unsigned numWorkers)
+  : handler(_handler), shared(0), workerId(0), split(false), parentFd(-1),
+    pathsBase(0), testsBase(0) {
+  assert(numWorkers > 1 && "a worker pool needs at least two workers");
+
+  void *p = mmap(0, sizeof(Shared), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    klee_warning("unable to map worker pool state, running in a single "
+                 "process: %s", strerror(errno));
+    return;
+  }
+  shared = static_cast<Shared *>(p);
+  memset(shared, 0, sizeof(Shared));
+  shared->idleSlots = numWorkers - 1;
+}
+
+WorkerPool::~WorkerPool() {
+  for (unsigned i = 0; i < childFds.size(); ++i)
+    close(childFds[i]);
+  if (parentFd >= 0)
+    close(parentFd);
+  if (shared)
+    munmap(shared, sizeof(Shared));
+}
+
+unsigned WorkerPool::getIdleSlots() const {
+  return shared ? __atomic_load_n(&shared->idleSlots, __ATOMIC_RELAXED) : 0;
+}
+
+void WorkerPool::reserve(Kind kind, unsigned used) {
+  assert(!split && "ids reserved after the first split");
+  shared->lastIds[kind] = used;
+}
+
+unsigned WorkerPool::next(Kind kind) {
+  return __atomic_add_fetch(&shared->lastIds[kind], 1, __ATOMIC_RELAXED);
+}
+
+void WorkerPool::startTracking() {
+  StatisticManager &sm = *theStatisticManager;
+  unsigned numStats = sm.getNumStatistics();
+
+  globalBase.resize(numStats);
+  for (unsigned i = 0; i < numStats; ++i)
+    globalBase[i] = sm.getValue(sm.getStatistic(i));
+  sm.trackIndexChanges();
+
+  pathsBase = handler->getNumPathsExplored();
+  testsBase = handler->getNumTestCases();
+}
+
+unsigned WorkerPool::startWorkers(unsigned n, unsigned &numShares) {
+  numShares = 1;
+
+  // Claim the slots first, other workers may be after the same ones.
+  unsigned idle = getIdleSlots();
+  do {
+    if (!idle)
+      return 0;
+  } while (!__atomic_compare_exchange_n(&shared->idleSlots, &idle,
+                                        idle - std::min(idle, n), false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  n = std::min(idle, n);
+
+  if (!split) {
+    split = true;
+    handler->setWorkerId(0, *this);
+  }
+
+  // Anything still sitting in a stdio buffer would otherwise be written once
+  // by every worker, and a writer thread would not survive the fork.
+  handler->finishPendingOutput();
+  fflush(NULL);
+
+  for (; n; --n) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+      klee_warning("unable to create pipe for a worker: %s", strerror(errno));
+      break;
+    }
+
+    unsigned id = __atomic_add_fetch(&shared->lastWorkerId, 1,
+                                     __ATOMIC_RELAXED);
+    pid_t pid = fork();
+    if (pid < 0) {
+      klee_warning("unable to fork worker %u: %s", id, strerror(errno));
+      close(fds[0]);
+      close(fds[1]);
+      break;
+    }
+
+    if (pid == 0) {
+      close(fds[0]);
+      for (unsigned i = 0; i < childFds.size(); ++i)
+        close(childFds[i]);
+      childFds.clear();
+      children.clear();
+      if (parentFd >= 0)
+        close(parentFd);
+      parentFd = fds[1];
+      workerId = id;
+      startTracking();
+      handler->setWorkerId(workerId, *this);
+      return numShares;
+    }
+
+    close(fds[1]);
+    children.push_back(pid);
+    childFds.push_back(fds[0]);
+    ++numShares;
+  }
+
+  // Give back the slots of the workers that could not be started.
+  if (n)
+    __atomic_add_fetch(&shared->idleSlots, n, __ATOMIC_RELAXED);
+  return 0;
+}
+
+void WorkerPool::finishWorker() {
+  assert(!isMainWorker());
+
+  joinWorkers();
+
+  StatisticManager &sm = *theStatisticManager;
+  unsigned numStats = sm.getNumStatistics();
+  const std::vector<unsigned> &indices = sm.getChangedIndices();
+
+  // Only the statistics that changed are sent: (statistic, delta) pairs for
+  // the global values, then (index, statistic, delta) triples.
+  std::vector<uint64_t> msg(5);
+  msg[1] = handler->getNumPathsExplored() - pathsBase;
+  msg[2] = handler->getNumTestCases() - testsBase;
+  for (unsigned i = 0; i < numStats; ++i) {
+    uint64_t delta = sm.getValue(sm.getStatistic(i)) - globalBase[i];
+    if (delta) {
+      msg.push_back(i);
+      msg.push_back(delta);
+      ++msg[3];
+    }
+  }
+  for (unsigned k = 0; k < indices.size(); ++k) {
+    for (unsigned i = 0; i < numStats; ++i) {
+      const Statistic &s = sm.getStatistic(i);
+      uint64_t delta = sm.getIndexedValue(s, indices[k]) -
+                       sm.getChangedBaseValue(s, k);
+      if (delta) {
+        msg.push_back(indices[k]);
+        msg.push_back(i);
+        msg.push_back(delta);
+        ++msg[4];
+      }
+    }
+  }
+  msg[0] = msg.size() - 1;
+
+  handler->finishWorker();
+  fflush(NULL);
+
+  bool ok = writeAll(parentFd, &msg[0], msg.size() * sizeof(msg[0]));
+  close(parentFd);
+  parentFd = -1;
+  _exit(ok ? 0 : 1);
+}
+
+void WorkerPool::joinWorkers() {
+  if (!split)
+    return;
+
+  // This process is out of states, so its slot can be used by another
+  // worker while it waits.
+  __atomic_add_fetch(&shared->idleSlots, 1, __ATOMIC_RELAXED);
+
+  StatisticManager &sm = *theStatisticManager;
+  unsigned numStats = sm.getNumStatistics();
+  unsigned numIndices = sm.getNumIndices();
+
+  std::vector<uint64_t> msg;
+  for (unsigned w = 0; w < children.size(); ++w) {
+    uint64_t size;
+    bool ok = readAll(childFds[w], &size, sizeof(size));
+    if (ok) {
+      msg.resize(size);
+      ok = size >= 4 && readAll(childFds[w], &msg[0], size * sizeof(msg[0]));
+    }
+    close(childFds[w]);
+
+    int status;
+    while (waitpid(children[w], &status, 0) < 0 && errno == EINTR)
+      ;
+
+    if (!ok || msg.size() != 4 + 2 * msg[2] + 3 * msg[3]) {
+      klee_warning("worker with pid %d exited without reporting, its "
+                   "statistics are lost", children[w]);
+      continue;
+    }
+
+    handler->addWorkerResults(msg[0], msg[1]);
+    const uint64_t *p = &msg[4];
+    for (uint64_t i = 0; i < msg[2]; ++i, p += 2)
+      if (p[0] < numStats)
+        sm.incrementGlobalValue(sm.getStatistic(p[0]), p[1]);
+    for (uint64_t i = 0; i < msg[3]; ++i, p += 3)
+      if (p[0] < numIndices && p[1] < numStats)
+        sm.incrementIndexedValue(sm.getStatistic(p[1]), p[0], p[2]);
+  }
+
+  children.clear();
+  childFds.clear();
+}
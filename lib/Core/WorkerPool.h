@@ -0,0 +1,96 @@
+//===-- WorkerPool.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_WORKERPOOL_H
+#define KLEE_WORKERPOOL_H
+
+#include "klee/Interpreter.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+namespace klee {
+  /// Splits a single search over up to a fixed number of worker processes.
+  ///
+  /// Every worker is a fork() of the worker that started it, so it starts
+  /// with the complete set of states, solver chain and statistics of its
+  /// parent and simply keeps its own share of the states. Processes are used
+  /// rather than threads because expression reference counts (unless built
+  /// with KLEE_THREADSAFE_EXPR), the statistic manager and the LLVM context
+  /// are not thread-safe.
+  ///
+  /// The workers share a count of idle slots. Whenever a slot is free (at the
+  /// first split, or because a worker ran out of states) a worker holding
+  /// enough states starts a new worker on it with a share of its states, so
+  /// the load is rebalanced for as long as the search runs.
+  ///
+  /// A worker that runs out of states waits for the workers it started,
+  /// merges their results and sends the statistics that changed since it was
+  /// started to its own parent, so everything ends up in worker 0.
+  class WorkerPool : public WorkerIds {
+    /// State shared by all workers, in an anonymous shared mapping.
+    struct Shared {
+      unsigned idleSlots;
+      unsigned lastWorkerId;
+      unsigned lastIds[WorkerIds::NumKinds];
+    };
+
+    InterpreterHandler *handler;
+    Shared *shared;
+    unsigned workerId;
+    bool split;
+
+    /// The pids of the workers this process started and the read ends of
+    /// their result pipes.
+    std::vector<pid_t> children;
+    std::vector<int> childFds;
+
+    /// Workers other than worker 0: the write end of the result pipe.
+    int parentFd;
+
+    /// Global statistics and handler counters when this worker was started;
+    /// indexed statistics are tracked by the statistic manager.
+    std::vector<uint64_t> globalBase;
+    unsigned pathsBase, testsBase;
+
+    void startTracking();
+
+  public:
+    WorkerPool(InterpreterHandler *handler, unsigned numWorkers);
+    ~WorkerPool();
+
+    unsigned getWorkerId() const { return workerId; }
+    bool hasSplit() const { return split; }
+    bool isMainWorker() const { return workerId == 0; }
+
+    /// The number of workers that could be started right now.
+    unsigned getIdleSlots() const;
+
+    /// Start up to \p n new workers. Returns the share of the states the
+    /// calling process keeps: 0 in the calling worker, and 1 to \p numShares
+    /// - 1 in the new ones. A share holds the states whose position in the
+    /// (identical, pre-fork) state set is congruent to it modulo
+    /// \p numShares.
+    unsigned startWorkers(unsigned n, unsigned &numShares);
+
+    /// Wait for the workers this process started and merge their results.
+    void joinWorkers();
+
+    /// In a worker other than worker 0: join its workers, send the results
+    /// to its parent and exit the process.
+    void finishWorker();
+
+    void reserve(Kind kind, unsigned used);
+    unsigned next(Kind kind);
+  };
+}
+
+#endif
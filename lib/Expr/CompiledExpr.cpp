@@ -0,0 +1,250 @@
+//===-- CompiledExpr.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/CompiledExpr.h"
+
+#include "klee/util/Assignment.h"
+
+using namespace klee;
+
+static inline uint64_t widthMask(Expr::Width w) {
+  return w >= 64 ? ~UINT64_C(0) : (UINT64_C(1) << w) - 1;
+}
+
+static inline int64_t signExtend(uint64_t v, Expr::Width w) {
+  if (w >= 64)
+    return (int64_t) v;
+  uint64_t sign = UINT64_C(1) << (w - 1);
+  return (int64_t) ((v ^ sign) - sign);
+}
+
+CompiledExpr *CompiledExpr::compile(const ref<Expr> &e) {
+  CompiledExpr *ce = new CompiledExpr();
+  std::map<const Expr*, unsigned> slots;
+  unsigned slot;
+  if (!ce->compile(e, slots, slot)) {
+    delete ce;
+    return 0;
+  }
+  assert(slot + 1 == ce->insts.size() && "root must be the last instruction");
+  ce->values.resize(ce->insts.size());
+  ce->bytes.resize(ce->arrays.size());
+  return ce;
+}
+
+bool CompiledExpr::compile(const ref<Expr> &e,
+                           std::map<const Expr*, unsigned> &slots,
+                           unsigned &slot) {
+  std::map<const Expr*, unsigned>::iterator it = slots.find(e.get());
+  if (it != slots.end()) {
+    slot = it->second;
+    return true;
+  }
+
+  Inst inst;
+  inst.kind = e->getKind();
+  inst.width = e->getWidth();
+  inst.ops[0] = inst.ops[1] = inst.ops[2] = 0;
+  inst.imm = 0;
+  if (inst.width > 64)
+    return false;
+
+  switch (inst.kind) {
+  case Expr::Constant:
+    inst.imm = cast<ConstantExpr>(e)->getZExtValue();
+    break;
+
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    const Array *array = re->updates.root;
+    if (array->getRange() != Expr::Int8)
+      return false;
+    if (!compile(re->index, slots, inst.ops[0]))
+      return false;
+
+    std::vector<Update> ups;
+    for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+      Update u;
+      if (!compile(un->index, slots, u.index) ||
+          !compile(un->value, slots, u.value))
+        return false;
+      ups.push_back(u);
+    }
+
+    unsigned n = 0;
+    while (n < arrays.size() && arrays[n] != array)
+      ++n;
+    if (n == arrays.size())
+      arrays.push_back(array);
+
+    inst.ops[1] = n;
+    inst.ops[2] = updates.size();
+    inst.imm = ups.size();
+    updates.insert(updates.end(), ups.begin(), ups.end());
+    break;
+  }
+
+  default:
+    if (ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+      inst.imm = ee->offset;
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i) {
+      assert(i < 3);
+      if (!compile(e->getKid(i), slots, inst.ops[i]))
+        return false;
+    }
+    break;
+  }
+
+  slot = insts.size();
+  insts.push_back(inst);
+  slots.insert(std::make_pair(e.get(), slot));
+  return true;
+}
+
+bool CompiledExpr::evaluate(const Assignment &a, uint64_t &result) const {
+  for (unsigned i = 0, e = arrays.size(); i != e; ++i) {
+    Assignment::bindings_ty::const_iterator it = a.bindings.find(arrays[i]);
+    bytes[i] = it == a.bindings.end() ? 0 : &it->second;
+  }
+
+  for (unsigned i = 0, e = insts.size(); i != e; ++i) {
+    const Inst &in = insts[i];
+    Expr::Width w = in.width;
+    uint64_t l = values[in.ops[0]], r = values[in.ops[1]];
+    uint64_t v;
+
+    switch (in.kind) {
+    case Expr::Constant:
+      v = in.imm;
+      break;
+    case Expr::NotOptimized:
+      v = l;
+      break;
+
+    case Expr::Read: {
+      const Update *u = &updates[in.ops[2]], *ue = u + in.imm;
+      while (u != ue && values[u->index] != l)
+        ++u;
+      if (u != ue) {
+        v = values[u->value];
+        break;
+      }
+      const Array *array = arrays[in.ops[1]];
+      if (array->isConstantArray() && l < array->size) {
+        v = array->constantValues[l]->getZExtValue();
+        break;
+      }
+      const std::vector<unsigned char> *b = bytes[in.ops[1]];
+      if (b && l < b->size()) {
+        v = (*b)[l];
+      } else {
+        if (a.allowFreeValues)
+          return false;
+        v = 0;
+      }
+      break;
+    }
+
+    case Expr::Select:
+      v = l ? r : values[in.ops[2]];
+      break;
+    case Expr::Concat:
+      v = (l << insts[in.ops[1]].width) | r;
+      break;
+    case Expr::Extract:
+      v = l >> in.imm;
+      break;
+    case Expr::ZExt:
+      v = l;
+      break;
+    case Expr::SExt:
+      v = signExtend(l, insts[in.ops[0]].width);
+      break;
+    case Expr::Not:
+      v = ~l;
+      break;
+
+    case Expr::Add: v = l + r; break;
+    case Expr::Sub: v = l - r; break;
+    case Expr::Mul: v = l * r; break;
+    case Expr::UDiv:
+      if (!r)
+        return false;
+      v = l / r;
+      break;
+    case Expr::URem:
+      if (!r)
+        return false;
+      v = l % r;
+      break;
+    case Expr::SDiv: {
+      int64_t sl = signExtend(l, w), sr = signExtend(r, w);
+      if (!sr)
+        return false;
+      // Dividing the minimum value by -1 wraps, as it does for APInt.
+      v = sr == -1 ? -(uint64_t) sl : (uint64_t) (sl / sr);
+      break;
+    }
+    case Expr::SRem: {
+      int64_t sl = signExtend(l, w), sr = signExtend(r, w);
+      if (!sr)
+        return false;
+      v = sr == -1 ? 0 : (uint64_t) (sl % sr);
+      break;
+    }
+
+    case Expr::And: v = l & r; break;
+    case Expr::Or: v = l | r; break;
+    case Expr::Xor: v = l ^ r; break;
+    case Expr::Shl:
+      v = r >= w ? 0 : l << r;
+      break;
+    case Expr::LShr:
+      v = r >= w ? 0 : l >> r;
+      break;
+    case Expr::AShr: {
+      int64_t sl = signExtend(l, w);
+      v = (uint64_t) (r >= w ? (sl < 0 ? -1 : 0) : sl >> r);
+      break;
+    }
+
+    case Expr::Eq: v = l == r; break;
+    case Expr::Ne: v = l != r; break;
+    case Expr::Ult: v = l < r; break;
+    case Expr::Ule: v = l <= r; break;
+    case Expr::Ugt: v = l > r; break;
+    case Expr::Uge: v = l >= r; break;
+    case Expr::Slt:
+    case Expr::Sle:
+    case Expr::Sgt:
+    case Expr::Sge: {
+      Expr::Width kw = insts[in.ops[0]].width;
+      int64_t sl = signExtend(l, kw), sr = signExtend(r, kw);
+      if (in.kind == Expr::Slt)
+        v = sl < sr;
+      else if (in.kind == Expr::Sle)
+        v = sl <= sr;
+      else if (in.kind == Expr::Sgt)
+        v = sl > sr;
+      else
+        v = sl >= sr;
+      break;
+    }
+
+    default:
+      assert(0 && "unhandled expression kind");
+      return false;
+    }
+
+    values[i] = v & widthMask(w);
+  }
+
+  result = values.back();
+  return true;
+}
@@ -10,13 +10,17 @@
 #include "klee/Constraints.h"
 
 #include "klee/util/ExprPPrinter.h"
+#include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 #include "klee/Internal/Module/KModule.h"
 
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+#include <iterator>
 #include <map>
+#include <set>
 
 using namespace klee;
 
@@ -72,9 +76,238 @@ public:
   }
 };
 
+namespace klee {
+/// ConstraintFactors - Partition of a constraint set into independent
+/// factors, in the sense of the independent solver: two constraints are
+/// related if they read a common byte of some array, or both read an array
+/// and one of them does so at a symbolic index.
+///
+/// Every array byte read at a constant index, and every array read at a
+/// symbolic index, is a node, and each node belongs to one factor. Factors
+/// and the per-array node tables are held by shared pointers, so a copy of
+/// the partition only copies the pointers, and a change copies just the
+/// factors and tables it touches. Adding a constraint merges the factors it
+/// reads into the largest of them.
+class ConstraintFactors {
+public:
+  /// Add the constraint at position \p pos of the manager, which must be
+  /// past every constraint added so far.
+  void add(ref<Expr> e, unsigned pos);
+
+  /// Collect, in ascending order, the positions of the constraints related
+  /// to \p e.
+  void getRelated(ref<Expr> e, std::vector<unsigned> &result) const;
+
+private:
+  static const unsigned NoFactor = ~0u;
+  /// The byte index of the node of a whole array.
+  static const unsigned WholeArray = ~0u;
+
+  typedef std::pair<const Array *, unsigned> Node;
+
+  struct Factor {
+    /// Positions of the constraints in the factor, ascending.
+    std::vector<unsigned> constraints;
+    std::vector<Node> nodes;
+  };
+
+  struct ArrayNodes {
+    /// Factor of the whole array once it has been read at a symbolic index.
+    unsigned whole;
+    /// Factor of each byte read at a constant index.
+    std::map<unsigned, unsigned> bytes;
+
+    ArrayNodes() : whole(NoFactor) {}
+  };
+
+  /// Factors by number, null for a free number.
+  std::vector< std::shared_ptr<Factor> > factors;
+  std::vector<unsigned> freeFactors;
+  std::map<const Array *, std::shared_ptr<ArrayNodes> > arrays;
+
+  Factor &getWriteableFactor(unsigned f) {
+    std::shared_ptr<Factor> &p = factors[f];
+    if (p.use_count() > 1)
+      p = std::make_shared<Factor>(*p);
+    return *p;
+  }
+
+  void setFactor(const Node &n, unsigned f) {
+    std::shared_ptr<ArrayNodes> &p = arrays[n.first];
+    if (!p)
+      p = std::make_shared<ArrayNodes>();
+    else if (p.use_count() > 1)
+      p = std::make_shared<ArrayNodes>(*p);
+    if (n.second == WholeArray)
+      p->whole = f;
+    else
+      p->bytes[n.second] = f;
+  }
+
+  unsigned newFactor() {
+    unsigned f;
+    if (freeFactors.empty()) {
+      f = factors.size();
+      factors.push_back(std::shared_ptr<Factor>());
+    } else {
+      f = freeFactors.back();
+      freeFactors.pop_back();
+    }
+    factors[f] = std::make_shared<Factor>();
+    return f;
+  }
+
+  /// Insert into \p found the factor of every node \p e reads, and append
+  /// to \p fresh, if given, the nodes it reads which are in no factor yet.
+  void getFactors(ref<Expr> e, std::set<unsigned> &found,
+                  std::vector<Node> *fresh) const;
+
+  static bool isIrrelevant(const ReadExpr *re) {
+    // Reads of a constant array don't alias.
+    return re->updates.root->isConstantArray() && !re->updates.head;
+  }
+};
+}
+
+void ConstraintFactors::getFactors(ref<Expr> e, std::set<unsigned> &found,
+                                   std::vector<Node> *fresh) const {
+  std::vector< ref<ReadExpr> > reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+
+  for (unsigned i = 0; i != reads.size(); ++i) {
+    const ReadExpr *re = reads[i].get();
+    if (isIrrelevant(re))
+      continue;
+
+    const Array *array = re->updates.root;
+    std::map<const Array *, std::shared_ptr<ArrayNodes> >::const_iterator ai =
+      arrays.find(array);
+    const ArrayNodes *an = ai == arrays.end() ? 0 : ai->second.get();
+
+    if (an && an->whole != NoFactor) {
+      found.insert(an->whole);
+    } else if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index)) {
+      unsigned index = (unsigned) CE->getZExtValue(32);
+      std::map<unsigned, unsigned>::const_iterator it;
+      if (an && (it = an->bytes.find(index)) != an->bytes.end())
+        found.insert(it->second);
+      else if (fresh)
+        fresh->push_back(Node(array, index));
+    } else {
+      // A symbolic index may touch any byte: the array becomes one node.
+      if (an)
+        for (std::map<unsigned, unsigned>::const_iterator
+               it = an->bytes.begin(), ie = an->bytes.end(); it != ie; ++it)
+          found.insert(it->second);
+      if (fresh)
+        fresh->push_back(Node(array, WholeArray));
+    }
+  }
+}
+
+void ConstraintFactors::add(ref<Expr> e, unsigned pos) {
+  std::set<unsigned> found;
+  std::vector<Node> fresh;
+  getFactors(e, found, &fresh);
+  if (found.empty() && fresh.empty())
+    return; // related to nothing
+
+  unsigned target = NoFactor;
+  size_t targetSize = 0;
+  for (std::set<unsigned>::iterator it = found.begin(), ie = found.end();
+       it != ie; ++it) {
+    size_t size = factors[*it]->nodes.size() +
+                  factors[*it]->constraints.size();
+    if (target == NoFactor || size > targetSize) {
+      target = *it;
+      targetSize = size;
+    }
+  }
+  if (target == NoFactor)
+    target = newFactor();
+
+  Factor &t = getWriteableFactor(target);
+  for (std::set<unsigned>::iterator it = found.begin(), ie = found.end();
+       it != ie; ++it) {
+    if (*it == target)
+      continue;
+    std::shared_ptr<Factor> src;
+    src.swap(factors[*it]);
+    freeFactors.push_back(*it);
+
+    for (unsigned i = 0, n = src->nodes.size(); i != n; ++i)
+      setFactor(src->nodes[i], target);
+    t.nodes.insert(t.nodes.end(), src->nodes.begin(), src->nodes.end());
+    std::vector<unsigned> merged;
+    merged.reserve(t.constraints.size() + src->constraints.size());
+    std::merge(t.constraints.begin(), t.constraints.end(),
+               src->constraints.begin(), src->constraints.end(),
+               std::back_inserter(merged));
+    t.constraints.swap(merged);
+  }
+
+  std::sort(fresh.begin(), fresh.end());
+  fresh.erase(std::unique(fresh.begin(), fresh.end()), fresh.end());
+  for (unsigned i = 0, n = fresh.size(); i != n; ++i)
+    setFactor(fresh[i], target);
+  t.nodes.insert(t.nodes.end(), fresh.begin(), fresh.end());
+
+  assert((t.constraints.empty() || t.constraints.back() < pos) &&
+         "constraints must be added in order");
+  t.constraints.push_back(pos);
+}
+
+void ConstraintFactors::getRelated(ref<Expr> e,
+                                   std::vector<unsigned> &result) const {
+  std::set<unsigned> found;
+  getFactors(e, found, 0);
+
+  for (std::set<unsigned>::iterator it = found.begin(), ie = found.end();
+       it != ie; ++it) {
+    const std::vector<unsigned> &cs = factors[*it]->constraints;
+    result.insert(result.end(), cs.begin(), cs.end());
+  }
+  if (found.size() > 1)
+    std::sort(result.begin(), result.end());
+}
+
+ConstraintFactors &ConstraintManager::getWriteableFactors() {
+  if (!factors)
+    factors = std::make_shared<ConstraintFactors>();
+  else if (factors.use_count() > 1)
+    factors = std::make_shared<ConstraintFactors>(*factors);
+  return *factors;
+}
+
+void ConstraintManager::pushConstraint(ref<Expr> e) {
+  constraints.push_back(e);
+  if (factored)
+    getWriteableFactors().add(e, constraints.size() - 1);
+}
+
+bool ConstraintManager::getRelatedConstraints(
+    ref<Expr> e, std::vector< ref<Expr> > &result) const {
+  if (!factored)
+    return false;
+  if (!factors)
+    return true;
+
+  std::vector<unsigned> positions;
+  factors->getRelated(e, positions);
+  for (unsigned i = 0, n = positions.size(); i != n; ++i) {
+    assert(positions[i] < constraints.size() && "partition out of sync");
+    result.push_back(constraints[positions[i]]);
+  }
+  return true;
+}
+
 bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
   ConstraintManager::constraints_ty old;
   bool changed = false;
+  // The rewritten constraints move, so the partition is rebuilt once they
+  // are all in place.
+  bool wasFactored = factored;
+  factored = false;
 
   constraints.swap(old);
   for (ConstraintManager::constraints_ty::iterator 
@@ -90,6 +323,13 @@ bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
     }
   }
 
+  factored = wasFactored;
+  if (factored && changed) {
+    factors = std::make_shared<ConstraintFactors>();
+    for (unsigned i = 0, n = constraints.size(); i != n; ++i)
+      factors->add(constraints[i], i);
+  }
+
   return changed;
 }
 
@@ -152,12 +392,12 @@ void ConstraintManager::addConstraintInternal(ref<Expr> e) {
 	rewriteConstraints(visitor);
       }
     }
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
     
   default:
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
 }
@@ -33,7 +33,7 @@ namespace {
 
 /***/
 
-unsigned Expr::count = 0;
+ExprRefCount Expr::count(0);
 
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
@@ -82,7 +82,9 @@ ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
 }
 
 int Expr::compare(const Expr &b) const {
-  static ExprEquivSet equivs;
+  // Per thread, so that expressions owned by different threads can be
+  // compared concurrently.
+  static thread_local ExprEquivSet equivs;
   int r = compare(b, equivs);
   equivs.clear();
   return r;
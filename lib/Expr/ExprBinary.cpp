@@ -0,0 +1,411 @@
+//===-- ExprBinary.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/ExprBinary.h"
+
+#include "klee/ExprBuilder.h"
+#include "klee/util/ArrayCache.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+
+using namespace klee;
+
+// Layout:
+//
+//   header:       "KEXB" u32:version
+//   array table:  u32:count { str:name u32:size u32:domain u32:range
+//                             u32:numValues { u64:value }* }*
+//   node table:   u32:count { u8:tag ... }*
+//
+// Strings are a u32 length followed by the bytes. Every node either defines
+// the next update node (tag UpdateTag: u32:next u32:index u32:value) or the
+// next expression (tag = Expr::Kind, followed by the kind specific operands).
+// Expression and update ids count separately, in table order.
+
+static const char Magic[4] = { 'K', 'E', 'X', 'B' };
+static const uint32_t Version = 1;
+static const uint8_t UpdateTag = 0xff;
+
+const uint32_t ExprBinaryWriter::NoId;
+
+ExprBinaryWriter::ExprBinaryWriter()
+  : numArrays(0), numNodes(0), numExprs(0), numUpdates(0) {}
+
+void ExprBinaryWriter::writeU8(llvm::raw_ostream &os, uint8_t v) {
+  os << (char) v;
+}
+
+void ExprBinaryWriter::writeU32(llvm::raw_ostream &os, uint32_t v) {
+  char buf[4];
+  for (unsigned i = 0; i < 4; ++i)
+    buf[i] = (char) (v >> (8 * i));
+  os.write(buf, sizeof(buf));
+}
+
+void ExprBinaryWriter::writeU64(llvm::raw_ostream &os, uint64_t v) {
+  char buf[8];
+  for (unsigned i = 0; i < 8; ++i)
+    buf[i] = (char) (v >> (8 * i));
+  os.write(buf, sizeof(buf));
+}
+
+void ExprBinaryWriter::writeString(llvm::raw_ostream &os,
+                                   const std::string &s) {
+  writeU32(os, s.size());
+  os.write(s.data(), s.size());
+}
+
+uint32_t ExprBinaryWriter::addArray(const Array *array) {
+  std::map<const Array *, uint32_t>::iterator it = arrayIds.find(array);
+  if (it != arrayIds.end())
+    return it->second;
+
+  llvm::raw_string_ostream os(arrayTable);
+  writeString(os, array->name);
+  writeU32(os, array->size);
+  writeU32(os, array->domain);
+  writeU32(os, array->range);
+  writeU32(os, array->constantValues.size());
+  for (unsigned i = 0; i < array->constantValues.size(); ++i)
+    writeU64(os, array->constantValues[i]->getZExtValue());
+  os.flush();
+
+  uint32_t id = numArrays++;
+  arrayIds[array] = id;
+  return id;
+}
+
+uint32_t ExprBinaryWriter::addUpdate(const UpdateNode *un) {
+  if (!un)
+    return NoId;
+
+  std::map<const UpdateNode *, uint32_t>::iterator it = updateIds.find(un);
+  if (it != updateIds.end())
+    return it->second;
+
+  uint32_t next = addUpdate(un->next);
+  uint32_t index = addExpr(un->index);
+  uint32_t value = addExpr(un->value);
+
+  llvm::raw_string_ostream os(nodeTable);
+  writeU8(os, UpdateTag);
+  writeU32(os, next);
+  writeU32(os, index);
+  writeU32(os, value);
+  os.flush();
+
+  ++numNodes;
+  uint32_t id = numUpdates++;
+  updateIds[un] = id;
+  return id;
+}
+
+uint32_t ExprBinaryWriter::addExpr(const ref<Expr> &e) {
+  if (e.isNull())
+    return NoId;
+
+  ExprHashMap<uint32_t>::iterator it = exprIds.find(e);
+  if (it != exprIds.end())
+    return it->second;
+
+  // Everything the node refers to has to be in the table before it.
+  uint32_t array = NoId, head = NoId;
+  std::vector<uint32_t> kids;
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    array = addArray(re->updates.root);
+    head = addUpdate(re->updates.head);
+  }
+  for (unsigned i = 0; i < e->getNumKids(); ++i)
+    kids.push_back(addExpr(e->getKid(i)));
+
+  llvm::raw_string_ostream os(nodeTable);
+  writeU8(os, e->getKind());
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const llvm::APInt &value = cast<ConstantExpr>(e)->getAPValue();
+    writeU32(os, value.getBitWidth());
+    for (unsigned i = 0; i < value.getNumWords(); ++i)
+      writeU64(os, value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read:
+    writeU32(os, array);
+    writeU32(os, head);
+    writeU32(os, kids[0]);
+    break;
+  case Expr::Extract:
+    writeU32(os, kids[0]);
+    writeU32(os, cast<ExtractExpr>(e)->offset);
+    writeU32(os, e->getWidth());
+    break;
+  case Expr::ZExt:
+  case Expr::SExt:
+    writeU32(os, kids[0]);
+    writeU32(os, e->getWidth());
+    break;
+  default:
+    for (unsigned i = 0; i < kids.size(); ++i)
+      writeU32(os, kids[i]);
+    break;
+  }
+  os.flush();
+
+  ++numNodes;
+  uint32_t id = numExprs++;
+  exprIds[e] = id;
+  return id;
+}
+
+void ExprBinaryWriter::write(llvm::raw_ostream &os) const {
+  os.write(Magic, sizeof(Magic));
+  writeU32(os, Version);
+  writeU32(os, numArrays);
+  os << arrayTable;
+  writeU32(os, numNodes);
+  os << nodeTable;
+}
+
+/***/
+
+ExprBinaryReader::ExprBinaryReader(const char *begin, const char *_end,
+                                   ExprBuilder *_builder,
+                                   ArrayCache *_arrayCache)
+  : pos(begin), end(_end), failed(false), builder(_builder),
+    arrayCache(_arrayCache) {}
+
+bool ExprBinaryReader::isExprBinary(const char *begin, const char *end) {
+  return end - begin >= (ptrdiff_t) sizeof(Magic) &&
+         !memcmp(begin, Magic, sizeof(Magic));
+}
+
+bool ExprBinaryReader::readU8(uint8_t &v) {
+  if (failed || end - pos < 1)
+    return fail();
+  v = (uint8_t) *pos++;
+  return true;
+}
+
+bool ExprBinaryReader::readU32(uint32_t &v) {
+  if (failed || end - pos < 4)
+    return fail();
+  v = 0;
+  for (unsigned i = 0; i < 4; ++i)
+    v |= (uint32_t) (uint8_t) pos[i] << (8 * i);
+  pos += 4;
+  return true;
+}
+
+bool ExprBinaryReader::readU64(uint64_t &v) {
+  if (failed || end - pos < 8)
+    return fail();
+  v = 0;
+  for (unsigned i = 0; i < 8; ++i)
+    v |= (uint64_t) (uint8_t) pos[i] << (8 * i);
+  pos += 8;
+  return true;
+}
+
+bool ExprBinaryReader::readString(std::string &s) {
+  uint32_t size;
+  if (!readU32(size))
+    return false;
+  if ((uint64_t) (end - pos) < size)
+    return fail();
+  s.assign(pos, size);
+  pos += size;
+  return true;
+}
+
+bool ExprBinaryReader::readExpr(ref<Expr> &e) {
+  uint32_t id;
+  if (!readU32(id))
+    return false;
+  if (id == ExprBinaryWriter::NoId) {
+    e = ref<Expr>();
+    return true;
+  }
+  if (id >= exprs.size())
+    return fail();
+  e = exprs[id];
+  return true;
+}
+
+bool ExprBinaryReader::readKid(ref<Expr> &e) {
+  return readExpr(e) && (!e.isNull() || fail());
+}
+
+bool ExprBinaryReader::readArray() {
+  std::string name;
+  uint32_t size, domain, range, numValues;
+  if (!readString(name) || !readU32(size) || !readU32(domain) ||
+      !readU32(range) || !readU32(numValues))
+    return false;
+
+  std::vector<ref<ConstantExpr> > values;
+  for (uint32_t i = 0; i < numValues; ++i) {
+    uint64_t value;
+    if (!readU64(value))
+      return false;
+    values.push_back(ConstantExpr::create(value, range));
+  }
+
+  if (values.empty())
+    arrays.push_back(arrayCache->CreateArray(name, size, 0, 0, domain, range));
+  else
+    arrays.push_back(arrayCache->CreateArray(name, size, &values[0],
+                                             &values[0] + values.size(),
+                                             domain, range));
+  return true;
+}
+
+bool ExprBinaryReader::readNode() {
+  uint8_t tag;
+  if (!readU8(tag))
+    return false;
+
+  if (tag == UpdateTag) {
+    uint32_t next;
+    ref<Expr> index, value;
+    if (!readU32(next) || !readKid(index) || !readKid(value))
+      return false;
+    if (next != ExprBinaryWriter::NoId && next >= updates.size())
+      return fail();
+    UpdateList ul(0, next == ExprBinaryWriter::NoId ? 0 : updates[next].head);
+    ul.extend(index, value);
+    updates.push_back(ul);
+    return true;
+  }
+
+  if (tag > Expr::LastKind)
+    return fail();
+
+  ref<Expr> kids[3];
+  ref<Expr> e;
+  switch ((Expr::Kind) tag) {
+  case Expr::Constant: {
+    uint32_t width;
+    if (!readU32(width) || !width)
+      return fail();
+    std::vector<uint64_t> words((width + 63) / 64);
+    for (unsigned i = 0; i < words.size(); ++i)
+      if (!readU64(words[i]))
+        return false;
+    e = builder->Constant(llvm::APInt(width, llvm::ArrayRef<uint64_t>(words)));
+    break;
+  }
+  case Expr::NotOptimized:
+    if (!readKid(kids[0]))
+      return false;
+    e = builder->NotOptimized(kids[0]);
+    break;
+  case Expr::Read: {
+    uint32_t array, head;
+    if (!readU32(array) || !readU32(head) || !readKid(kids[0]))
+      return false;
+    if (array >= arrays.size() ||
+        (head != ExprBinaryWriter::NoId && head >= updates.size()))
+      return fail();
+    UpdateList ul(arrays[array],
+                  head == ExprBinaryWriter::NoId ? 0 : updates[head].head);
+    e = builder->Read(ul, kids[0]);
+    break;
+  }
+  case Expr::Select:
+    if (!readKid(kids[0]) || !readKid(kids[1]) || !readKid(kids[2]))
+      return false;
+    e = builder->Select(kids[0], kids[1], kids[2]);
+    break;
+  case Expr::Extract: {
+    uint32_t offset, width;
+    if (!readKid(kids[0]) || !readU32(offset) || !readU32(width))
+      return false;
+    e = builder->Extract(kids[0], offset, width);
+    break;
+  }
+  case Expr::ZExt:
+  case Expr::SExt: {
+    uint32_t width;
+    if (!readKid(kids[0]) || !readU32(width))
+      return false;
+    e = tag == Expr::ZExt ? builder->ZExt(kids[0], width)
+                          : builder->SExt(kids[0], width);
+    break;
+  }
+  case Expr::Not:
+    if (!readKid(kids[0]))
+      return false;
+    e = builder->Not(kids[0]);
+    break;
+  default: {
+    if (!readKid(kids[0]) || !readKid(kids[1]))
+      return false;
+    switch ((Expr::Kind) tag) {
+    case Expr::Concat: e = builder->Concat(kids[0], kids[1]); break;
+    case Expr::Add: e = builder->Add(kids[0], kids[1]); break;
+    case Expr::Sub: e = builder->Sub(kids[0], kids[1]); break;
+    case Expr::Mul: e = builder->Mul(kids[0], kids[1]); break;
+    case Expr::UDiv: e = builder->UDiv(kids[0], kids[1]); break;
+    case Expr::SDiv: e = builder->SDiv(kids[0], kids[1]); break;
+    case Expr::URem: e = builder->URem(kids[0], kids[1]); break;
+    case Expr::SRem: e = builder->SRem(kids[0], kids[1]); break;
+    case Expr::And: e = builder->And(kids[0], kids[1]); break;
+    case Expr::Or: e = builder->Or(kids[0], kids[1]); break;
+    case Expr::Xor: e = builder->Xor(kids[0], kids[1]); break;
+    case Expr::Shl: e = builder->Shl(kids[0], kids[1]); break;
+    case Expr::LShr: e = builder->LShr(kids[0], kids[1]); break;
+    case Expr::AShr: e = builder->AShr(kids[0], kids[1]); break;
+    case Expr::Eq: e = builder->Eq(kids[0], kids[1]); break;
+    case Expr::Ne: e = builder->Ne(kids[0], kids[1]); break;
+    case Expr::Ult: e = builder->Ult(kids[0], kids[1]); break;
+    case Expr::Ule: e = builder->Ule(kids[0], kids[1]); break;
+    case Expr::Ugt: e = builder->Ugt(kids[0], kids[1]); break;
+    case Expr::Uge: e = builder->Uge(kids[0], kids[1]); break;
+    case Expr::Slt: e = builder->Slt(kids[0], kids[1]); break;
+    case Expr::Sle: e = builder->Sle(kids[0], kids[1]); break;
+    case Expr::Sgt: e = builder->Sgt(kids[0], kids[1]); break;
+    case Expr::Sge: e = builder->Sge(kids[0], kids[1]); break;
+    default:
+      return fail();
+    }
+    break;
+  }
+  }
+
+  exprs.push_back(e);
+  return true;
+}
+
+bool ExprBinaryReader::readTables() {
+  if (!isExprBinary(pos, end))
+    return fail();
+  pos += sizeof(Magic);
+
+  uint32_t version, numArrays, numNodes;
+  if (!readU32(version))
+    return false;
+  if (version != Version)
+    return fail();
+
+  if (!readU32(numArrays))
+    return false;
+  for (uint32_t i = 0; i < numArrays; ++i)
+    if (!readArray())
+      return false;
+
+  if (!readU32(numNodes))
+    return false;
+  for (uint32_t i = 0; i < numNodes; ++i)
+    if (!readNode())
+      return false;
+
+  return true;
+}
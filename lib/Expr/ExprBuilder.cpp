@@ -8,6 +8,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/ExprBuilder.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <algorithm>
 
 using namespace klee;
 
@@ -1052,6 +1055,193 @@ namespace {
 
   typedef ConstantSpecializedExprBuilder<SimplifyingBuilder>
     SimplifyingExprBuilder;
+
+  /// HashConsingExprBuilder - Expression builder which keeps a unique table of
+  /// every expression it returned, so that structurally equal expressions
+  /// built through it are the same object. Equal subtrees are then shared
+  /// between all their users and Expr::compare() returns on the first
+  /// pointer-equal kid instead of walking both trees.
+  ///
+  /// The table holds a reference to each expression; entries nobody else
+  /// refers to any more are swept whenever the table has doubled in size.
+  class HashConsingExprBuilder : public ExprBuilder {
+    ExprBuilder *Base;
+    ExprHashSet Table;
+    size_t SweepThreshold;
+
+    void sweep() {
+      // Dropping an expression may leave its kids unreferenced, so repeat
+      // until nothing else can go.
+      size_t Before;
+      do {
+        Before = Table.size();
+        for (ExprHashSet::iterator it = Table.begin(), ie = Table.end();
+             it != ie;) {
+          if ((*it)->refCount == 1)
+            it = Table.erase(it);
+          else
+            ++it;
+        }
+      } while (Table.size() != Before);
+    }
+
+    ref<Expr> unique(const ref<Expr> &E) {
+      ExprHashSet::iterator it = Table.find(E);
+      if (it != Table.end())
+        return *it;
+
+      // Register the kids as well: builders further down the chain may have
+      // created new subexpressions the caller never saw.
+      for (unsigned i = 0, e = E->getNumKids(); i != e; ++i)
+        unique(E->getKid(i));
+
+      Table.insert(E);
+      if (Table.size() >= SweepThreshold) {
+        sweep();
+        SweepThreshold = std::max(SweepThreshold, 2 * Table.size());
+      }
+      return E;
+    }
+
+  public:
+    HashConsingExprBuilder(ExprBuilder *_Base)
+      : Base(_Base), SweepThreshold(1 << 16) {}
+    ~HashConsingExprBuilder() {
+      Table.clear();
+      delete Base;
+    }
+
+    virtual ref<Expr> Constant(const llvm::APInt &Value) {
+      return unique(Base->Constant(Value));
+    }
+
+    virtual ref<Expr> NotOptimized(const ref<Expr> &Index) {
+      return unique(Base->NotOptimized(Index));
+    }
+
+    virtual ref<Expr> Read(const UpdateList &Updates,
+                           const ref<Expr> &Index) {
+      return unique(Base->Read(Updates, Index));
+    }
+
+    virtual ref<Expr> Select(const ref<Expr> &Cond,
+                             const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Select(Cond, LHS, RHS));
+    }
+
+    virtual ref<Expr> Concat(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Concat(LHS, RHS));
+    }
+
+    virtual ref<Expr> Extract(const ref<Expr> &LHS,
+                              unsigned Offset, Expr::Width W) {
+      return unique(Base->Extract(LHS, Offset, W));
+    }
+
+    virtual ref<Expr> ZExt(const ref<Expr> &LHS, Expr::Width W) {
+      return unique(Base->ZExt(LHS, W));
+    }
+
+    virtual ref<Expr> SExt(const ref<Expr> &LHS, Expr::Width W) {
+      return unique(Base->SExt(LHS, W));
+    }
+
+    virtual ref<Expr> Not(const ref<Expr> &LHS) {
+      return unique(Base->Not(LHS));
+    }
+
+    virtual ref<Expr> Add(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Add(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sub(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Sub(LHS, RHS));
+    }
+
+    virtual ref<Expr> Mul(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Mul(LHS, RHS));
+    }
+
+    virtual ref<Expr> UDiv(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->UDiv(LHS, RHS));
+    }
+
+    virtual ref<Expr> SDiv(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->SDiv(LHS, RHS));
+    }
+
+    virtual ref<Expr> URem(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->URem(LHS, RHS));
+    }
+
+    virtual ref<Expr> SRem(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->SRem(LHS, RHS));
+    }
+
+    virtual ref<Expr> And(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->And(LHS, RHS));
+    }
+
+    virtual ref<Expr> Or(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Or(LHS, RHS));
+    }
+
+    virtual ref<Expr> Xor(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Xor(LHS, RHS));
+    }
+
+    virtual ref<Expr> Shl(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Shl(LHS, RHS));
+    }
+
+    virtual ref<Expr> LShr(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->LShr(LHS, RHS));
+    }
+
+    virtual ref<Expr> AShr(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->AShr(LHS, RHS));
+    }
+
+    virtual ref<Expr> Eq(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Eq(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ne(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Ne(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ult(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Ult(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ule(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Ule(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ugt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Ugt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Uge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Uge(LHS, RHS));
+    }
+
+    virtual ref<Expr> Slt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Slt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sle(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Sle(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sgt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Sgt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return unique(Base->Sge(LHS, RHS));
+    }
+  };
 }
 
 ExprBuilder *klee::createDefaultExprBuilder() {
@@ -1065,3 +1255,7 @@ ExprBuilder *klee::createConstantFoldingExprBuilder(ExprBuilder *Base) {
 ExprBuilder *klee::createSimplifyingExprBuilder(ExprBuilder *Base) {
   return new SimplifyingExprBuilder(Base);
 }
+
+ExprBuilder *klee::createHashConsingExprBuilder(ExprBuilder *Base) {
+  return new HashConsingExprBuilder(Base);
+}
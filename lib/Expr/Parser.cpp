@@ -110,7 +110,8 @@ namespace {
     const std::string Filename;
     const MemoryBuffer *TheMemoryBuffer;
     ExprBuilder *Builder;
-    ArrayCache TheArrayCache;
+    ArrayCache OwnArrayCache;
+    ArrayCache *TheArrayCache;
     bool ClearArrayAfterQuery;
 
     Lexer TheLexer;
@@ -324,8 +325,10 @@ namespace {
 
   public:
     ParserImpl(const std::string _Filename, const MemoryBuffer *MB,
-               ExprBuilder *_Builder, bool _ClearArrayAfterQuery)
+               ExprBuilder *_Builder, ArrayCache *_ArrayCache,
+               bool _ClearArrayAfterQuery)
         : Filename(_Filename), TheMemoryBuffer(MB), Builder(_Builder),
+          TheArrayCache(_ArrayCache ? _ArrayCache : &OwnArrayCache),
           ClearArrayAfterQuery(_ClearArrayAfterQuery), TheLexer(MB),
           MaxErrors(~0u), NumErrors(0) {}
 
@@ -523,10 +526,10 @@ DeclResult ParserImpl::ParseArrayDecl() {
   const Identifier *Label = GetOrCreateIdentifier(Name);
   const Array *Root;
   if (!Values.empty())
-    Root = TheArrayCache.CreateArray(Label->Name, Size.get(), &Values[0],
+    Root = TheArrayCache->CreateArray(Label->Name, Size.get(), &Values[0],
                                      &Values[0] + Values.size());
   else
-    Root = TheArrayCache.CreateArray(Label->Name, Size.get());
+    Root = TheArrayCache->CreateArray(Label->Name, Size.get());
   ArrayDecl *AD = new ArrayDecl(Label, Size.get(), 
                                 DomainType.get(), RangeType.get(), Root);
 
@@ -1316,7 +1319,7 @@ VersionResult ParserImpl::ParseVersionSpecifier() {
   if (!Res.isValid()) {
     // FIXME: I'm not sure if this is right. Do we need a unique array here?
     Res =
-        VersionResult(true, UpdateList(TheArrayCache.CreateArray("", 0), NULL));
+        VersionResult(true, UpdateList(TheArrayCache->CreateArray("", 0), NULL));
   }
   
   if (Label)
@@ -1647,7 +1650,14 @@ Parser::~Parser() {
 
 Parser *Parser::Create(const std::string Filename, const MemoryBuffer *MB,
                        ExprBuilder *Builder, bool ClearArrayAfterQuery) {
-  ParserImpl *P = new ParserImpl(Filename, MB, Builder, ClearArrayAfterQuery);
+  return Create(Filename, MB, Builder, 0, ClearArrayAfterQuery);
+}
+
+Parser *Parser::Create(const std::string Filename, const MemoryBuffer *MB,
+                       ExprBuilder *Builder, ArrayCache *TheArrayCache,
+                       bool ClearArrayAfterQuery) {
+  ParserImpl *P = new ParserImpl(Filename, MB, Builder, TheArrayCache,
+                                 ClearArrayAfterQuery);
   P->Initialize();
   return P;
 }
@@ -13,19 +13,11 @@
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/IncompleteSolver.h"
+#include "klee/SharedQueryCache.h"
 #include "klee/SolverImpl.h"
 
 #include "klee/SolverStats.h"
 
-#include <ciso646>
-#ifdef _LIBCPP_VERSION
-#include <unordered_map>
-#define unordered_map std::unordered_map
-#else
-#include <tr1/unordered_map>
-#define unordered_map std::tr1::unordered_map
-#endif
-
 using namespace klee;
 
 class CachingSolver : public SolverImpl {
@@ -39,43 +31,21 @@ private:
   bool cacheLookup(const Query& query,
                    IncompleteSolver::PartialValidity &result);
   
-  struct CacheEntry {
-    CacheEntry(const ConstraintManager &c, ref<Expr> q)
-      : constraints(c), query(q) {}
-
-    CacheEntry(const CacheEntry &ce)
-      : constraints(ce.constraints), query(ce.query) {}
-    
-    ConstraintManager constraints;
-    ref<Expr> query;
-
-    bool operator==(const CacheEntry &b) const {
-      return constraints==b.constraints && *query.get()==*b.query.get();
-    }
-  };
-  
-  struct CacheEntryHash {
-    unsigned operator()(const CacheEntry &ce) const {
-      unsigned result = ce.query->hash();
-      
-      for (ConstraintManager::constraint_iterator it = ce.constraints.begin();
-           it != ce.constraints.end(); ++it)
-        result ^= (*it)->hash();
-      
-      return result;
-    }
-  };
-
-  typedef unordered_map<CacheEntry, 
-                        IncompleteSolver::PartialValidity, 
-                        CacheEntryHash> cache_map;
-  
   Solver *solver;
-  cache_map cache;
+  SharedQueryCache *cache;
+  // whether cache is private to this solver
+  bool ownsCache;
 
 public:
-  CachingSolver(Solver *s) : solver(s) {}
-  ~CachingSolver() { cache.clear(); delete solver; }
+  CachingSolver(Solver *s)
+    : solver(s), cache(new SharedQueryCache(1)), ownsCache(true) {}
+  CachingSolver(Solver *s, SharedQueryCache *_cache)
+    : solver(s), cache(_cache), ownsCache(false) {}
+  ~CachingSolver() {
+    if (ownsCache)
+      delete cache;
+    delete solver;
+  }
 
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeTruth(const Query&, bool &isValid);
@@ -120,13 +90,11 @@ bool CachingSolver::cacheLookup(const Query& query,
   bool negationUsed;
   ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
 
-  CacheEntry ce(query.constraints, canonicalQuery);
-  cache_map::iterator it = cache.find(ce);
-  
-  if (it != cache.end()) {
+  IncompleteSolver::PartialValidity cachedResult;
+  if (cache->lookup(query.constraints, canonicalQuery, cachedResult)) {
     result = (negationUsed ?
-              IncompleteSolver::negatePartialValidity(it->second) :
-              it->second);
+              IncompleteSolver::negatePartialValidity(cachedResult) :
+              cachedResult);
     return true;
   }
   
@@ -139,11 +107,10 @@ void CachingSolver::cacheInsert(const Query& query,
   bool negationUsed;
   ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
 
-  CacheEntry ce(query.constraints, canonicalQuery);
   IncompleteSolver::PartialValidity cachedResult = 
     (negationUsed ? IncompleteSolver::negatePartialValidity(result) : result);
   
-  cache.insert(std::make_pair(ce, cachedResult));
+  cache->insert(query.constraints, canonicalQuery, cachedResult);
 }
 
 bool CachingSolver::computeValidity(const Query& query,
@@ -266,3 +233,7 @@ void CachingSolver::setCoreSolverTimeout(double timeout) {
 Solver *klee::createCachingSolver(Solver *_solver) {
   return new Solver(new CachingSolver(_solver));
 }
+
+Solver *klee::createCachingSolver(Solver *_solver, SharedQueryCache *cache) {
+  return new Solver(new CachingSolver(_solver, cache));
+}
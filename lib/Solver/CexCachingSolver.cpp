@@ -7,16 +7,15 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include "klee/Solver.h"
+#include "CexCachingSolver.h"
 
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
-#include "klee/SolverImpl.h"
 #include "klee/TimerStatIncrementer.h"
 #include "klee/util/Assignment.h"
+#include "klee/util/CompiledExpr.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
-#include "klee/Internal/ADT/MapOfSets.h"
 
 #include "klee/SolverStats.h"
 
@@ -24,6 +23,8 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+
 using namespace klee;
 using namespace llvm;
 
@@ -44,75 +45,231 @@ namespace {
   cl::opt<bool>
   CexCacheExperimental("cex-cache-exp", cl::init(false));
 
+  cl::opt<unsigned>
+  CexCacheSize("cex-cache-size",
+               cl::desc("Maximum number of queries kept in the counterexample cache, evicting the least recently used (0=unbounded, default=65536)"),
+               cl::init(65536));
+
 }
 
 ///
 
-typedef std::set< ref<Expr> > KeyType;
+struct CexCachingSolver::LargerEntry {
+  const std::deque<CacheEntry> &entries;
+
+  LargerEntry(const std::deque<CacheEntry> &_entries) : entries(_entries) {}
 
-struct AssignmentLessThan {
-  bool operator()(const Assignment *a, const Assignment *b) {
-    return a->bindings < b->bindings;
+  bool operator()(unsigned a, unsigned b) const {
+    return entries[a].ids.size() > entries[b].ids.size();
   }
 };
 
+bool CexCachingSolver::AssignmentLessThan::operator()(const Assignment *a,
+                                                      const Assignment *b)
+  const {
+  return a->bindings < b->bindings;
+}
 
-class CexCachingSolver : public SolverImpl {
-  typedef std::set<Assignment*, AssignmentLessThan> assignmentsTable_ty;
+CexCachingSolver::CexCachingSolver(Solver *_solver, unsigned _maxEntries)
+  : solver(_solver), maxEntries(_maxEntries), emptyEntry(NoEntry),
+    mru(NoEntry), lru(NoEntry) {}
 
-  Solver *solver;
-  
-  MapOfSets<ref<Expr>, Assignment*> cache;
-  // memo table
-  assignmentsTable_ty assignmentsTable;
+CexCachingSolver::~CexCachingSolver() {
+  delete solver;
+  for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
+         ie = assignmentsTable.end(); it != ie; ++it)
+    delete it->first;
+  for (std::vector<CachedConstraint>::iterator it = constraints.begin(),
+         ie = constraints.end(); it != ie; ++it)
+    delete it->compiled;
+}
 
-  bool searchForAssignment(KeyType &key, 
-                           Assignment *&result);
-  
-  bool lookupAssignment(const Query& query, KeyType &key, Assignment *&result);
+/// acquireKey - Build the key of \arg query, taking a use of each of its
+/// constraints. Every acquired key is either inserted or released.
+void CexCachingSolver::acquireKey(const Query &query, KeyType &key) {
+  std::vector< ref<Expr> > exprs(query.constraints.begin(),
+                                 query.constraints.end());
+  ref<Expr> neg = Expr::createIsZero(query.expr);
+  if (!isa<ConstantExpr>(neg))
+    exprs.push_back(neg);
+
+  key.ids.clear();
+  key.ids.reserve(exprs.size());
+  for (std::vector< ref<Expr> >::iterator it = exprs.begin(),
+         ie = exprs.end(); it != ie; ++it) {
+    std::pair<ExprHashMap<unsigned>::iterator, bool> res =
+      constraintIds.insert(std::make_pair(*it, 0u));
+    if (res.second) {
+      if (freeIds.empty()) {
+        res.first->second = constraints.size();
+        constraints.push_back(CachedConstraint());
+        postings.push_back(std::vector<unsigned>());
+      } else {
+        res.first->second = freeIds.back();
+        freeIds.pop_back();
+      }
+      CachedConstraint &c = constraints[res.first->second];
+      c.expr = *it;
+      c.uses = 0;
+      c.compileTried = false;
+      c.compiled = 0;
+    }
+    key.ids.push_back(res.first->second);
+  }
 
-  bool lookupAssignment(const Query& query, Assignment *&result) {
-    KeyType key;
-    return lookupAssignment(query, key, result);
+  std::sort(key.ids.begin(), key.ids.end());
+  key.ids.erase(std::unique(key.ids.begin(), key.ids.end()), key.ids.end());
+  for (std::vector<unsigned>::iterator it = key.ids.begin(),
+         ie = key.ids.end(); it != ie; ++it)
+    ++constraints[*it].uses;
+}
+
+void CexCachingSolver::releaseKey(const KeyType &key) {
+  for (std::vector<unsigned>::const_iterator it = key.ids.begin(),
+         ie = key.ids.end(); it != ie; ++it) {
+    CachedConstraint &c = constraints[*it];
+    assert(c.uses && "releasing an unused constraint");
+    if (--c.uses)
+      continue;
+    assert(postings[*it].empty() && "freeing an indexed constraint");
+    constraintIds.erase(c.expr);
+    c.expr = ref<Expr>();
+    delete c.compiled;
+    c.compiled = 0;
+    freeIds.push_back(*it);
   }
+}
 
-  bool getAssignment(const Query& query, Assignment *&result);
-  
-public:
-  CexCachingSolver(Solver *_solver) : solver(_solver) {}
-  ~CexCachingSolver();
-  
-  bool computeTruth(const Query&, bool &isValid);
-  bool computeValidity(const Query&, Solver::Validity &result);
-  bool computeValue(const Query&, ref<Expr> &result);
-  bool computeInitialValues(const Query&,
-                            const std::vector<const Array*> &objects,
-                            std::vector< std::vector<unsigned char> > &values,
-                            bool &hasSolution);
-  SolverRunStatus getOperationStatusCode();
-  char *getConstraintLog(const Query& query);
-  void setCoreSolverTimeout(double timeout);
-};
+void CexCachingSolver::unlink(unsigned entry) {
+  CacheEntry &e = entries[entry];
+  if (e.prev == NoEntry)
+    mru = e.next;
+  else
+    entries[e.prev].next = e.next;
+  if (e.next == NoEntry)
+    lru = e.prev;
+  else
+    entries[e.next].prev = e.prev;
+}
 
-///
+void CexCachingSolver::touch(unsigned entry) {
+  if (entry == mru)
+    return;
+  unlink(entry);
+  CacheEntry &e = entries[entry];
+  e.prev = NoEntry;
+  e.next = mru;
+  entries[mru].prev = entry;
+  mru = entry;
+}
 
-struct NullAssignment {
-  bool operator()(Assignment *a) const { return !a; }
-};
+void CexCachingSolver::insert(KeyType &key, Assignment *binding) {
+  unsigned entry;
+  if (freeEntries.empty()) {
+    entry = entries.size();
+    entries.push_back(CacheEntry());
+    hits.push_back(0);
+  } else {
+    entry = freeEntries.back();
+    freeEntries.pop_back();
+  }
 
-struct NonNullAssignment {
-  bool operator()(Assignment *a) const { return a!=0; }
-};
+  CacheEntry &e = entries[entry];
+  e.ids.swap(key.ids);
+  e.binding = binding;
+  bool inserted = exact.insert(std::make_pair(&e.ids, entry)).second;
+  assert(inserted && "inserting a query that is already cached");
+  (void) inserted;
+
+  for (std::vector<unsigned>::iterator it = e.ids.begin(),
+         ie = e.ids.end(); it != ie; ++it)
+    postings[*it].push_back(entry);
+  if (e.ids.empty())
+    emptyEntry = entry;
+  if (binding)
+    ++assignmentsTable[binding];
+
+  e.prev = NoEntry;
+  e.next = mru;
+  if (mru != NoEntry)
+    entries[mru].prev = entry;
+  mru = entry;
+  if (lru == NoEntry)
+    lru = entry;
+
+  if (maxEntries)
+    while (exact.size() > maxEntries)
+      evict(lru);
+}
 
-struct NullOrSatisfyingAssignment {
-  KeyType &key;
-  
-  NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
+void CexCachingSolver::evict(unsigned entry) {
+  CacheEntry &e = entries[entry];
+  if (Assignment *binding = e.binding) {
+    assignmentsTable_ty::iterator at = assignmentsTable.find(binding);
+    assert(at != assignmentsTable.end() && at->first == binding);
+    if (!--at->second) {
+      assignmentsTable.erase(at);
+      delete binding;
+    }
+  }
 
-  bool operator()(Assignment *a) const { 
-    return !a || a->satisfies(key.begin(), key.end()); 
+  for (std::vector<unsigned>::iterator it = e.ids.begin(),
+         ie = e.ids.end(); it != ie; ++it) {
+    std::vector<unsigned> &posting = postings[*it];
+    std::vector<unsigned>::iterator pos =
+      std::find(posting.begin(), posting.end(), entry);
+    assert(pos != posting.end() && "entry missing from the index");
+    *pos = posting.back();
+    posting.pop_back();
   }
-};
+  if (entry == emptyEntry)
+    emptyEntry = NoEntry;
+
+  unlink(entry);
+  exact.erase(&e.ids);
+
+  KeyType key;
+  key.ids.swap(e.ids);
+  releaseKey(key);
+  freeEntries.push_back(entry);
+}
+
+/// satisfies - Check whether \arg a satisfies the constraints \arg ids, except
+/// for those in \arg known (sorted), which it is already known to satisfy.
+bool CexCachingSolver::satisfies(Assignment *a,
+                                 const std::vector<unsigned> &ids,
+                                 const std::vector<unsigned> *known) {
+  std::vector<unsigned>::const_iterator ki, ke;
+  if (known) {
+    ki = known->begin();
+    ke = known->end();
+  }
+
+  for (std::vector<unsigned>::const_iterator it = ids.begin(),
+         ie = ids.end(); it != ie; ++it) {
+    if (known) {
+      while (ki != ke && *ki < *it)
+        ++ki;
+      if (ki != ke && *ki == *it)
+        continue;
+    }
+
+    CachedConstraint &c = constraints[*it];
+    if (!c.compileTried) {
+      c.compileTried = true;
+      c.compiled = CompiledExpr::compile(c.expr);
+    }
+
+    uint64_t value;
+    if (c.compiled && c.compiled->evaluate(*a, value)) {
+      if (value != 1)
+        return false;
+    } else if (!a->evaluate(c.expr)->isTrue()) {
+      return false;
+    }
+  }
+  return true;
+}
 
 /// searchForAssignment - Look for a cached solution for a query.
 ///
@@ -122,61 +279,95 @@ struct NullOrSatisfyingAssignment {
 /// unsatisfiable query).
 /// \return - True if a cached result was found.
 bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
-  Assignment * const *lookup = cache.lookup(key);
-  if (lookup) {
-    result = *lookup;
+  std::map<const std::vector<unsigned>*, unsigned, IdsLessThan>::iterator
+    lookup = exact.find(&key.ids);
+  if (lookup != exact.end()) {
+    touch(lookup->second);
+    result = entries[lookup->second].binding;
     return true;
   }
 
-  if (CexCacheTryAll) {
-    // Look for a satisfying assignment for a superset, which is trivially an
-    // assignment for any subset.
-    Assignment **lookup = 0;
-    if (CexCacheSuperSet)
-      lookup = cache.findSuperset(key, NonNullAssignment());
-
-    // Otherwise, look for a subset which is unsatisfiable, see below.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullAssignment());
+  // Look for a satisfying assignment for a superset, which is trivially an
+  // assignment for any subset. Every superset mentions the least used
+  // constraint of the query, so only its posting list needs checking.
+  if (CexCacheSuperSet && !key.ids.empty()) {
+    const std::vector<unsigned> *candidates = &postings[key.ids[0]];
+    for (std::vector<unsigned>::iterator it = key.ids.begin() + 1,
+           ie = key.ids.end(); it != ie; ++it)
+      if (postings[*it].size() < candidates->size())
+        candidates = &postings[*it];
+
+    for (std::vector<unsigned>::const_iterator it = candidates->begin(),
+           ie = candidates->end(); it != ie; ++it) {
+      const CacheEntry &e = entries[*it];
+      if (e.binding && e.ids.size() > key.ids.size() &&
+          std::includes(e.ids.begin(), e.ids.end(),
+                        key.ids.begin(), key.ids.end())) {
+        result = e.binding;
+        touch(*it);
+        return true;
+      }
+    }
+  }
 
-    // If either lookup succeeded, then we have a cached solution.
-    if (lookup) {
-      result = *lookup;
+  // Otherwise, look for a subset which is unsatisfiable -- if the subset is
+  // unsatisfiable then no additional constraints can produce a valid
+  // assignment. An entry is a subset of the query when every one of its
+  // constraints is hit by the posting lists of the query's constraints.
+  std::vector<unsigned> subsets, touched;
+  if (emptyEntry != NoEntry)
+    subsets.push_back(emptyEntry);
+  for (std::vector<unsigned>::iterator it = key.ids.begin(),
+         ie = key.ids.end(); it != ie; ++it) {
+    const std::vector<unsigned> &posting = postings[*it];
+    for (std::vector<unsigned>::const_iterator pi = posting.begin(),
+           pe = posting.end(); pi != pe; ++pi) {
+      if (!hits[*pi]++)
+        touched.push_back(*pi);
+      if (hits[*pi] == entries[*pi].ids.size())
+        subsets.push_back(*pi);
+    }
+  }
+  for (std::vector<unsigned>::iterator it = touched.begin(),
+         ie = touched.end(); it != ie; ++it)
+    hits[*it] = 0;
+
+  for (std::vector<unsigned>::iterator it = subsets.begin(),
+         ie = subsets.end(); it != ie; ++it) {
+    if (!entries[*it].binding) {
+      result = 0;
+      touch(*it);
       return true;
     }
+  }
 
+  if (!CexCacheTryAll) {
+    // While searching subsets, we also check the solutions for satisfiable
+    // subsets to see if they solve the current query and return them if so.
+    // They already satisfy the constraints of the subset, so only the rest
+    // of the query needs evaluating. This is cheap and frequently succeeds,
+    // the more so for the larger subsets, which are tried first.
+    std::sort(subsets.begin(), subsets.end(), LargerEntry(entries));
+    for (std::vector<unsigned>::iterator it = subsets.begin(),
+           ie = subsets.end(); it != ie; ++it) {
+      const CacheEntry &e = entries[*it];
+      if (satisfies(e.binding, key.ids, &e.ids)) {
+        result = e.binding;
+        touch(*it);
+        return true;
+      }
+    }
+  } else {
     // Otherwise, iterate through the set of current assignments to see if one
     // of them satisfies the query.
     for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
            ie = assignmentsTable.end(); it != ie; ++it) {
-      Assignment *a = *it;
-      if (a->satisfies(key.begin(), key.end())) {
+      Assignment *a = it->first;
+      if (satisfies(a, key.ids)) {
         result = a;
         return true;
       }
     }
-  } else {
-    // FIXME: Which order? one is sure to be better.
-
-    // Look for a satisfying assignment for a superset, which is trivially an
-    // assignment for any subset.
-    Assignment **lookup = 0;
-    if (CexCacheSuperSet)
-      lookup = cache.findSuperset(key, NonNullAssignment());
-
-    // Otherwise, look for a subset which is unsatisfiable -- if the subset is
-    // unsatisfiable then no additional constraints can produce a valid
-    // assignment. While searching subsets, we also explicitly the solutions for
-    // satisfiable subsets to see if they solve the current query and return
-    // them if so. This is cheap and frequently succeeds.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
-
-    // If either lookup succeeded, then we have a cached solution.
-    if (lookup) {
-      result = *lookup;
-      return true;
-    }
   }
   
   return false;
@@ -185,7 +376,8 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
 /// lookupAssignment - Lookup a cached result for the given \arg query.
 ///
 /// \param query - The query to lookup.
-/// \param key [out] - On return, the key constructed for the query.
+/// \param key [out] - On return, the key constructed for the query. The
+/// caller must insert or release it.
 /// \param result [out] - The cached result, if the lookup is succesful. This is
 /// either a satisfying assignment (for a satisfiable query), or 0 (for an
 /// unsatisfiable query).
@@ -193,7 +385,7 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
 bool CexCachingSolver::lookupAssignment(const Query &query, 
                                         KeyType &key,
                                         Assignment *&result) {
-  key = KeyType(query.constraints.begin(), query.constraints.end());
+  acquireKey(query, key);
   ref<Expr> neg = Expr::createIsZero(query.expr);
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(neg)) {
     if (CE->isFalse()) {
@@ -201,8 +393,6 @@ bool CexCachingSolver::lookupAssignment(const Query &query,
       ++stats::queryCexCacheHits;
       return true;
     }
-  } else {
-    key.insert(neg);
   }
 
   bool found = searchForAssignment(key, result);
@@ -215,17 +405,27 @@ bool CexCachingSolver::lookupAssignment(const Query &query,
 
 bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   KeyType key;
-  if (lookupAssignment(query, key, result))
+  if (lookupAssignment(query, key, result)) {
+    releaseKey(key);
     return true;
+  }
+
+  std::vector< ref<Expr> > exprs;
+  exprs.reserve(key.ids.size());
+  for (std::vector<unsigned>::iterator it = key.ids.begin(),
+         ie = key.ids.end(); it != ie; ++it)
+    exprs.push_back(constraints[*it].expr);
 
   std::vector<const Array*> objects;
-  findSymbolicObjects(key.begin(), key.end(), objects);
+  findSymbolicObjects(exprs.begin(), exprs.end(), objects);
 
   std::vector< std::vector<unsigned char> > values;
   bool hasSolution;
   if (!solver->impl->computeInitialValues(query, objects, values, 
-                                          hasSolution))
+                                          hasSolution)) {
+    releaseKey(key);
     return false;
+  }
     
   Assignment *binding;
   if (hasSolution) {
@@ -233,14 +433,14 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
 
     // Memoize the result.
     std::pair<assignmentsTable_ty::iterator, bool>
-      res = assignmentsTable.insert(binding);
+      res = assignmentsTable.insert(std::make_pair(binding, 0u));
     if (!res.second) {
       delete binding;
-      binding = *res.first;
+      binding = res.first->first;
     }
     
     if (DebugCexCacheCheckBinding)
-      if (!binding->satisfies(key.begin(), key.end())) {
+      if (!binding->satisfies(exprs.begin(), exprs.end())) {
         query.dump();
         binding->dump();
         klee_error("Generated assignment doesn't match query");
@@ -250,21 +450,13 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   }
   
   result = binding;
-  cache.insert(key, binding);
+  insert(key, binding);
 
   return true;
 }
 
 ///
 
-CexCachingSolver::~CexCachingSolver() {
-  cache.clear();
-  delete solver;
-  for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-         ie = assignmentsTable.end(); it != ie; ++it)
-    delete *it;
-}
-
 bool CexCachingSolver::computeValidity(const Query& query,
                                        Solver::Validity &result) {
   TimerStatIncrementer t(stats::cexCacheTime);
@@ -378,5 +570,5 @@ void CexCachingSolver::setCoreSolverTimeout(double timeout) {
 ///
 
 Solver *klee::createCexCachingSolver(Solver *_solver) {
-  return new Solver(new CexCachingSolver(_solver));
+  return new Solver(new CexCachingSolver(_solver, CexCacheSize));
 }
@@ -0,0 +1,152 @@
+//===-- CexCachingSolver.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CEXCACHINGSOLVER_H
+#define KLEE_CEXCACHINGSOLVER_H
+
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace klee {
+class Assignment;
+class CompiledExpr;
+
+/// CexCachingSolver - Caches the counterexamples (or unsatisfiability) of
+/// queries, seen as sets of constraints, and answers new queries from the
+/// results of their subsets and supersets.
+///
+/// Constraints are numbered, and every cached query is kept as the sorted
+/// numbers of its constraints. An inverted index from each constraint to the
+/// cached queries mentioning it finds subsets by counting, and supersets by
+/// walking the shortest posting list. At most maxEntries queries are kept,
+/// the least recently used one is evicted first.
+class CexCachingSolver : public SolverImpl {
+public:
+  struct KeyType {
+    /// The sorted ids of the constraints, including the negated query
+    /// expression.
+    std::vector<unsigned> ids;
+  };
+
+private:
+  /// A constraint mentioned by some key, with its compiled form.
+  struct CachedConstraint {
+    ref<Expr> expr;
+    /// Number of keys (cached or being looked up) mentioning the constraint.
+    unsigned uses;
+    bool compileTried;
+    CompiledExpr *compiled;
+  };
+
+  struct CacheEntry {
+    std::vector<unsigned> ids;
+    /// The cached result: a satisfying assignment, or null if unsatisfiable.
+    Assignment *binding;
+    /// Neighbours in the recency list, NoEntry at its ends.
+    unsigned prev, next;
+  };
+
+  struct IdsLessThan {
+    bool operator()(const std::vector<unsigned> *a,
+                    const std::vector<unsigned> *b) const {
+      return *a < *b;
+    }
+  };
+
+  struct AssignmentLessThan {
+    bool operator()(const Assignment *a, const Assignment *b) const;
+  };
+
+  struct LargerEntry;
+
+  static const unsigned NoEntry = ~0u;
+
+  /// Unique assignments with the number of cache entries referring to each.
+  typedef std::map<Assignment*, unsigned, AssignmentLessThan>
+    assignmentsTable_ty;
+
+  Solver *solver;
+  unsigned maxEntries;
+
+  ExprHashMap<unsigned> constraintIds;
+  std::vector<CachedConstraint> constraints;
+  std::vector<unsigned> freeIds;
+
+  // Entries do not move, so the exact index can point at their ids.
+  std::deque<CacheEntry> entries;
+  std::vector<unsigned> freeEntries;
+  std::map<const std::vector<unsigned>*, unsigned, IdsLessThan> exact;
+  /// The entries mentioning each constraint id.
+  std::vector< std::vector<unsigned> > postings;
+  /// The entry of the empty key, which is a subset of every key.
+  unsigned emptyEntry;
+  /// The most and least recently used entries.
+  unsigned mru, lru;
+  // Scratch space for counting subset hits, indexed by entry.
+  std::vector<unsigned> hits;
+  // memo table
+  assignmentsTable_ty assignmentsTable;
+
+  void acquireKey(const Query &query, KeyType &key);
+  void releaseKey(const KeyType &key);
+
+  void unlink(unsigned entry);
+  void touch(unsigned entry);
+  void insert(KeyType &key, Assignment *binding);
+  void evict(unsigned entry);
+
+  bool satisfies(Assignment *a, const std::vector<unsigned> &ids,
+                 const std::vector<unsigned> *known = 0);
+
+  bool searchForAssignment(KeyType &key, Assignment *&result);
+
+  bool lookupAssignment(const Query& query, KeyType &key, Assignment *&result);
+
+  bool lookupAssignment(const Query& query, Assignment *&result) {
+    KeyType key;
+    bool found = lookupAssignment(query, key, result);
+    releaseKey(key);
+    return found;
+  }
+
+  bool getAssignment(const Query& query, Assignment *&result);
+
+public:
+  /// \param _maxEntries - The number of queries to keep, 0 for no limit.
+  CexCachingSolver(Solver *_solver, unsigned _maxEntries);
+  ~CexCachingSolver();
+
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeValidity(const Query&, Solver::Validity &result);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query& query);
+  void setCoreSolverTimeout(double timeout);
+
+  /// Number of queries currently cached.
+  unsigned getNumEntries() const { return exact.size(); }
+  /// Number of distinct satisfying assignments currently cached.
+  unsigned getNumAssignments() const { return assignmentsTable.size(); }
+  /// Number of constraints the cached queries mention.
+  unsigned getNumConstraints() const { return constraintIds.size(); }
+  /// Number of constraint ids ever handed out; freed ids are reused.
+  unsigned getNumConstraintIds() const { return constraints.size(); }
+};
+}
+
+#endif
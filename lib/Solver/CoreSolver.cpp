@@ -11,14 +11,76 @@
 #include "Z3Solver.h"
 #include "MetaSMTSolver.h"
 #include "klee/CommandLine.h"
+#include "klee/Expr.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/Solver.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include <string>
+#include <vector>
 
 namespace klee {
 
+static const char *getCoreSolverName(CoreSolverType cst) {
+  switch (cst) {
+  case STP_SOLVER:
+    return "stp";
+  case METASMT_SOLVER:
+    return "metasmt";
+  case DUMMY_SOLVER:
+    return "dummy";
+  case Z3_SOLVER:
+    return "z3";
+  default:
+    return "unknown";
+  }
+}
+
+static Solver *createPortfolioCoreSolver() {
+  std::vector<CoreSolverType> types(PortfolioSolvers.begin(),
+                                    PortfolioSolvers.end());
+  if (types.empty()) {
+#ifdef ENABLE_STP
+    types.push_back(STP_SOLVER);
+#endif
+#ifdef ENABLE_Z3
+    types.push_back(Z3_SOLVER);
+#endif
+#ifdef ENABLE_METASMT
+    types.push_back(METASMT_SOLVER);
+#endif
+  }
+
+  std::vector<Solver *> solvers;
+  std::vector<std::string> names;
+  for (unsigned i = 0; i < types.size(); ++i) {
+    if (Solver *s = createCoreSolver(types[i])) {
+      solvers.push_back(s);
+      names.push_back(getCoreSolverName(types[i]));
+    }
+  }
+
+  if (solvers.empty())
+    return NULL;
+  // The racers are forked, which is not safe while another thread (e.g. the
+  // call path writer of klee) may hold a lock.
+  if (Expr::threadSafe && solvers.size() > 1) {
+    klee_warning("portfolio solver is not available in builds with "
+                 "ENABLE_THREADSAFE_EXPR, using %s alone", names[0].c_str());
+    for (unsigned i = 1; i < solvers.size(); ++i)
+      delete solvers[i];
+    return solvers[0];
+  }
+  if (solvers.size() == 1) {
+    klee_warning("portfolio solver needs at least two backends, using %s "
+                 "alone", names[0].c_str());
+    return solvers[0];
+  }
+  klee_message("Using portfolio of %u solver backends",
+               (unsigned) solvers.size());
+  return createPortfolioSolver(solvers, names);
+}
+
 Solver *createCoreSolver(CoreSolverType cst) {
   switch (cst) {
   case STP_SOLVER:
@@ -47,6 +109,8 @@ Solver *createCoreSolver(CoreSolverType cst) {
     klee_message("Not compiled with Z3 support");
     return NULL;
 #endif
+  case PORTFOLIO_SOLVER:
+    return createPortfolioCoreSolver();
   case NO_SOLVER:
     klee_message("Invalid solver");
     return NULL;
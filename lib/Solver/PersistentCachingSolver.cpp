@@ -0,0 +1,714 @@
+//===-- PersistentCachingSolver.cpp - On-disk validity cache --------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/ADT/StringExtras.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+using namespace klee;
+
+// The cache file is an append-only log:
+//
+//   header:  "KQPC" u32:version u64:reserved
+//   records: { u64:hash1 u64:hash2 u64:value u8:kind u8:result u16:reserved
+//              u32:checksum }*
+//
+// A record maps the hash of a query to its (partial) validity or to a value
+// of its expression. Later records refine earlier ones, so several processes
+// can append to the same file under an flock() and pick up each other's
+// results. Records whose checksum does not match (e.g. the tail of a write
+// that was cut short) are skipped. When the log holds many superseded
+// records it is rewritten into a fresh file that replaces the old one; the
+// other processes notice the replacement and reopen the file.
+
+namespace {
+  const char Magic[4] = { 'K', 'Q', 'P', 'C' };
+  const uint32_t Version = 1;
+  const size_t HeaderSize = 16;
+  const size_t RecordSize = 32;
+
+  enum RecordKind { ValidityRecord = 1, ValueRecord = 2 };
+
+  /// Rewrite the log on exit once it holds this many records and less than
+  /// half of them are still current.
+  const uint64_t MinRecordsToCompact = 1024;
+
+  struct QueryKey {
+    uint64_t hash1, hash2;
+
+    bool operator==(const QueryKey &b) const {
+      return hash1 == b.hash1 && hash2 == b.hash2;
+    }
+  };
+
+  struct QueryKeyHash {
+    size_t operator()(const QueryKey &key) const { return key.hash1; }
+  };
+
+  /// Computes a 128 bit hash of a query which does not depend on the names
+  /// of the arrays it reads: arrays are numbered in the order they are first
+  /// met, so queries that only differ in the naming of their symbolic inputs
+  /// share their cache entries.
+  class QueryHasher {
+    struct Hash {
+      uint64_t h1, h2;
+      Hash() : h1(0x84222325cbf29ce4ULL), h2(0x6c62272e07bb0142ULL) {}
+
+      void add(uint64_t v) {
+        h1 = mix((h1 ^ v) * 0x100000001b3ULL);
+        h2 = mix(h2 * 0x9e3779b97f4a7c15ULL + v + 1);
+      }
+      void add(const Hash &h) {
+        add(h.h1);
+        add(h.h2);
+      }
+
+      static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb3f97ea49c1bULL;
+        x ^= x >> 33;
+        return x;
+      }
+    };
+
+    std::map<const Array *, unsigned> arrayIds;
+    std::unordered_map<const Expr *, Hash> exprHashes;
+    std::unordered_map<const UpdateNode *, Hash> updateHashes;
+
+    void addArray(Hash &h, const Array *array);
+    void addUpdates(Hash &h, const UpdateList &ul);
+    Hash hashExpr(const ref<Expr> &e);
+
+  public:
+    QueryKey hashQuery(const Query &query);
+  };
+
+  class PersistentCachingSolver : public SolverImpl {
+    typedef std::unordered_map<QueryKey, IncompleteSolver::PartialValidity,
+                               QueryKeyHash> validity_map;
+    typedef std::unordered_map<QueryKey, uint64_t, QueryKeyHash> value_map;
+
+    Solver *solver;
+    validity_map validityCache;
+    value_map valueCache;
+
+    std::string path;
+    /// The cache file, -1 once persisting failed.
+    int fd;
+    /// The process that opened fd. Forked children share the open file
+    /// description, and with it the lock, so they open their own.
+    pid_t fdOwner;
+    /// Size of the prefix of the file that has been read.
+    uint64_t consumed;
+    /// Number of records in that prefix.
+    uint64_t numRecords;
+
+    bool openFile();
+    void disable(const char *what);
+    bool lock(int operation);
+    void unlock() { flock(fd, LOCK_UN); }
+    void readNewRecords();
+    void readNewRecordsLocked();
+    void appendRecord(const QueryKey &key, RecordKind kind, uint8_t result,
+                      uint64_t value);
+    void compact();
+
+    void insertRecord(const QueryKey &key, RecordKind kind, uint8_t result,
+                      uint64_t value);
+    bool lookupValidity(const QueryKey &key,
+                        IncompleteSolver::PartialValidity &result);
+    void cacheValidity(const QueryKey &key,
+                       IncompleteSolver::PartialValidity result);
+
+  public:
+    PersistentCachingSolver(Solver *s, const std::string &path);
+    ~PersistentCachingSolver();
+
+    bool computeValidity(const Query &, Solver::Validity &result);
+    bool computeTruth(const Query &, bool &isValid);
+    bool computeValue(const Query &query, ref<Expr> &result);
+    bool computeInitialValues(const Query &query,
+                              const std::vector<const Array *> &objects,
+                              std::vector<std::vector<unsigned char> > &values,
+                              bool &hasSolution) {
+      return solver->impl->computeInitialValues(query, objects, values,
+                                                hasSolution);
+    }
+    SolverRunStatus getOperationStatusCode() {
+      return solver->impl->getOperationStatusCode();
+    }
+    char *getConstraintLog(const Query &query) {
+      return solver->impl->getConstraintLog(query);
+    }
+    void setCoreSolverTimeout(double timeout) {
+      solver->impl->setCoreSolverTimeout(timeout);
+    }
+  };
+}
+
+/***/
+
+void QueryHasher::addArray(Hash &h, const Array *array) {
+  std::pair<std::map<const Array *, unsigned>::iterator, bool> res =
+      arrayIds.insert(std::make_pair(array, arrayIds.size()));
+  h.add(res.first->second);
+  if (!res.second)
+    return;
+
+  // First time around, describe the array itself.
+  h.add(array->size);
+  h.add(array->domain);
+  h.add(array->range);
+  h.add(array->constantValues.size());
+  for (unsigned i = 0; i < array->constantValues.size(); ++i)
+    h.add(array->constantValues[i]->getZExtValue());
+}
+
+void QueryHasher::addUpdates(Hash &h, const UpdateList &ul) {
+  addArray(h, ul.root);
+
+  // Hash the writes oldest first, the list shares its tail with others.
+  std::vector<const UpdateNode *> pending;
+  for (const UpdateNode *un = ul.head; un; un = un->next) {
+    if (updateHashes.count(un))
+      break;
+    pending.push_back(un);
+  }
+  for (std::vector<const UpdateNode *>::reverse_iterator
+           it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+    const UpdateNode *un = *it;
+    Hash uh;
+    if (un->next)
+      uh.add(updateHashes[un->next]);
+    uh.add(hashExpr(un->index));
+    uh.add(hashExpr(un->value));
+    updateHashes[un] = uh;
+  }
+
+  if (ul.head)
+    h.add(updateHashes[ul.head]);
+}
+
+QueryHasher::Hash QueryHasher::hashExpr(const ref<Expr> &e) {
+  std::unordered_map<const Expr *, Hash>::iterator it =
+      exprHashes.find(e.get());
+  if (it != exprHashes.end())
+    return it->second;
+
+  Hash h;
+  h.add(e->getKind());
+  h.add(e->getWidth());
+
+  if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    const llvm::APInt &value = CE->getAPValue();
+    const uint64_t *words = value.getRawData();
+    for (unsigned i = 0; i < value.getNumWords(); ++i)
+      h.add(words[i]);
+  } else if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    addUpdates(h, re->updates);
+    h.add(hashExpr(re->index));
+  } else {
+    if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+      h.add(ee->offset);
+    for (unsigned i = 0; i < e->getNumKids(); ++i)
+      h.add(hashExpr(e->getKid(i)));
+  }
+
+  exprHashes[e.get()] = h;
+  return h;
+}
+
+QueryKey QueryHasher::hashQuery(const Query &query) {
+  Hash h;
+  h.add(query.constraints.size());
+  for (ConstraintManager::constraint_iterator it = query.constraints.begin(),
+                                              ie = query.constraints.end();
+       it != ie; ++it)
+    h.add(hashExpr(*it));
+  h.add(hashExpr(query.expr));
+
+  QueryKey key = { h.h1, h.h2 };
+  return key;
+}
+
+static QueryKey getQueryKey(const Query &query) {
+  QueryHasher hasher;
+  return hasher.hashQuery(query);
+}
+
+/***/
+
+static void encodeU32(char *buf, uint32_t v) {
+  for (unsigned i = 0; i < 4; ++i)
+    buf[i] = (char) (v >> (8 * i));
+}
+
+static void encodeU64(char *buf, uint64_t v) {
+  for (unsigned i = 0; i < 8; ++i)
+    buf[i] = (char) (v >> (8 * i));
+}
+
+static uint32_t decodeU32(const char *buf) {
+  uint32_t v = 0;
+  for (unsigned i = 0; i < 4; ++i)
+    v |= (uint32_t) (unsigned char) buf[i] << (8 * i);
+  return v;
+}
+
+static uint64_t decodeU64(const char *buf) {
+  uint64_t v = 0;
+  for (unsigned i = 0; i < 8; ++i)
+    v |= (uint64_t) (unsigned char) buf[i] << (8 * i);
+  return v;
+}
+
+static uint32_t checksum(const char *buf, size_t size) {
+  uint32_t h = 0x811c9dc5;
+  for (size_t i = 0; i < size; ++i)
+    h = (h ^ (unsigned char) buf[i]) * 0x01000193;
+  return h;
+}
+
+static void encodeRecord(char *buf, const QueryKey &key, RecordKind kind,
+                         uint8_t result, uint64_t value) {
+  encodeU64(buf, key.hash1);
+  encodeU64(buf + 8, key.hash2);
+  encodeU64(buf + 16, value);
+  buf[24] = (char) kind;
+  buf[25] = (char) result;
+  buf[26] = buf[27] = 0;
+  encodeU32(buf + 28, checksum(buf, 28));
+}
+
+static bool writeAll(int fd, const char *buf, size_t size) {
+  while (size) {
+    ssize_t n = write(fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    buf += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// Combine two partial validities known for the same query.
+static IncompleteSolver::PartialValidity
+mergeValidity(IncompleteSolver::PartialValidity a,
+              IncompleteSolver::PartialValidity b) {
+  if (a == b || b == IncompleteSolver::None)
+    return a;
+  if (a == IncompleteSolver::None)
+    return b;
+  if (a == IncompleteSolver::MayBeTrue || a == IncompleteSolver::MayBeFalse) {
+    if (b == IncompleteSolver::MayBeTrue || b == IncompleteSolver::MayBeFalse)
+      return IncompleteSolver::TrueOrFalse;
+    return b;
+  }
+  return a;
+}
+
+/***/
+
+PersistentCachingSolver::PersistentCachingSolver(Solver *s,
+                                                 const std::string &_path)
+  : solver(s), path(_path), fd(-1), fdOwner(0), consumed(0), numRecords(0) {
+  if (openFile())
+    readNewRecords();
+}
+
+PersistentCachingSolver::~PersistentCachingSolver() {
+  if (fd >= 0 && fdOwner == getpid()) {
+    compact();
+    close(fd);
+  }
+  delete solver;
+}
+
+bool PersistentCachingSolver::openFile() {
+  fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    disable("open");
+    return false;
+  }
+  fdOwner = getpid();
+  consumed = numRecords = 0;
+  return true;
+}
+
+void PersistentCachingSolver::disable(const char *what) {
+  klee_warning("persistent query cache %s: %s failed: %s, continuing "
+               "without it", path.c_str(), what, strerror(errno));
+  if (fd >= 0)
+    close(fd);
+  fd = -1;
+}
+
+/// Lock the cache file, reopening it first if it was replaced by a
+/// compaction or was opened by the parent of this process.
+bool PersistentCachingSolver::lock(int operation) {
+  for (;;) {
+    if (fdOwner != getpid()) {
+      // Leave the parent's description (and lock) alone.
+      close(fd);
+      if (!openFile())
+        return false;
+    }
+
+    while (flock(fd, operation) < 0) {
+      if (errno != EINTR) {
+        disable("flock");
+        return false;
+      }
+    }
+
+    struct stat fileStat, pathStat;
+    if (fstat(fd, &fileStat) < 0) {
+      disable("fstat");
+      return false;
+    }
+    if (stat(path.c_str(), &pathStat) == 0 &&
+        pathStat.st_dev == fileStat.st_dev &&
+        pathStat.st_ino == fileStat.st_ino)
+      return true;
+
+    unlock();
+    close(fd);
+    if (!openFile())
+      return false;
+  }
+}
+
+void PersistentCachingSolver::readNewRecords() {
+  if (fd < 0 || !lock(LOCK_SH))
+    return;
+  readNewRecordsLocked();
+  if (fd >= 0)
+    unlock();
+}
+
+void PersistentCachingSolver::readNewRecordsLocked() {
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    disable("fstat");
+    return;
+  }
+
+  uint64_t size = st.st_size;
+  if (size >= HeaderSize && size > consumed) {
+    void *map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      disable("mmap");
+      return;
+    }
+    const char *data = static_cast<const char *>(map);
+
+    if (consumed == 0) {
+      if (memcmp(data, Magic, sizeof(Magic)) != 0 ||
+          decodeU32(data + 4) != Version) {
+        klee_warning("persistent query cache %s: not a cache file of this "
+                     "version, ignoring it", path.c_str());
+        munmap(map, size);
+        close(fd);
+        fd = -1;
+        return;
+      }
+      consumed = HeaderSize;
+    }
+
+    for (; consumed + RecordSize <= size; consumed += RecordSize) {
+      const char *rec = data + consumed;
+      ++numRecords;
+      if (decodeU32(rec + 28) != checksum(rec, 28))
+        continue;
+      QueryKey key = { decodeU64(rec), decodeU64(rec + 8) };
+      insertRecord(key, (RecordKind) rec[24], (uint8_t) rec[25],
+                   decodeU64(rec + 16));
+    }
+
+    munmap(map, size);
+  }
+}
+
+void PersistentCachingSolver::appendRecord(const QueryKey &key,
+                                           RecordKind kind, uint8_t result,
+                                           uint64_t value) {
+  if (fd < 0 || !lock(LOCK_EX))
+    return;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    disable("fstat");
+    return;
+  }
+
+  // A process that died in the middle of an append leaves a partial record
+  // (or header) at the end. Appending after it would shift the framing of
+  // every later record, so cut it off first.
+  uint64_t size = st.st_size;
+  uint64_t whole = size < HeaderSize
+                       ? 0
+                       : size - (size - HeaderSize) % RecordSize;
+  if (whole != size) {
+    if (ftruncate(fd, whole) < 0) {
+      disable("ftruncate");
+      return;
+    }
+  }
+
+  bool ok = true;
+  if (whole == 0) {
+    char header[HeaderSize];
+    memcpy(header, Magic, sizeof(Magic));
+    encodeU32(header + 4, Version);
+    encodeU64(header + 8, 0);
+    ok = writeAll(fd, header, sizeof(header));
+  }
+
+  char rec[RecordSize];
+  encodeRecord(rec, key, kind, result, value);
+  if (ok)
+    ok = writeAll(fd, rec, sizeof(rec));
+
+  if (!ok) {
+    disable("write");
+    return;
+  }
+  unlock();
+}
+
+void PersistentCachingSolver::compact() {
+  if (fd < 0 || !lock(LOCK_EX))
+    return;
+  readNewRecordsLocked();
+  if (fd < 0)
+    return;
+
+  uint64_t live = validityCache.size() + valueCache.size();
+  if (numRecords < MinRecordsToCompact || numRecords < 2 * live) {
+    unlock();
+    return;
+  }
+
+  std::string tmpPath = path + ".tmp." + llvm::utostr(getpid());
+  int tmpFd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (tmpFd < 0) {
+    unlock();
+    return;
+  }
+
+  std::string buf;
+  buf.reserve(HeaderSize + live * RecordSize);
+  char header[HeaderSize];
+  memcpy(header, Magic, sizeof(Magic));
+  encodeU32(header + 4, Version);
+  encodeU64(header + 8, 0);
+  buf.append(header, sizeof(header));
+
+  char rec[RecordSize];
+  for (validity_map::iterator it = validityCache.begin(),
+                              ie = validityCache.end();
+       it != ie; ++it) {
+    encodeRecord(rec, it->first, ValidityRecord, (uint8_t) it->second, 0);
+    buf.append(rec, sizeof(rec));
+  }
+  for (value_map::iterator it = valueCache.begin(), ie = valueCache.end();
+       it != ie; ++it) {
+    encodeRecord(rec, it->first, ValueRecord, 0, it->second);
+    buf.append(rec, sizeof(rec));
+  }
+
+  bool ok = writeAll(tmpFd, buf.data(), buf.size());
+  close(tmpFd);
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) < 0)
+    unlink(tmpPath.c_str());
+  unlock();
+}
+
+void PersistentCachingSolver::insertRecord(const QueryKey &key,
+                                           RecordKind kind, uint8_t result,
+                                           uint64_t value) {
+  switch (kind) {
+  case ValidityRecord: {
+    IncompleteSolver::PartialValidity pv =
+        (IncompleteSolver::PartialValidity) (int8_t) result;
+    std::pair<validity_map::iterator, bool> res =
+        validityCache.insert(std::make_pair(key, pv));
+    if (!res.second)
+      res.first->second = mergeValidity(res.first->second, pv);
+    break;
+  }
+  case ValueRecord:
+    valueCache[key] = value;
+    break;
+  default:
+    break;
+  }
+}
+
+bool PersistentCachingSolver::lookupValidity(
+    const QueryKey &key, IncompleteSolver::PartialValidity &result) {
+  validity_map::iterator it = validityCache.find(key);
+  if (it == validityCache.end()) {
+    // Another process may have answered it in the meantime.
+    readNewRecords();
+    it = validityCache.find(key);
+    if (it == validityCache.end())
+      return false;
+  }
+  result = it->second;
+  return true;
+}
+
+void PersistentCachingSolver::cacheValidity(
+    const QueryKey &key, IncompleteSolver::PartialValidity result) {
+  insertRecord(key, ValidityRecord, (uint8_t) (int8_t) result, 0);
+  appendRecord(key, ValidityRecord, (uint8_t) (int8_t) result, 0);
+}
+
+bool PersistentCachingSolver::computeValidity(const Query &query,
+                                              Solver::Validity &result) {
+  QueryKey key = getQueryKey(query);
+  IncompleteSolver::PartialValidity cachedResult;
+  bool tmp, cacheHit = lookupValidity(key, cachedResult);
+
+  if (cacheHit) {
+    switch (cachedResult) {
+    case IncompleteSolver::MustBeTrue:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::True;
+      return true;
+    case IncompleteSolver::MustBeFalse:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::False;
+      return true;
+    case IncompleteSolver::TrueOrFalse:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::Unknown;
+      return true;
+    case IncompleteSolver::MayBeTrue:
+      ++stats::queryPersistentCacheMisses;
+      if (!solver->impl->computeTruth(query, tmp))
+        return false;
+      cacheValidity(key, tmp ? IncompleteSolver::MustBeTrue
+                             : IncompleteSolver::TrueOrFalse);
+      result = tmp ? Solver::True : Solver::Unknown;
+      return true;
+    case IncompleteSolver::MayBeFalse:
+      ++stats::queryPersistentCacheMisses;
+      if (!solver->impl->computeTruth(query.negateExpr(), tmp))
+        return false;
+      cacheValidity(key, tmp ? IncompleteSolver::MustBeFalse
+                             : IncompleteSolver::TrueOrFalse);
+      result = tmp ? Solver::False : Solver::Unknown;
+      return true;
+    default:
+      break;
+    }
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+
+  switch (result) {
+  case Solver::True:
+    cachedResult = IncompleteSolver::MustBeTrue; break;
+  case Solver::False:
+    cachedResult = IncompleteSolver::MustBeFalse; break;
+  default:
+    cachedResult = IncompleteSolver::TrueOrFalse; break;
+  }
+  cacheValidity(key, cachedResult);
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  QueryKey key = getQueryKey(query);
+  IncompleteSolver::PartialValidity cachedResult;
+  bool cacheHit = lookupValidity(key, cachedResult);
+
+  // a cached result of MayBeTrue forces us to check whether
+  // a False assignment exists.
+  if (cacheHit && cachedResult != IncompleteSolver::MayBeTrue &&
+      cachedResult != IncompleteSolver::None) {
+    ++stats::queryPersistentCacheHits;
+    isValid = (cachedResult == IncompleteSolver::MustBeTrue);
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+
+  cacheValidity(key, isValid ? IncompleteSolver::MustBeTrue
+                             : IncompleteSolver::MayBeFalse);
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  Expr::Width width = query.expr->getWidth();
+  if (width > 64)
+    return solver->impl->computeValue(query, result);
+
+  QueryKey key = getQueryKey(query);
+  value_map::iterator it = valueCache.find(key);
+  if (it == valueCache.end()) {
+    readNewRecords();
+    it = valueCache.find(key);
+  }
+  if (it != valueCache.end()) {
+    ++stats::queryPersistentCacheHits;
+    result = ConstantExpr::create(it->second, width);
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValue(query, result))
+    return false;
+
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(result)) {
+    insertRecord(key, ValueRecord, 0, CE->getZExtValue());
+    appendRecord(key, ValueRecord, 0, CE->getZExtValue());
+  }
+  return true;
+}
+
+///
+
+Solver *klee::createPersistentCachingSolver(Solver *_solver,
+                                            const std::string &path) {
+  return new Solver(new PersistentCachingSolver(_solver, path));
+}
@@ -0,0 +1,519 @@
+//===-- PortfolioSolver.cpp - Race several core solvers -------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Statistics.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <map>
+#include <unordered_set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+  llvm::cl::opt<unsigned>
+  PortfolioWarmup("portfolio-warmup",
+                  llvm::cl::init(8),
+                  llvm::cl::desc("Number of races after which queries of a "
+                                 "shape only go to the backend that keeps "
+                                 "winning them (default=8, 0=always race)"));
+
+  llvm::cl::opt<bool>
+  DebugPortfolioSolver("debug-portfolio-solver",
+                       llvm::cl::init(false),
+                       llvm::cl::desc("Print the race results of the "
+                                      "portfolio solver per query shape on "
+                                      "exit (default=off)"));
+
+  /// Fraction (in tenths) of the races of a shape a backend must have won to
+  /// get the queries of that shape to itself.
+  const uint64_t PreferredWinTenths = 9;
+
+  /// Even once a backend is preferred, every so many queries of the shape are
+  /// raced again so that the statistics follow a change of workload.
+  const uint64_t RaceInterval = 32;
+
+  /// Expressions are only walked this far to classify a query.
+  const unsigned MaxShapeNodes = 4096;
+
+  enum ShapeFeature {
+    NonLinear = 1 << 0,     ///< products or quotients of two symbolic terms
+    Bitwise = 1 << 1,       ///< bitwise logic or shifts on bitvectors
+    SymbolicIndex = 1 << 2, ///< reads at a symbolic index or through updates
+    Wide = 1 << 3,          ///< terms wider than 32 bits
+    SizeShift = 4           ///< log4 of the number of nodes, up to 7
+  };
+
+  /// What a racer sends back: this, the statistics it added, and the values
+  /// if it found a solution.
+  struct RaceResult {
+    uint8_t ok;
+    uint8_t hasSolution;
+    uint32_t status;
+  };
+}
+
+static bool writeAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char *>(buf);
+  while (size) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool readAll(int fd, void *buf, size_t size) {
+  char *p = static_cast<char *>(buf);
+  while (size) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (n == 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static std::vector<uint64_t> getStatistics() {
+  std::vector<uint64_t> values(theStatisticManager->getNumStatistics());
+  for (unsigned i = 0; i < values.size(); ++i)
+    values[i] = theStatisticManager->getValue(
+        theStatisticManager->getStatistic(i));
+  return values;
+}
+
+/// Add the statistics a racer gathered in its own process, as if the query
+/// had been solved here.
+static bool addRacerStatistics(int fd) {
+  std::vector<uint64_t> added(theStatisticManager->getNumStatistics());
+  if (!readAll(fd, added.data(), added.size() * sizeof(uint64_t)))
+    return false;
+  for (unsigned i = 0; i < added.size(); ++i)
+    if (added[i])
+      theStatisticManager->incrementStatistic(
+          theStatisticManager->getStatistic(i), added[i]);
+  return true;
+}
+
+/// Classify a query by the kind of theory reasoning it needs and its size.
+/// Backends tend to be consistently good or bad at a given mix, so the
+/// result keys the race statistics.
+static unsigned getQueryShape(const Query &query) {
+  std::vector<const Expr *> stack;
+  std::unordered_set<const Expr *> visited;
+  unsigned shape = 0;
+
+  stack.push_back(query.expr.get());
+  for (ConstraintManager::constraint_iterator it = query.constraints.begin(),
+         ie = query.constraints.end(); it != ie; ++it)
+    stack.push_back(it->get());
+
+  while (!stack.empty() && visited.size() < MaxShapeNodes) {
+    const Expr *e = stack.back();
+    stack.pop_back();
+    if (!visited.insert(e).second)
+      continue;
+
+    if (e->getWidth() > Expr::Int32)
+      shape |= Wide;
+
+    switch (e->getKind()) {
+    case Expr::Mul:
+      if (!isa<ConstantExpr>(e->getKid(0)) && !isa<ConstantExpr>(e->getKid(1)))
+        shape |= NonLinear;
+      break;
+    case Expr::UDiv:
+    case Expr::SDiv:
+    case Expr::URem:
+    case Expr::SRem:
+      if (!isa<ConstantExpr>(e->getKid(1)))
+        shape |= NonLinear;
+      break;
+    case Expr::And:
+    case Expr::Or:
+    case Expr::Xor:
+      if (e->getWidth() != Expr::Bool)
+        shape |= Bitwise;
+      break;
+    case Expr::Shl:
+    case Expr::LShr:
+    case Expr::AShr:
+      shape |= Bitwise;
+      break;
+    case Expr::Read: {
+      const ReadExpr *re = cast<ReadExpr>(e);
+      if (!isa<ConstantExpr>(re->index) || re->updates.head)
+        shape |= SymbolicIndex;
+      for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+        stack.push_back(un->index.get());
+        stack.push_back(un->value.get());
+      }
+      break;
+    }
+    default:
+      break;
+    }
+
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      stack.push_back(e->getKid(i).get());
+  }
+
+  unsigned sizeClass = 0;
+  for (size_t n = visited.size(); n > 1 && sizeClass < 7; n >>= 2)
+    ++sizeClass;
+  return shape | (sizeClass << SizeShift);
+}
+
+class PortfolioSolver : public SolverImpl {
+private:
+  struct ShapeStats {
+    uint64_t races;
+    uint64_t shortcuts;
+    uint64_t sinceRace;
+    std::vector<uint64_t> wins;
+
+    ShapeStats() : races(0), shortcuts(0), sinceRace(0) {}
+  };
+
+  std::vector<Solver *> solvers;
+  std::vector<std::string> names;
+  std::map<unsigned, ShapeStats> shapes;
+  SolverRunStatus runStatusCode;
+
+  int getPreferred(const ShapeStats &ss) const;
+  bool runInProcess(unsigned index, const Query &query,
+                    const std::vector<const Array *> &objects,
+                    std::vector<std::vector<unsigned char> > &values,
+                    bool &hasSolution);
+  void runInChild(unsigned index, int fd, const Query &query,
+                  const std::vector<const Array *> &objects);
+  bool race(const Query &query, const std::vector<const Array *> &objects,
+            std::vector<std::vector<unsigned char> > &values,
+            bool &hasSolution, int exclude, int &winner);
+  void dumpShapes() const;
+
+public:
+  PortfolioSolver(const std::vector<Solver *> &_solvers,
+                  const std::vector<std::string> &_names)
+    : solvers(_solvers), names(_names),
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+    assert(solvers.size() > 1 && "a portfolio needs at least two solvers");
+    assert(solvers.size() == names.size());
+  }
+  ~PortfolioSolver();
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() { return runStatusCode; }
+  char *getConstraintLog(const Query &query) {
+    return solvers[0]->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(double timeout) {
+    for (unsigned i = 0; i < solvers.size(); ++i)
+      solvers[i]->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+PortfolioSolver::~PortfolioSolver() {
+  if (DebugPortfolioSolver)
+    dumpShapes();
+  for (unsigned i = 0; i < solvers.size(); ++i)
+    delete solvers[i];
+}
+
+void PortfolioSolver::dumpShapes() const {
+  llvm::raw_ostream &os = llvm::errs();
+  os << "portfolio solver: shape (nonlinear, bitwise, symbolic index, wide, "
+        "size class): races, shortcuts, wins per backend\n";
+  for (std::map<unsigned, ShapeStats>::const_iterator it = shapes.begin(),
+         ie = shapes.end(); it != ie; ++it) {
+    unsigned shape = it->first;
+    const ShapeStats &ss = it->second;
+    os << "  (" << ((shape & NonLinear) ? 1 : 0) << ", "
+       << ((shape & Bitwise) ? 1 : 0) << ", "
+       << ((shape & SymbolicIndex) ? 1 : 0) << ", "
+       << ((shape & Wide) ? 1 : 0) << ", " << (shape >> SizeShift) << "): "
+       << ss.races << ", " << ss.shortcuts;
+    for (unsigned i = 0; i < names.size(); ++i)
+      os << ", " << names[i] << "=" << ss.wins[i];
+    os << "\n";
+  }
+}
+
+int PortfolioSolver::getPreferred(const ShapeStats &ss) const {
+  if (!PortfolioWarmup || ss.races < PortfolioWarmup)
+    return -1;
+  unsigned best = 0;
+  for (unsigned i = 1; i < ss.wins.size(); ++i)
+    if (ss.wins[i] > ss.wins[best])
+      best = i;
+  if (ss.wins[best] * 10 < ss.races * PreferredWinTenths)
+    return -1;
+  return best;
+}
+
+bool PortfolioSolver::runInProcess(
+    unsigned index, const Query &query,
+    const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  SolverImpl *impl = solvers[index]->impl;
+  bool ok = impl->computeInitialValues(query, objects, values, hasSolution);
+  runStatusCode = impl->getOperationStatusCode();
+  return ok;
+}
+
+void PortfolioSolver::runInChild(unsigned index, int fd, const Query &query,
+                                 const std::vector<const Array *> &objects) {
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution = false;
+  SolverImpl *impl = solvers[index]->impl;
+  // The child starts out with the statistics of the parent.
+  std::vector<uint64_t> added = getStatistics();
+
+  RaceResult result;
+  result.ok = impl->computeInitialValues(query, objects, values, hasSolution);
+  result.hasSolution = hasSolution;
+  result.status = impl->getOperationStatusCode();
+
+  std::vector<uint64_t> after = getStatistics();
+  for (unsigned i = 0; i < added.size(); ++i)
+    added[i] = after[i] - added[i];
+
+  bool ok = writeAll(fd, &result, sizeof(result)) &&
+            writeAll(fd, added.data(), added.size() * sizeof(uint64_t));
+  if (ok && result.ok && result.hasSolution)
+    for (unsigned i = 0; ok && i < values.size(); ++i)
+      ok = writeAll(fd, values[i].data(), values[i].size());
+  close(fd);
+  _exit(ok ? 0 : 1);
+}
+
+bool PortfolioSolver::race(const Query &query,
+                           const std::vector<const Array *> &objects,
+                           std::vector<std::vector<unsigned char> > &values,
+                           bool &hasSolution, int exclude, int &winner) {
+  winner = -1;
+
+  std::vector<unsigned> candidates;
+  for (unsigned i = 0; i < solvers.size(); ++i)
+    if ((int) i != exclude)
+      candidates.push_back(i);
+  if (candidates.size() == 1) {
+    winner = candidates[0];
+    return runInProcess(winner, query, objects, values, hasSolution);
+  }
+
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  std::vector<unsigned> runners;
+  for (unsigned c = 0; c < candidates.size(); ++c) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+      klee_warning("portfolio solver: unable to create pipe: %s",
+                   strerror(errno));
+      break;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      klee_warning("portfolio solver: unable to fork: %s", strerror(errno));
+      close(pipefd[0]);
+      close(pipefd[1]);
+      break;
+    }
+    if (pid == 0) {
+      // Own process group, so that cancelling the racer also takes down any
+      // process the backend forked itself (e.g. the forked STP solver).
+      setpgid(0, 0);
+      close(pipefd[0]);
+      for (unsigned i = 0; i < fds.size(); ++i)
+        close(fds[i]);
+      runInChild(candidates[c], pipefd[1], query, objects);
+    }
+    setpgid(pid, pid);
+    close(pipefd[1]);
+    pids.push_back(pid);
+    fds.push_back(pipefd[0]);
+    runners.push_back(candidates[c]);
+  }
+
+  if (runners.empty()) {
+    winner = candidates[0];
+    return runInProcess(winner, query, objects, values, hasSolution);
+  }
+  ++stats::portfolioRaces;
+
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  std::vector<bool> done(runners.size(), false);
+  unsigned pending = runners.size();
+  while (pending && winner < 0) {
+    std::vector<struct pollfd> pfds;
+    std::vector<unsigned> pfdRunner;
+    for (unsigned r = 0; r < runners.size(); ++r) {
+      if (done[r])
+        continue;
+      struct pollfd pfd;
+      pfd.fd = fds[r];
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      pfds.push_back(pfd);
+      pfdRunner.push_back(r);
+    }
+
+    if (poll(pfds.data(), pfds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      klee_warning("portfolio solver: poll failed: %s", strerror(errno));
+      break;
+    }
+
+    for (unsigned p = 0; p < pfds.size() && winner < 0; ++p) {
+      if (!pfds[p].revents)
+        continue;
+      unsigned r = pfdRunner[p];
+      done[r] = true;
+      --pending;
+
+      // The statistics of racers that are killed below are lost.
+      RaceResult result;
+      if (!readAll(fds[r], &result, sizeof(result)) ||
+          !addRacerStatistics(fds[r])) {
+        // The racer died without answering.
+        runStatusCode = SOLVER_RUN_STATUS_UNEXPECTED_EXIT_CODE;
+        continue;
+      }
+      runStatusCode = (SolverRunStatus) result.status;
+      if (!result.ok)
+        continue;
+
+      std::vector<std::vector<unsigned char> > answer;
+      if (result.hasSolution) {
+        answer.resize(objects.size());
+        bool complete = true;
+        for (unsigned i = 0; complete && i < objects.size(); ++i) {
+          answer[i].resize(objects[i]->size);
+          complete = readAll(fds[r], answer[i].data(), answer[i].size());
+        }
+        if (!complete) {
+          runStatusCode = SOLVER_RUN_STATUS_UNEXPECTED_EXIT_CODE;
+          continue;
+        }
+      }
+      hasSolution = result.hasSolution;
+      values.swap(answer);
+      winner = runners[r];
+    }
+  }
+
+  for (unsigned r = 0; r < runners.size(); ++r) {
+    if (!done[r])
+      kill(-pids[r], SIGKILL);
+    close(fds[r]);
+    int status;
+    while (waitpid(pids[r], &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+
+  return winner >= 0;
+}
+
+bool PortfolioSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  ShapeStats &ss = shapes[getQueryShape(query)];
+  if (ss.wins.empty())
+    ss.wins.resize(solvers.size());
+
+  int exclude = -1;
+  int preferred = getPreferred(ss);
+  if (preferred >= 0 && ++ss.sinceRace < RaceInterval) {
+    ++ss.shortcuts;
+    ++stats::portfolioShortcuts;
+    if (runInProcess(preferred, query, objects, values, hasSolution))
+      return true;
+    // Most likely a timeout: give the others a go at it.
+    exclude = preferred;
+  }
+
+  ss.sinceRace = 0;
+  int winner;
+  if (!race(query, objects, values, hasSolution, exclude, winner))
+    return false;
+  ++ss.races;
+  ++ss.wins[winner];
+  return true;
+}
+
+bool PortfolioSolver::computeTruth(const Query &query, bool &isValid) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolver::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+Solver *klee::createPortfolioSolver(const std::vector<Solver *> &solvers,
+                                    const std::vector<std::string> &names) {
+  return new Solver(new PortfolioSolver(solvers, names));
+}
@@ -0,0 +1,102 @@
+//===-- SharedQueryCache.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/SharedQueryCache.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+
+#include <cassert>
+#include <mutex>
+#include <unordered_map>
+
+using namespace klee;
+
+namespace {
+  unsigned hashEntry(const ConstraintManager &constraints,
+                     const ref<Expr> &query) {
+    unsigned result = query->hash();
+
+    for (ConstraintManager::constraint_iterator it = constraints.begin();
+         it != constraints.end(); ++it)
+      result ^= (*it)->hash();
+
+    return result;
+  }
+
+  struct CacheEntry {
+    CacheEntry(const ConstraintManager &c, ref<Expr> q)
+      : constraints(c), query(q), hash(hashEntry(c, q)) {}
+
+    ConstraintManager constraints;
+    ref<Expr> query;
+    unsigned hash;
+
+    bool operator==(const CacheEntry &b) const {
+      return constraints==b.constraints && *query.get()==*b.query.get();
+    }
+  };
+
+  struct CacheEntryHash {
+    unsigned operator()(const CacheEntry &ce) const { return ce.hash; }
+  };
+}
+
+struct SharedQueryCache::Shard {
+  typedef std::unordered_map<CacheEntry,
+                             IncompleteSolver::PartialValidity,
+                             CacheEntryHash> cache_map;
+
+  mutable std::mutex lock;
+  cache_map cache;
+};
+
+SharedQueryCache::SharedQueryCache(unsigned _numShards)
+  : shards(new Shard[_numShards]), numShards(_numShards) {
+  assert(numShards > 0 && "a cache needs at least one shard");
+}
+
+SharedQueryCache::~SharedQueryCache() {}
+
+SharedQueryCache::Shard &SharedQueryCache::getShard(unsigned hash) const {
+  // The low bits also pick the bucket inside the shard's map, so mix the
+  // hash before choosing the shard.
+  return shards[(hash * 0x9E3779B1u >> 16) % numShards];
+}
+
+bool SharedQueryCache::lookup(const ConstraintManager &constraints,
+                              const ref<Expr> &query,
+                              IncompleteSolver::PartialValidity &result) const {
+  CacheEntry ce(constraints, query);
+  Shard &shard = getShard(ce.hash);
+
+  std::lock_guard<std::mutex> guard(shard.lock);
+  Shard::cache_map::iterator it = shard.cache.find(ce);
+  if (it == shard.cache.end())
+    return false;
+  result = it->second;
+  return true;
+}
+
+void SharedQueryCache::insert(const ConstraintManager &constraints,
+                              const ref<Expr> &query,
+                              IncompleteSolver::PartialValidity result) {
+  CacheEntry ce(constraints, query);
+  Shard &shard = getShard(ce.hash);
+
+  std::lock_guard<std::mutex> guard(shard.lock);
+  shard.cache.insert(std::make_pair(ce, result));
+}
+
+void SharedQueryCache::clear() {
+  for (unsigned i = 0; i < numShards; ++i) {
+    std::lock_guard<std::mutex> guard(shards[i].lock);
+    shards[i].cache.clear();
+  }
+}
@@ -11,19 +11,30 @@
 
 using namespace klee;
 
-Statistic stats::cexCacheTime("CexCacheTime", "CCtime");
-Statistic stats::queries("Queries", "Q");
-Statistic stats::queriesInvalid("QueriesInvalid", "Qiv");
-Statistic stats::queriesValid("QueriesValid", "Qv");
-Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
-Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
-Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits") ;
-Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses");
-Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
-Statistic stats::queryConstructs("QueriesConstructs", "QB");
-Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
-Statistic stats::queryTime("QueryTime", "Qtime");
+// Solver chains may run on several threads, so their statistics are shared.
+Statistic stats::cexCacheTime("CexCacheTime", "CCtime", true);
+Statistic stats::portfolioRaces("PortfolioRaces", "PFraces", true);
+Statistic stats::portfolioShortcuts("PortfolioShortcuts", "PFshort", true);
+Statistic stats::queries("Queries", "Q", true);
+Statistic stats::queriesInvalid("QueriesInvalid", "Qiv", true);
+Statistic stats::queriesValid("QueriesValid", "Qv", true);
+Statistic stats::queryCacheHits("QueryCacheHits", "QChits", true);
+Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses", true);
+Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits", true);
+Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses", true);
+Statistic stats::queryConstructTime("QueryConstructTime", "QBtime", true);
+Statistic stats::queryConstructs("QueriesConstructs", "QB", true);
+Statistic stats::queryCounterexamples("QueriesCEX", "Qcex", true);
+Statistic stats::queryIncrementalFallbacks("QueryIncrementalFallbacks", "QIfb",
+                                           true);
+Statistic stats::queryIncrementalReused("QueryIncrementalReused", "QIreused",
+                                        true);
+Statistic stats::queryPersistentCacheHits("QueryPersistentCacheHits", "QPChits",
+                                          true);
+Statistic stats::queryPersistentCacheMisses("QueryPersistentCacheMisses",
+                                            "QPCmisses", true);
+Statistic stats::queryTime("QueryTime", "Qtime", true);
 
 #ifdef KLEE_ARRAY_DEBUG
-Statistic stats::arrayHashTime("ArrayHashTime", "AHtime");
+Statistic stats::arrayHashTime("ArrayHashTime", "AHtime", true);
 #endif
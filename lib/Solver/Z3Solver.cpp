@@ -38,6 +38,24 @@ llvm::cl::opt<bool> Z3ValidateModels(
 llvm::cl::opt<unsigned>
     Z3VerbosityLevel("debug-z3-verbosity", llvm::cl::init(0),
                      llvm::cl::desc("Z3 verbosity level (default=0)"));
+
+llvm::cl::opt<bool> Z3Incremental(
+    "z3-incremental", llvm::cl::init(false),
+    llvm::cl::desc("Keep Z3 solvers alive across queries and only push the "
+                   "constraints not shared with the previous query "
+                   "(default=off)"));
+
+llvm::cl::opt<unsigned> Z3IncrementalSolvers(
+    "z3-incremental-solvers", llvm::cl::init(4),
+    llvm::cl::desc("Number of incremental Z3 solvers, each holding a different "
+                   "constraint prefix (default=4)"));
+
+llvm::cl::opt<unsigned> Z3IncrementalMaxFailures(
+    "z3-incremental-max-failures", llvm::cl::init(16),
+    llvm::cl::desc("Stop using incremental Z3 solvers after this many "
+                   "incremental queries timed out, or were unknown while a "
+                   "fresh solver answered them, 0 to never stop "
+                   "(default=16)"));
 }
 
 #include "llvm/Support/ErrorHandling.h"
@@ -54,10 +72,35 @@ private:
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
 
+  /// A Z3 solver kept alive across queries in incremental mode. Every
+  /// constraint in \ref asserted lives in its own scope so that the solver
+  /// can be rolled back to any common prefix with the next query.
+  struct IncrementalSolver {
+    ::Z3_solver solver;
+    std::vector<ref<Expr> > asserted;
+    uint64_t lastUse;
+  };
+  std::vector<IncrementalSolver> incrementalSolvers;
+  uint64_t incrementalUseCounter;
+  unsigned incrementalFailures;
+
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
                          bool &hasSolution);
+  SolverRunStatus runFreshSolver(const Query &,
+                                 const std::vector<const Array *> *objects,
+                                 std::vector<std::vector<unsigned char> > *values,
+                                 bool &hasSolution);
+  SolverRunStatus
+  runIncrementalSolver(const Query &,
+                       const std::vector<const Array *> *objects,
+                       std::vector<std::vector<unsigned char> > *values,
+                       bool &hasSolution);
+  IncrementalSolver &getIncrementalSolver(const ConstraintManager &constraints);
+  void dropIncrementalSolver(IncrementalSolver &is);
+  void assertConstantArrays(::Z3_solver theSolver, ref<Expr> e);
+  void dumpQuery(::Z3_solver theSolver);
 bool validateZ3Model(::Z3_solver &theSolver, ::Z3_model &theModel);
 
 public:
@@ -74,6 +117,8 @@ public:
       timeoutInMilliSeconds = UINT_MAX;
     Z3_params_set_uint(builder->ctx, solverParameters, timeoutParamStrSymbol,
                        timeoutInMilliSeconds);
+    for (auto &is : incrementalSolvers)
+      Z3_solver_set_params(builder->ctx, is.solver, solverParameters);
   }
 
   bool computeTruth(const Query &, bool &isValid);
@@ -97,7 +142,7 @@ Z3SolverImpl::Z3SolverImpl()
               ? Z3LogInteractionFile.c_str()
               : NULL)),
       timeout(0.0), runStatusCode(SOLVER_RUN_STATUS_FAILURE),
-      dumpedQueriesFile(0) {
+      dumpedQueriesFile(0), incrementalUseCounter(0), incrementalFailures(0) {
   assert(builder && "unable to create Z3Builder");
   solverParameters = Z3_mk_params(builder->ctx);
   Z3_params_inc_ref(builder->ctx, solverParameters);
@@ -125,6 +170,9 @@ Z3SolverImpl::Z3SolverImpl()
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  for (auto &is : incrementalSolvers)
+    Z3_solver_dec_ref(builder->ctx, is.solver);
+  incrementalSolvers.clear();
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
 
@@ -247,9 +295,92 @@ bool Z3SolverImpl::internalRunSolver(
     std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
 
   TimerStatIncrementer t(stats::queryTime);
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  ++stats::queries;
+  if (objects)
+    ++stats::queryCounterexamples;
+
+  bool useIncremental = Z3Incremental && Z3IncrementalSolvers > 0;
+  if (useIncremental && Z3IncrementalMaxFailures &&
+      incrementalFailures >= Z3IncrementalMaxFailures)
+    useIncremental = false;
+
+  if (useIncremental) {
+    runStatusCode = runIncrementalSolver(query, objects, values, hasSolution);
+    bool degraded = false;
+    if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_FAILURE) {
+      // Z3 switches to a weaker incremental core once push/pop are used, so
+      // give a fresh solver a chance before reporting a failure.
+      if (values)
+        values->clear();
+      runStatusCode = runFreshSolver(query, objects, values, hasSolution);
+      if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+          runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+        ++stats::queryIncrementalFallbacks;
+        degraded = true;
+      }
+    } else if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_TIMEOUT) {
+      // A timeout is reported as is, the retry would get the full timeout
+      // again, but it still counts against the incremental solvers.
+      degraded = true;
+    }
+    if (degraded && ++incrementalFailures == Z3IncrementalMaxFailures)
+      klee_warning("incremental Z3 queries keep failing, falling back to "
+                   "a fresh solver per query");
+  } else {
+    runStatusCode = runFreshSolver(query, objects, values, hasSolution);
+  }
+
+  // Clear the builder's cache to prevent memory usage exploding.
+  // By using ``autoClearConstructCache=false`` and clearning now
+  // we allow Z3_ast expressions to be shared from an entire
+  // ``Query`` rather than only sharing within a single call to
+  // ``builder->construct()``.
+  builder->clearConstructCache();
+
+  if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+      runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+    if (hasSolution) {
+      ++stats::queriesInvalid;
+    } else {
+      ++stats::queriesValid;
+    }
+    return true; // success
+  }
+  return false; // failed
+}
+
+void Z3SolverImpl::assertConstantArrays(::Z3_solver theSolver, ref<Expr> e) {
+  ConstantArrayFinder constant_arrays;
+  constant_arrays.visit(e);
+  for (auto const &constant_array : constant_arrays.results) {
+    assert(builder->constant_array_assertions.count(constant_array) == 1 &&
+           "Constant array found in query, but not handled by Z3Builder");
+    for (auto const &arrayIndexValueExpr :
+         builder->constant_array_assertions[constant_array]) {
+      Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
+    }
+  }
+}
+
+void Z3SolverImpl::dumpQuery(::Z3_solver theSolver) {
+  if (!dumpedQueriesFile)
+    return;
+  *dumpedQueriesFile << "; start Z3 query\n";
+  *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, theSolver);
+  *dumpedQueriesFile << "(check-sat)\n";
+  *dumpedQueriesFile << "(reset)\n";
+  *dumpedQueriesFile << "; end Z3 query\n\n";
+  dumpedQueriesFile->flush();
+}
+
+SolverImpl::SolverRunStatus Z3SolverImpl::runFreshSolver(
+    const Query &query, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
   // NOTE: Z3 will switch to using a slower solver internally if push/pop are
-  // used so for now it is likely that creating a new solver each time is the
-  // right way to go until Z3 changes its behaviour.
+  // used so by default a new solver is created for each query; see
+  // --z3-incremental for the alternative.
   //
   // TODO: Investigate using a custom tactic as described in
   // https://github.com/klee/klee/issues/653
@@ -257,16 +388,11 @@ bool Z3SolverImpl::internalRunSolver(
   Z3_solver_inc_ref(builder->ctx, theSolver);
   Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
 
-  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
-
   ConstantArrayFinder constant_arrays_in_query;
   for (auto const &constraint : query.constraints) {
     Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
     constant_arrays_in_query.visit(constraint);
   }
-  ++stats::queries;
-  if (objects)
-    ++stats::queryCounterexamples;
 
   Z3ASTHandle z3QueryExpr =
       Z3ASTHandle(builder->construct(query.expr), builder->ctx);
@@ -290,37 +416,105 @@ bool Z3SolverImpl::internalRunSolver(
       builder->ctx, theSolver,
       Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
 
-  if (dumpedQueriesFile) {
-    *dumpedQueriesFile << "; start Z3 query\n";
-    *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, theSolver);
-    *dumpedQueriesFile << "(check-sat)\n";
-    *dumpedQueriesFile << "(reset)\n";
-    *dumpedQueriesFile << "; end Z3 query\n\n";
-    dumpedQueriesFile->flush();
-  }
+  dumpQuery(theSolver);
 
   ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
-  runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
-                                       hasSolution);
+  SolverRunStatus status = handleSolverResponse(theSolver, satisfiable,
+                                                objects, values, hasSolution);
 
   Z3_solver_dec_ref(builder->ctx, theSolver);
-  // Clear the builder's cache to prevent memory usage exploding.
-  // By using ``autoClearConstructCache=false`` and clearning now
-  // we allow Z3_ast expressions to be shared from an entire
-  // ``Query`` rather than only sharing within a single call to
-  // ``builder->construct()``.
-  builder->clearConstructCache();
+  return status;
+}
 
-  if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
-      runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
-    if (hasSolution) {
-      ++stats::queriesInvalid;
-    } else {
-      ++stats::queriesValid;
+Z3SolverImpl::IncrementalSolver &
+Z3SolverImpl::getIncrementalSolver(const ConstraintManager &constraints) {
+  // Pick the solver sharing the longest constraint prefix with the query,
+  // the least recently used one breaking ties.
+  IncrementalSolver *best = NULL;
+  size_t bestPrefix = 0;
+  for (auto &is : incrementalSolvers) {
+    size_t prefix = 0;
+    ConstraintManager::const_iterator ci = constraints.begin(),
+                                      ce = constraints.end();
+    for (; prefix < is.asserted.size() && ci != ce; ++prefix, ++ci)
+      if (is.asserted[prefix] != *ci)
+        break;
+
+    if (!best || prefix > bestPrefix ||
+        (prefix == bestPrefix && is.lastUse < best->lastUse)) {
+      best = &is;
+      bestPrefix = prefix;
     }
-    return true; // success
   }
-  return false; // failed
+
+  if ((!best || bestPrefix == 0) &&
+      incrementalSolvers.size() < Z3IncrementalSolvers) {
+    IncrementalSolver is;
+    is.solver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, is.solver);
+    Z3_solver_set_params(builder->ctx, is.solver, solverParameters);
+    is.lastUse = 0;
+    incrementalSolvers.push_back(is);
+    best = &incrementalSolvers.back();
+    bestPrefix = 0;
+  }
+
+  if (bestPrefix < best->asserted.size()) {
+    Z3_solver_pop(builder->ctx, best->solver,
+                  best->asserted.size() - bestPrefix);
+    best->asserted.resize(bestPrefix);
+  }
+  best->lastUse = ++incrementalUseCounter;
+  return *best;
+}
+
+void Z3SolverImpl::dropIncrementalSolver(IncrementalSolver &is) {
+  Z3_solver_dec_ref(builder->ctx, is.solver);
+  std::swap(is, incrementalSolvers.back());
+  incrementalSolvers.pop_back();
+}
+
+SolverImpl::SolverRunStatus Z3SolverImpl::runIncrementalSolver(
+    const Query &query, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  IncrementalSolver &is = getIncrementalSolver(query.constraints);
+  ::Z3_solver theSolver = is.solver;
+
+  stats::queryIncrementalReused += is.asserted.size();
+
+  ConstraintManager::const_iterator ci = query.constraints.begin(),
+                                    ce = query.constraints.end();
+  for (ci += is.asserted.size(); ci != ce; ++ci) {
+    Z3_solver_push(builder->ctx, theSolver);
+    Z3_solver_assert(builder->ctx, theSolver, builder->construct(*ci));
+    assertConstantArrays(theSolver, *ci);
+    is.asserted.push_back(*ci);
+  }
+
+  // The query itself is the only part that is never shared, it gets its own
+  // scope that is popped right after the check.
+  Z3_solver_push(builder->ctx, theSolver);
+  Z3ASTHandle z3QueryExpr =
+      Z3ASTHandle(builder->construct(query.expr), builder->ctx);
+  assertConstantArrays(theSolver, query.expr);
+  Z3_solver_assert(
+      builder->ctx, theSolver,
+      Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
+
+  dumpQuery(theSolver);
+
+  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
+  SolverRunStatus status = handleSolverResponse(theSolver, satisfiable,
+                                                objects, values, hasSolution);
+
+  if (status == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+      status == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+  } else {
+    // A solver that timed out may be left in a poor state, start over.
+    dropIncrementalSolver(is);
+  }
+  return status;
 }
 
 SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
@@ -12,6 +12,7 @@
 
 #include "klee/Internal/Support/Debug.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iomanip>
 #include <fstream>
@@ -31,7 +32,8 @@ TreeStreamWriter::TreeStreamWriter(const std::string &_path)
     path(_path),
     output(new std::ofstream(path.c_str(), 
                              std::ios::out | std::ios::binary)),
-    ids(1) {
+    ids(1),
+    flushedSize(0) {
   if (!output->good()) {
     delete output;
     output = 0;
@@ -91,6 +93,33 @@ void TreeStreamWriter::flushBuffer() {
 void TreeStreamWriter::flush() {
   flushBuffer();
   output->flush();
+  flushedSize = output->tellp();
+}
+
+bool TreeStreamWriter::continueIn(const std::string &newPath) {
+  assert(output && !bufferCount && "flush() before continuing elsewhere");
+  // Our copy of the descriptor shares its offset with the parent's.
+  delete output;
+  output = 0;
+
+  std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+  std::ofstream *os = new std::ofstream(newPath.c_str(),
+                                        std::ios::out | std::ios::binary);
+  std::vector<char> chunk(bufferSize);
+  for (unsigned long left = flushedSize; left && is.good() && os->good();) {
+    unsigned long n = std::min(left, (unsigned long) chunk.size());
+    is.read(&chunk[0], n);
+    os->write(&chunk[0], is.gcount());
+    left -= is.gcount();
+  }
+
+  path = newPath;
+  if (!is.good() || !os->good()) {
+    delete os;
+    return false;
+  }
+  output = os;
+  return true;
 }
 
 void TreeStreamWriter::readStream(TreeStreamID streamID,
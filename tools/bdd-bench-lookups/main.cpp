@@ -0,0 +1,130 @@
+#include "llvm/Support/CommandLine.h"
+
+#include <chrono>
+#include <functional>
+
+#include "call-paths-to-bdd.h"
+
+namespace {
+llvm::cl::list<std::string> InputCallPathFiles(llvm::cl::desc("<call paths>"),
+                                               llvm::cl::Positional);
+
+llvm::cl::OptionCategory BenchCat("BDD lookup benchmark options");
+
+llvm::cl::opt<std::string>
+InputBDDFile("in", llvm::cl::desc("Input file for BDD deserialization."),
+             llvm::cl::cat(BenchCat));
+
+llvm::cl::opt<unsigned>
+Lookups("lookups",
+        llvm::cl::desc("Number of node lookups to time (default=100000)."),
+        llvm::cl::init(100000), llvm::cl::cat(BenchCat));
+
+std::vector<BDD::BDDNode_ptr> get_all_nodes(const BDD::BDD &bdd) {
+  std::vector<BDD::BDDNode_ptr> all;
+  std::vector<BDD::BDDNode_ptr> nodes{ bdd.get_init(), bdd.get_process() };
+
+  while (nodes.size()) {
+    auto node = nodes.back();
+    nodes.pop_back();
+    all.push_back(node);
+
+    if (node->get_type() == BDD::Node::NodeType::BRANCH) {
+      auto branch_node = static_cast<BDD::Branch *>(node.get());
+
+      nodes.push_back(branch_node->get_on_true());
+      nodes.push_back(branch_node->get_on_false());
+    } else if (node->get_next()) {
+      nodes.push_back(node->get_next());
+    }
+  }
+
+  return all;
+}
+
+// How get_node_by_id used to look nodes up before the BDD kept an index.
+BDD::BDDNode_ptr walk_to_node(const BDD::BDD &bdd, uint64_t id) {
+  std::vector<BDD::BDDNode_ptr> nodes{ bdd.get_init(), bdd.get_process() };
+
+  while (nodes.size()) {
+    auto node = nodes[0];
+    nodes.erase(nodes.begin());
+
+    if (node->get_id() == id) {
+      return node;
+    }
+
+    if (node->get_type() == BDD::Node::NodeType::BRANCH) {
+      auto branch_node = static_cast<BDD::Branch *>(node.get());
+
+      nodes.push_back(branch_node->get_on_true());
+      nodes.push_back(branch_node->get_on_false());
+    } else if (node->get_next()) {
+      nodes.push_back(node->get_next());
+    }
+  }
+
+  return nullptr;
+}
+
+void bench_lookups(const BDD::BDD &bdd, unsigned lookups) {
+  auto all = get_all_nodes(bdd);
+  std::vector<uint64_t> ids;
+
+  for (unsigned i = 0; i < lookups; i++) {
+    ids.push_back(all[(i * 7919ull) % all.size()]->get_id());
+  }
+
+  auto time = [&](std::function<BDD::BDDNode_ptr(uint64_t)> lookup) {
+    auto start = std::chrono::steady_clock::now();
+    for (auto id : ids) {
+      auto node = lookup(id);
+      assert(node && node->get_id() == id);
+      (void)node;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+        .count();
+  };
+
+  // A fresh copy, so building the index is part of the measurement.
+  auto copy = bdd.clone();
+  auto indexed = time([&](uint64_t id) { return copy.get_node_by_id(id); });
+  auto walked = time([&](uint64_t id) { return walk_to_node(copy, id); });
+
+  std::cerr << "Node lookups: " << all.size() << " nodes, " << lookups
+            << " lookups\n";
+  std::cerr << "  index : " << indexed << " us\n";
+  std::cerr << "  walk  : " << walked << " us\n";
+}
+} // namespace
+
+// Times node lookups by id on a BDD, with the index the BDD keeps and with
+// the walk get_node_by_id used to do.
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(argc, argv);
+
+  if (InputBDDFile.size()) {
+    auto bdd = BDD::BDD(InputBDDFile);
+    bench_lookups(bdd, Lookups);
+    return 0;
+  }
+
+  if (InputCallPathFiles.size() == 0) {
+    assert(false &&
+           "Please provide either at least 1 call path file, or a bdd file");
+  }
+
+  std::vector<call_path_t *> call_paths =
+      load_call_paths(std::vector<std::string>(InputCallPathFiles.begin(),
+                                               InputCallPathFiles.end()));
+
+  BDD::BDD bdd(call_paths);
+  bench_lookups(bdd, Lookups);
+
+  for (auto call_path : call_paths) {
+    delete call_path;
+  }
+
+  return 0;
+}
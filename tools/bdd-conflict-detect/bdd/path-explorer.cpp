@@ -76,7 +76,7 @@ bool PathExplorer::explore(const BDDNode_ptr &node, bdd_path_t* p, std::vector<b
 
         klee::ref<klee::ConstantExpr> res;
 
-        solver_toolbox.solver->getValue(query_example, res);
+        solver_toolbox.get_solver()->getValue(query_example, res);
 
         std::string exam;
         res->toString(exam);
@@ -160,9 +160,9 @@ bool PathExplorer::arePathsCompatible(bdd_path_t* p1, bdd_path_t* p2){
       exprBuilder->And(expr_1, symbol_replacer.visit(expr_2));
 
   auto query = klee::Query(constraints, evaluate_expr);
-  solver_toolbox.solver->mayBeTrue(query, res1);
-  //solver_toolbox.solver->mayBeFalse(query, res2);
-  //solver_toolbox.solver->evaluate(query, val);
+  solver_toolbox.get_solver()->mayBeTrue(query, res1);
+  //solver_toolbox.get_solver()->mayBeFalse(query, res2);
+  //solver_toolbox.get_solver()->evaluate(query, val);
 
   // paths are compatible if they may be true
   return res1;
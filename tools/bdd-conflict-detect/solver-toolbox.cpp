@@ -4,6 +4,68 @@ namespace BDD {
 
 solver_toolbox_t solver_toolbox;
 
+solver_toolbox_t::~solver_toolbox_t() {
+  for (auto solver : idle_solvers) {
+    delete solver;
+  }
+}
+
+klee::Solver *solver_toolbox_t::acquire_solver() const {
+  {
+    std::lock_guard<std::mutex> guard(idle_solvers_lock);
+
+    if (idle_solvers.size()) {
+      auto solver = idle_solvers.back();
+      idle_solvers.pop_back();
+      return solver;
+    }
+  }
+
+  assert(query_cache && "solver toolbox used before build()");
+
+  klee::Solver *solver = klee::createCoreSolver(klee::Z3_SOLVER);
+  assert(solver);
+
+  solver = createCexCachingSolver(solver);
+  if (!klee::PersistentQueryCache.empty()) {
+    solver = klee::createPersistentCachingSolver(solver,
+                                                 klee::PersistentQueryCache);
+  }
+  solver = createCachingSolver(solver, query_cache.get());
+  solver = createIndependentSolver(solver);
+
+  return solver;
+}
+
+void solver_toolbox_t::release_solver(klee::Solver *solver) const {
+  std::lock_guard<std::mutex> guard(idle_solvers_lock);
+  idle_solvers.push_back(solver);
+}
+
+klee::Solver *solver_toolbox_t::get_solver() const {
+  struct lease_t {
+    const solver_toolbox_t *toolbox;
+    klee::Solver *solver;
+
+    lease_t() : toolbox(nullptr), solver(nullptr) {}
+
+    ~lease_t() {
+      if (solver) {
+        toolbox->release_solver(solver);
+      }
+    }
+  };
+
+  thread_local lease_t lease;
+
+  if (!lease.solver) {
+    lease.toolbox = this;
+    lease.solver = acquire_solver();
+  }
+
+  return lease.solver;
+}
+
 klee::ref<klee::Expr>
 solver_toolbox_t::create_new_symbol(const std::string &symbol_name,
                                     klee::Expr::Width width) const {
@@ -41,7 +103,7 @@ bool solver_toolbox_t::is_expr_always_true(klee::ConstraintManager constraints,
   klee::Query sat_query(constraints, expr);
 
   bool result;
-  bool success = solver->mustBeTrue(sat_query, result);
+  bool success = get_solver()->mustBeTrue(sat_query, result);
   assert(success);
 
   return result;
@@ -72,9 +134,9 @@ bool solver_toolbox_t::are_exprs_always_equal(
   bool eq_in_e2_ctx;
 
   bool eq_in_e1_ctx_success =
-      solver->mustBeTrue(eq_in_e1_ctx_sat_query, eq_in_e1_ctx);
+      get_solver()->mustBeTrue(eq_in_e1_ctx_sat_query, eq_in_e1_ctx);
   bool eq_in_e2_ctx_success =
-      solver->mustBeTrue(eq_in_e2_ctx_sat_query, eq_in_e2_ctx);
+      get_solver()->mustBeTrue(eq_in_e2_ctx_sat_query, eq_in_e2_ctx);
 
   assert(eq_in_e1_ctx_success);
   assert(eq_in_e2_ctx_success);
@@ -107,9 +169,9 @@ bool solver_toolbox_t::are_exprs_always_not_equal(
   bool not_eq_in_e2_ctx;
 
   bool not_eq_in_e1_ctx_success =
-      solver->mustBeFalse(eq_in_e1_ctx_sat_query, not_eq_in_e1_ctx);
+      get_solver()->mustBeFalse(eq_in_e1_ctx_sat_query, not_eq_in_e1_ctx);
   bool not_eq_in_e2_ctx_success =
-      solver->mustBeFalse(eq_in_e2_ctx_sat_query, not_eq_in_e2_ctx);
+      get_solver()->mustBeFalse(eq_in_e2_ctx_sat_query, not_eq_in_e2_ctx);
 
   assert(not_eq_in_e1_ctx_success);
   assert(not_eq_in_e2_ctx_success);
@@ -139,7 +201,7 @@ bool solver_toolbox_t::is_expr_always_false(klee::ConstraintManager constraints,
   klee::Query sat_query(constraints, expr);
 
   bool result;
-  bool success = solver->mustBeFalse(sat_query, result);
+  bool success = get_solver()->mustBeFalse(sat_query, result);
   assert(success);
 
   return result;
@@ -192,7 +254,7 @@ uint64_t solver_toolbox_t::value_from_expr(klee::ref<klee::Expr> expr) const {
   klee::Query sat_query(no_constraints, expr);
 
   klee::ref<klee::ConstantExpr> value_expr;
-  bool success = solver->getValue(sat_query, value_expr);
+  bool success = get_solver()->getValue(sat_query, value_expr);
 
   assert(success);
   return value_expr->getZExtValue();
@@ -204,7 +266,7 @@ solver_toolbox_t::value_from_expr(klee::ref<klee::Expr> expr,
   klee::Query sat_query(constraints, expr);
 
   klee::ref<klee::ConstantExpr> value_expr;
-  bool success = solver->getValue(sat_query, value_expr);
+  bool success = get_solver()->getValue(sat_query, value_expr);
 
   assert(success);
   return value_expr->getZExtValue();
@@ -296,7 +358,7 @@ bool solver_toolbox_t::are_constraints_compatible(klee::ConstraintManager c1, kl
       solver_toolbox.exprBuilder->And(expr_1, symbol_replacer.visit(expr_2));
 
   auto query = klee::Query(constraints, evaluate_expr);
-  solver_toolbox.solver->mayBeTrue(query, res1);
+  solver_toolbox.get_solver()->mayBeTrue(query, res1);
 
   return res1;
 }
@@ -852,6 +852,8 @@ void reorder(BDD &bdd, BDDNode_ptr root, candidate_t candidate) {
     branch->get_on_false()->recursive_update_ids(id);
     bdd.set_id(id);
   }
+
+  bdd.invalidate_node_index();
 }
 
 std::vector<reordered_bdd> reorder(const BDD &bdd, BDDNode_ptr root) {
@@ -876,7 +878,7 @@ std::vector<reordered_bdd> reorder(const BDD &bdd, BDDNode_ptr root) {
 #endif
 
   for (auto candidate : candidates) {
-    auto bdd_cloned = bdd.clone();
+    auto bdd_cloned = bdd.clone(root->get_id());
     auto root_cloned = bdd_cloned.get_node_by_id(root->get_id());
     auto candidate_cloned = bdd_cloned.get_node_by_id(candidate.node->get_id());
 
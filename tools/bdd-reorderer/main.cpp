@@ -49,17 +49,10 @@ BDD::BDD build_bdd() {
     return BDD::BDD(InputBDDFile);
   }
 
-  std::vector<call_path_t *> call_paths;
-
-  for (auto file : InputCallPathFiles) {
-    std::cerr << "Loading: " << file << std::endl;
-
-    std::vector<std::string> expressions_str;
-    std::deque<klee::ref<klee::Expr>> expressions;
-
-    call_path_t *call_path = load_call_path(file, expressions_str, expressions);
-    call_paths.push_back(call_path);
-  }
+  std::vector<call_path_t *> call_paths =
+      load_call_paths(std::vector<std::string>(InputCallPathFiles.begin(),
+                                               InputCallPathFiles.end()));
+  std::cerr << "Loaded " << call_paths.size() << " call paths" << std::endl;
 
   return BDD::BDD(call_paths);
 }
@@ -17,18 +17,20 @@ std::vector<std::string> BDD::skip_conditions_with_symbol{ "received_a_packet",
 
 void BDD::visit(BDDVisitor &visitor) const { visitor.visit(*this); }
 
-BDDNode_ptr BDD::get_node_by_id(uint64_t _id) const {
+std::shared_ptr<const BDD::node_index_t> BDD::build_node_index() const {
+  auto index = std::make_shared<node_index_t>();
   std::vector<BDDNode_ptr> nodes{ nf_init, nf_process };
-  BDDNode_ptr node;
 
   while (nodes.size()) {
-    node = nodes[0];
-    nodes.erase(nodes.begin());
+    auto node = nodes.back();
+    nodes.pop_back();
 
-    if (node->get_id() == _id) {
-      return node;
+    if (!node) {
+      continue;
     }
 
+    index->emplace(node->get_id(), node);
+
     if (node->get_type() == Node::NodeType::BRANCH) {
       auto branch_node = static_cast<Branch *>(node.get());
 
@@ -39,7 +41,26 @@ BDDNode_ptr BDD::get_node_by_id(uint64_t _id) const {
     }
   }
 
-  return node;
+  return index;
+}
+
+BDDNode_ptr BDD::get_node_by_id(uint64_t _id) const {
+  auto index = std::atomic_load(&node_index);
+
+  if (!index) {
+    index = build_node_index();
+    std::atomic_store(&node_index, index);
+  }
+
+  auto found_it = index->find(_id);
+
+  if (found_it == index->end()) {
+    return nullptr;
+  }
+
+  assert(found_it->second->get_id() == _id &&
+         "Stale node index, missing call to invalidate_node_index()");
+  return found_it->second;
 }
 
 unsigned BDD::get_number_of_nodes(BDDNode_ptr root) const {
@@ -74,6 +95,88 @@ BDD BDD::clone() const {
 
   bdd.nf_init = bdd.nf_init->clone(true);
   bdd.nf_process = bdd.nf_process->clone(true);
+  bdd.invalidate_node_index();
+
+  return bdd;
+}
+
+static BDDNode_ptr clone_path(const BDDNode_ptr &root,
+                              uint64_t subtree_root_id) {
+  // Depth first search for the subtree root, keeping the path from the root.
+  // The prev pointers can't be used here, shared nodes keep pointing to the
+  // parents they had in the BDD they were created in.
+  std::vector<BDDNode_ptr> path;
+  std::vector<std::pair<BDDNode_ptr, unsigned>> stack{ { root, 0 } };
+
+  while (stack.size()) {
+    auto node = stack.back().first;
+    auto depth = stack.back().second;
+    stack.pop_back();
+
+    path.resize(depth);
+
+    if (node->get_id() == subtree_root_id) {
+      path.push_back(node);
+      break;
+    }
+
+    if (node->get_type() == Node::NodeType::BRANCH) {
+      auto branch_node = static_cast<Branch *>(node.get());
+
+      path.push_back(node);
+      stack.emplace_back(branch_node->get_on_false(), depth + 1);
+      stack.emplace_back(branch_node->get_on_true(), depth + 1);
+    } else if (node->get_next()) {
+      path.push_back(node);
+      stack.emplace_back(node->get_next(), depth + 1);
+    }
+  }
+
+  if (path.empty() || path.back()->get_id() != subtree_root_id) {
+    return nullptr;
+  }
+
+  auto clone = path.back()->clone(true);
+
+  for (auto i = path.size() - 1; i-- > 0;) {
+    auto parent_clone = path[i]->clone();
+    auto child = path[i + 1];
+
+    if (parent_clone->get_type() == Node::NodeType::BRANCH) {
+      auto branch_clone = static_cast<Branch *>(parent_clone.get());
+
+      if (branch_clone->get_on_true() == child) {
+        branch_clone->replace_on_true(clone);
+      } else {
+        assert(branch_clone->get_on_false() == child);
+        branch_clone->replace_on_false(clone);
+      }
+    } else {
+      parent_clone->replace_next(clone);
+    }
+
+    clone->replace_prev(parent_clone);
+    clone = parent_clone;
+  }
+
+  return clone;
+}
+
+BDD BDD::clone(uint64_t subtree_root_id) const {
+  BDD bdd = *this;
+
+  assert(bdd.nf_init);
+  assert(bdd.nf_process);
+
+  if (auto init = clone_path(nf_init, subtree_root_id)) {
+    bdd.nf_init = init;
+  } else if (auto process = clone_path(nf_process, subtree_root_id)) {
+    bdd.nf_process = process;
+  } else {
+    assert(false && "Node not found in BDD");
+  }
+
+  bdd.invalidate_node_index();
 
   return bdd;
 }
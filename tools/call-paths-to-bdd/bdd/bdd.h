@@ -1,5 +1,7 @@
 #pragma once
 
+#include <unordered_map>
+
 #include "nodes/node.h"
 #include "symbol-factory.h"
 
@@ -25,19 +27,28 @@ public:
 
   BDD(const BDD &bdd)
       : id(bdd.id), total_call_paths(bdd.total_call_paths),
-        nf_init(bdd.nf_init), nf_process(bdd.nf_process) {}
+        nf_init(bdd.nf_init), nf_process(bdd.nf_process),
+        node_index(std::atomic_load(&bdd.node_index)) {}
 
   BDD(const std::string &file_path) : id(0), total_call_paths(0) {
     solver_toolbox.build();
     deserialize(file_path);
   }
 
-  BDD &operator=(const BDD &) = default;
+  BDD &operator=(const BDD &bdd) {
+    id = bdd.id;
+    total_call_paths = bdd.total_call_paths;
+    nf_init = bdd.nf_init;
+    nf_process = bdd.nf_process;
+    std::atomic_store(&node_index, std::atomic_load(&bdd.node_index));
+    return *this;
+  }
 
   uint64_t get_id() const { return id; }
   void set_id(uint64_t _id) {
     assert(_id >= id);
     id = _id;
+    invalidate_node_index();
   }
 
   unsigned get_total_call_paths() const { return total_call_paths; }
@@ -47,8 +58,19 @@ public:
   BDDNode_ptr get_process() const { return nf_process; }
   BDDNode_ptr get_node_by_id(uint64_t _id) const;
 
+  // Must be called after nodes are added, removed or renumbered from outside
+  // the BDD, the id index is rebuilt on the next lookup.
+  void invalidate_node_index() {
+    std::atomic_store(&node_index, std::shared_ptr<const node_index_t>());
+  }
+
   BDD clone() const;
 
+  // Clone for rewriting the subtree rooted at the node with the given id.
+  // Only that subtree and the nodes on the path to it are copied, every other
+  // node is shared with this BDD and must be left untouched.
+  BDD clone(uint64_t subtree_root_id) const;
+
   void visit(BDDVisitor &visitor) const;
   void serialize(std::string file_path) const;
 
@@ -59,6 +81,14 @@ private:
   BDDNode_ptr nf_init;
   BDDNode_ptr nf_process;
 
+  // Id to node index, built on the first get_node_by_id and shared between
+  // copies of the BDD until one of them modifies its nodes. Loaded and stored
+  // atomically, lookups on the same BDD may come from several threads.
+  typedef std::unordered_map<uint64_t, BDDNode_ptr> node_index_t;
+  mutable std::shared_ptr<const node_index_t> node_index;
+
+  std::shared_ptr<const node_index_t> build_node_index() const;
+
   static std::vector<std::string> skip_conditions_with_symbol;
 
   static constexpr char INIT_CONTEXT_MARKER[] = "start_time";
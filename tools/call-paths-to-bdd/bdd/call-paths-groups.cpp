@@ -1,5 +1,8 @@
 #include "call-paths-groups.h"
 
+#include <atomic>
+#include <thread>
+
 namespace BDD {
 void CallPathsGroup::group_call_paths() {
   assert(call_paths.size());
@@ -125,12 +128,40 @@ CallPathsGroup::get_possible_discriminating_constraints() const {
   std::vector<klee::ref<klee::Expr>> possible_discriminating_constraints;
   assert(on_true.size());
 
-  int i = 0;
-  for (auto constraint : on_true.cp[0]->constraints) {
-    if (satisfies_constraint(on_true.cp, constraint)) {
-      possible_discriminating_constraints.emplace_back(constraint);
+  std::vector<klee::ref<klee::Expr>> candidates(
+      on_true.cp[0]->constraints.begin(), on_true.cp[0]->constraints.end());
+
+  // Every candidate costs a query per call path, and solver_toolbox gives
+  // each thread its own solver, so check them in parallel when expressions
+  // may be shared between threads.
+  std::vector<char> satisfied(candidates.size(), false);
+  std::atomic<size_t> next(0);
+
+  auto check = [&]() {
+    for (size_t i = next++; i < candidates.size(); i = next++) {
+      satisfied[i] = satisfies_constraint(on_true.cp, candidates[i]);
+    }
+  };
+
+  unsigned num_threads = 1;
+  if (klee::Expr::threadSafe) {
+    num_threads = std::min<size_t>(
+        std::max(1u, std::thread::hardware_concurrency()), candidates.size());
+  }
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < num_threads; i++) {
+    threads.emplace_back(check);
+  }
+  check();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < candidates.size(); i++) {
+    if (satisfied[i]) {
+      possible_discriminating_constraints.emplace_back(candidates[i]);
     }
-    i++;
   }
 
   return possible_discriminating_constraints;
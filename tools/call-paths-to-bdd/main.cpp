@@ -39,22 +39,15 @@ int main(int argc, char **argv) {
     return 0;
   }
 
-  std::vector<call_path_t *> call_paths;
-
   if (InputCallPathFiles.size() == 0) {
     assert(false &&
            "Please provide either at least 1 call path file, or a bdd file");
   }
 
-  for (auto file : InputCallPathFiles) {
-    std::cerr << "Loading: " << file << std::endl;
-
-    std::vector<std::string> expressions_str;
-    std::deque<klee::ref<klee::Expr>> expressions;
-
-    call_path_t *call_path = load_call_path(file, expressions_str, expressions);
-    call_paths.push_back(call_path);
-  }
+  std::vector<call_path_t *> call_paths =
+      load_call_paths(std::vector<std::string>(InputCallPathFiles.begin(),
+                                               InputCallPathFiles.end()));
+  std::cerr << "Loaded " << call_paths.size() << " call paths" << std::endl;
 
   BDD::BDD bdd(call_paths);
 
@@ -2,6 +2,12 @@
 
 #include "load-call-paths.h"
 
+#include "klee/CommandLine.h"
+#include "klee/SharedQueryCache.h"
+
+#include <memory>
+#include <mutex>
+
 namespace BDD {
 
 class ReplaceSymbols : public klee::ExprVisitor::ExprVisitor {
@@ -70,27 +76,35 @@ public:
 };
 
 struct solver_toolbox_t {
-  klee::Solver *solver;
   klee::ExprBuilder *exprBuilder;
   klee::ArrayCache arr_cache;
 
-  solver_toolbox_t() : solver(nullptr) {}
+  // Validity results shared by the solver chains of all threads.
+  std::unique_ptr<klee::SharedQueryCache> query_cache;
 
-  void build() {
-    if (solver != nullptr) {
-      return;
-    }
+  // BDDs call build() as they are created, possibly on several threads.
+  std::once_flag built;
 
-    solver = klee::createCoreSolver(klee::Z3_SOLVER);
-    assert(solver);
+  // Solver chains of threads that have exited, kept for the next ones.
+  mutable std::mutex idle_solvers_lock;
+  mutable std::vector<klee::Solver *> idle_solvers;
 
-    solver = createCexCachingSolver(solver);
-    solver = createCachingSolver(solver);
-    solver = createIndependentSolver(solver);
+  solver_toolbox_t() : exprBuilder(nullptr) {}
+  ~solver_toolbox_t();
 
-    exprBuilder = klee::createDefaultExprBuilder();
+  void build() {
+    std::call_once(built, [this]() {
+      query_cache.reset(new klee::SharedQueryCache());
+      exprBuilder = klee::createDefaultExprBuilder();
+    });
   }
 
+  // The solver chain of the calling thread. The chains are not thread-safe,
+  // only the cache underneath is shared. A thread takes an idle chain or
+  // creates one on first use, and gives it back when it exits, so that
+  // short-lived worker threads do not start from cold solvers.
+  klee::Solver *get_solver() const;
+
   klee::ref<klee::Expr> create_new_symbol(const std::string &symbol_name,
                                           klee::Expr::Width width) const;
 
@@ -125,6 +139,10 @@ struct solver_toolbox_t {
                            klee::ConstraintManager constraints) const;
 
   bool are_calls_equal(call_t c1, call_t c2) const;
+
+private:
+  klee::Solver *acquire_solver() const;
+  void release_solver(klee::Solver *solver) const;
 };
 
 extern solver_toolbox_t solver_toolbox;
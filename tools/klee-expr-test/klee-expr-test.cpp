@@ -57,9 +57,9 @@ int main(int argc, char **argv) {
 
   //if expr can be true
   auto query = klee::Query(constraints, expr1);
-  BDD::solver_toolbox.solver->mayBeTrue(query, result_maybetrue);
-  BDD::solver_toolbox.solver->mayBeFalse(query, result_maybefalse);
-  BDD::solver_toolbox.solver->evaluate(query, val);
+  BDD::solver_toolbox.get_solver()->mayBeTrue(query, result_maybetrue);
+  BDD::solver_toolbox.get_solver()->mayBeFalse(query, result_maybefalse);
+  BDD::solver_toolbox.get_solver()->evaluate(query, val);
 
   std::cerr << "--- A ^ ~A ---\n"
             << "May be true: " << result_maybetrue << "\n"
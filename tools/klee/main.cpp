@@ -23,6 +23,7 @@
 #include "klee/Interpreter.h"
 #include "klee/Statistics.h"
 #include "klee/ExprBuilder.h"
+#include "klee/util/ExprBinary.h"
 #include "klee/util/ExprPPrinter.h"
 
 #include "llvm/IR/Constants.h"
@@ -54,12 +55,18 @@
 #include <sys/wait.h>
 
 #include <cerrno>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iterator>
 #include <sstream>
 #include <list>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 using namespace llvm;
 using namespace klee;
@@ -166,6 +173,31 @@ DumpCallTraces("dump-call-traces",
                         "klee_trace_ret* intrinsic labels."),
                cl::init(false));
 
+enum CallPathFormatType {
+  TextCallPaths,
+  BinaryCallPaths
+};
+
+cl::opt<CallPathFormatType> CallPathFormat(
+    "call-path-format",
+    cl::desc("Format of the .call_path files written with --dump-call-traces "
+             "(text by default)."),
+    cl::values(clEnumValN(TextCallPaths, "text",
+                          "kQuery followed by the calls, in plain text"),
+               clEnumValN(BinaryCallPaths, "binary",
+                          "Compact binary form with shared expression and "
+                          "array tables, much faster to load")
+               KLEE_LLVM_CL_VAL_END),
+    cl::init(TextCallPaths));
+
+cl::opt<unsigned> CallPathQueueSize(
+    "call-path-queue-size",
+    cl::desc("Number of .call_path files that may wait for the background "
+             "writer thread; the interpreter blocks while the queue is full. "
+             "0 writes them on the interpreter thread, as do builds without "
+             "ENABLE_THREADSAFE_EXPR (default=64)."),
+    cl::init(64));
+
 cl::opt<bool> CondoneUndeclaredHavocs(
     "condone-undeclared-havocs",
     cl::desc("Do not throw an error if a memory location changes "
@@ -231,13 +263,21 @@ struct CallPathTip {
 
 class CallTree {
   std::vector<CallTree *> children;
+  // positions in children, by CallInfo::hash()
+  std::unordered_multimap<unsigned, unsigned> childIndex;
+  // the tips of the children grouped by CallInfo::sameInvocation as they are
+  // added, and the positions of the groups by the invocationHash() of their
+  // first call
+  std::vector<std::vector<CallPathTip *>> groups;
+  std::unordered_multimap<unsigned, unsigned> groupIndex;
   CallPathTip tip;
-  std::vector<std::vector<CallPathTip *>> groupChildren();
+
+  CallTree *getChild(const CallInfo &call, unsigned path_id);
 
 public:
   CallTree() : children(), tip() {};
-  void addCallPath(std::vector<CallInfo>::const_iterator path_begin,
-                   std::vector<CallInfo>::const_iterator path_end,
+  void addCallPath(std::vector<const CallInfo *>::const_iterator path_begin,
+                   std::vector<const CallInfo *>::const_iterator path_end,
                    unsigned path_id);
   void dumpCallPrefixes(
       std::list<CallInfo> accumulated_prefix,
@@ -249,6 +289,44 @@ public:
   int refCount;
 };
 
+/// Writes .call_path files on a background thread, so that the interpreter
+/// does not wait for the formatting and the file system. A job owns a copy
+/// of the constraints and the call path of the terminated state, which
+/// leaves the state free to go.
+class CallPathWriter {
+public:
+  struct Job {
+    std::string filename;
+    ConstraintManager constraints;
+    CallPath callPath;
+  };
+
+private:
+  KleeHandler *handler;
+  unsigned capacity;
+
+  std::mutex lock;
+  std::condition_variable notEmpty, notFull;
+  std::deque<std::unique_ptr<Job>> queue;
+  std::thread thread;
+  bool stopping;
+
+  void run();
+
+public:
+  CallPathWriter(KleeHandler *_handler, unsigned _capacity)
+      : handler(_handler), capacity(_capacity), stopping(false) {}
+  ~CallPathWriter() { finish(); }
+
+  /// Queue \p job, waiting while the queue is full. Writes it right away if
+  /// the queue has no room at all.
+  void push(std::unique_ptr<Job> job);
+
+  /// Write everything still queued and stop the thread. A later push()
+  /// starts it again.
+  void finish();
+};
+
 /***/
 
 class KleeHandler : public InterpreterHandler {
@@ -265,12 +343,19 @@ private:
   unsigned m_callPathIndex;     // number of call path strings dumped so far
   unsigned m_callPathPrefixIndex; // number of call path strings dumped so far
 
+  // once the search was split over several workers, file ids are taken
+  // from m_workerIds so that the workers never write to the same file
+  unsigned m_workerId;
+  WorkerIds *m_workerIds;
+
   // used for writing .ktest files
   int m_argc;
   char **m_argv;
 
   CallTree m_callTree;
 
+  CallPathWriter m_callPathWriter;
+
 public:
   KleeHandler(int argc, char **argv);
   ~KleeHandler();
@@ -281,6 +366,15 @@ public:
   unsigned getNumPathsExplored() { return m_pathsExplored; }
   void incPathsExplored() { m_pathsExplored++; }
 
+  void setWorkerId(unsigned workerId, WorkerIds &ids);
+  void finishPendingOutput();
+  void finishWorker();
+  void addWorkerResults(unsigned pathsExplored, unsigned testCases) {
+    m_pathsExplored += pathsExplored;
+    m_numGeneratedTests += testCases;
+  }
+  unsigned getWorkerUniqueId(WorkerIds::Kind kind, unsigned localId);
+
   void setInterpreter(Interpreter *i);
 
   void processTestCase(const ExecutionState &state, const char *errorMessage,
@@ -302,14 +396,66 @@ public:
   llvm::raw_fd_ostream *openNextCallPathPrefixFile();
 
   void dumpCallPathPrefixes();
-  void dumpCallPath(const ExecutionState &state, llvm::raw_ostream *file);
+  void writeCallPath(const CallPathWriter::Job &job);
+  void dumpCallPath(const ConstraintManager &constraints,
+                    const CallPath &callPath, llvm::raw_ostream *file);
+  void dumpCallPathBinary(const ConstraintManager &constraints,
+                          const CallPath &callPath, llvm::raw_ostream *file);
 };
 
+void CallPathWriter::run() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    notEmpty.wait(guard, [this] { return stopping || !queue.empty(); });
+    if (queue.empty())
+      return;
+    std::unique_ptr<Job> job = std::move(queue.front());
+    queue.pop_front();
+    notFull.notify_one();
+
+    guard.unlock();
+    handler->writeCallPath(*job);
+    // Release the expressions off the interpreter thread as well.
+    job.reset();
+    guard.lock();
+  }
+}
+
+void CallPathWriter::push(std::unique_ptr<Job> job) {
+  if (capacity == 0) {
+    handler->writeCallPath(*job);
+    return;
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  if (!thread.joinable()) {
+    stopping = false;
+    thread = std::thread(&CallPathWriter::run, this);
+  }
+  notFull.wait(guard, [this] { return queue.size() < capacity; });
+  queue.push_back(std::move(job));
+  notEmpty.notify_one();
+}
+
+void CallPathWriter::finish() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!thread.joinable())
+      return;
+    stopping = true;
+  }
+  notEmpty.notify_one();
+  thread.join();
+}
+
 KleeHandler::KleeHandler(int argc, char **argv)
     : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0), m_infoFile(0),
       m_outputDirectory(), m_numTotalTests(0), m_numGeneratedTests(0),
       m_pathsExplored(0), m_callPathIndex(1), m_callPathPrefixIndex(0),
-      m_argc(argc), m_argv(argv) {
+      m_workerId(0), m_workerIds(0),
+      m_argc(argc), m_argv(argv),
+      // The writer thread shares the constraints' expressions.
+      m_callPathWriter(this, Expr::threadSafe ? CallPathQueueSize : 0) {
 
   // create output directory (OutputDir or "klee-out-<i>")
   bool dir_given = OutputDir != "";
@@ -387,6 +533,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
 }
 
 KleeHandler::~KleeHandler() {
+  m_callPathWriter.finish();
   delete m_pathWriter;
   delete m_symPathWriter;
   fclose(klee_warning_file);
@@ -410,6 +557,52 @@ void KleeHandler::setInterpreter(Interpreter *i) {
   }
 }
 
+void KleeHandler::setWorkerId(unsigned workerId, WorkerIds &ids) {
+  if (!m_workerIds) {
+    // Before the first split, all ids were taken by this process.
+    ids.reserve(WorkerIds::TestCase, m_numTotalTests);
+    ids.reserve(WorkerIds::CallPath, m_callPathIndex - 1);
+    ids.reserve(WorkerIds::CallPrefix, m_callPathPrefixIndex);
+    m_workerIds = &ids;
+  }
+  m_workerId = workerId;
+  if (workerId == 0)
+    return;
+
+  // The call paths so far are in the tree of the worker that started this
+  // one, which dumps their prefixes.
+  m_callTree = CallTree();
+
+  // The stream ids of the states stay valid in a copy of the path files.
+  std::stringstream suffix;
+  suffix << '-' << workerId << ".ts";
+  if (m_pathWriter &&
+      !m_pathWriter->continueIn(getOutputFilename("paths" + suffix.str())))
+    klee_error("unable to copy paths.ts for worker %u", workerId);
+  if (m_symPathWriter &&
+      !m_symPathWriter->continueIn(getOutputFilename("symPaths" + suffix.str())))
+    klee_error("unable to copy symPaths.ts for worker %u", workerId);
+}
+
+void KleeHandler::finishPendingOutput() {
+  m_callPathWriter.finish();
+  if (m_pathWriter)
+    m_pathWriter->flush();
+  if (m_symPathWriter)
+    m_symPathWriter->flush();
+}
+
+void KleeHandler::finishWorker() {
+  finishPendingOutput();
+  if (DumpCallTracePrefixes)
+    dumpCallPathPrefixes();
+}
+
+unsigned KleeHandler::getWorkerUniqueId(WorkerIds::Kind kind,
+                                        unsigned localId) {
+  return m_workerIds ? m_workerIds->next(kind) : localId;
+}
+
 std::string KleeHandler::getOutputFilename(const std::string &filename) {
   SmallString<128> path = m_outputDirectory;
   sys::path::append(path, filename);
@@ -458,7 +651,7 @@ void KleeHandler::processTestCase(const ExecutionState &state,
 
     double start_time = util::getWallTime();
 
-    unsigned id = ++m_numTotalTests;
+    unsigned id = getWorkerUniqueId(WorkerIds::TestCase, ++m_numTotalTests);
 
     if (success) {
       KTest b;
@@ -529,10 +722,11 @@ void KleeHandler::processTestCase(const ExecutionState &state,
       }
 
       if (DumpCallTraces && !errorMessage) {
-        llvm::raw_fd_ostream *trace_file =
-            openOutputFile(getTestFilename("call_path", id));
-        dumpCallPath(state, trace_file);
-        delete trace_file;
+        std::unique_ptr<CallPathWriter::Job> job(new CallPathWriter::Job);
+        job->filename = getTestFilename("call_path", id);
+        job->constraints = state.constraints;
+        job->callPath = state.callPath;
+        m_callPathWriter.push(std::move(job));
       }
 
       for (unsigned i = 0; i < b.numObjects; i++)
@@ -633,6 +827,8 @@ void KleeHandler::processTestCase(const ExecutionState &state,
 }
 
 bool dumpCallInfo(const CallInfo &ci, llvm::raw_ostream &file) {
+  if (!ci.hasAllOutValues())
+    return false;
   file << ci.callPlace.getLine() << ":" << ci.f->getName() << "(";
   assert(ci.returned);
   for (std::vector<CallArg>::const_iterator argIter = ci.args.begin(),
@@ -649,8 +845,6 @@ bool dumpCallInfo(const CallInfo &ci, llvm::raw_ostream &file) {
           if (arg->pointee.doTraceValueIn) {
             file << *arg->pointee.inVal;
           }
-          if (arg->pointee.doTraceValueOut && arg->pointee.outVal.isNull())
-            return false;
           file << "->";
           if (arg->pointee.doTraceValueOut) {
             file << *arg->pointee.outVal;
@@ -666,8 +860,6 @@ bool dumpCallInfo(const CallInfo &ci, llvm::raw_ostream &file) {
                 file << *i->second.inVal;
               }
               file << "->";
-              if (i->second.doTraceValueOut && i->second.outVal.isNull())
-                return false;
               if (i->second.doTraceValueOut) {
                 file << *i->second.outVal;
               }
@@ -914,9 +1106,10 @@ bool dumpCallInfoSExpr(const CallInfo &ci, llvm::raw_ostream &file) {
 }
 
 void KleeHandler::processCallPath(const ExecutionState &state) {
-  unsigned id = m_callPathIndex;
+  unsigned id = getWorkerUniqueId(WorkerIds::CallPath, m_callPathIndex);
+  std::vector<const CallInfo *> calls = state.callPath.getCalls();
   if (DumpCallTracePrefixes)
-    m_callTree.addCallPath(state.callPath.begin(), state.callPath.end(), id);
+    m_callTree.addCallPath(calls.begin(), calls.end(), id);
 
   if (!DumpCallTraces)
     return;
@@ -927,10 +1120,10 @@ void KleeHandler::processCallPath(const ExecutionState &state) {
   filename << "call-path" << std::setfill('0') << std::setw(6) << id << '.'
            << "txt";
   llvm::raw_ostream *file = openOutputFile(filename.str());
-  for (std::vector<CallInfo>::const_iterator iter = state.callPath.begin(),
-                                             end = state.callPath.end();
+  for (std::vector<const CallInfo *>::const_iterator iter = calls.begin(),
+                                                     end = calls.end();
        iter != end; ++iter) {
-    const CallInfo &ci = *iter;
+    const CallInfo &ci = **iter;
     bool dumped = dumpCallInfo(ci, *file);
     if (!dumped)
       break;
@@ -945,7 +1138,8 @@ void KleeHandler::processCallPath(const ExecutionState &state) {
 }
 
 llvm::raw_fd_ostream *KleeHandler::openNextCallPathPrefixFile() {
-  unsigned id = ++m_callPathPrefixIndex;
+  unsigned id =
+      getWorkerUniqueId(WorkerIds::CallPrefix, ++m_callPathPrefixIndex);
   std::stringstream filename;
   filename << "call-prefix" << std::setfill('0') << std::setw(6) << id << '.'
            << "txt";
@@ -958,12 +1152,28 @@ void KleeHandler::dumpCallPathPrefixes() {
   // std::vector<ref<Expr> >* >(), this);
 }
 
-void KleeHandler::dumpCallPath(const ExecutionState &state,
+void KleeHandler::writeCallPath(const CallPathWriter::Job &job) {
+  llvm::raw_fd_ostream *file = openOutputFile(job.filename);
+  if (!file)
+    return;
+  dumpCallPath(job.constraints, job.callPath, file);
+  delete file;
+}
+
+void KleeHandler::dumpCallPath(const ConstraintManager &constraints,
+                               const CallPath &callPath,
                                llvm::raw_ostream *file) {
+  if (CallPathFormat == BinaryCallPaths) {
+    dumpCallPathBinary(constraints, callPath, file);
+    return;
+  }
+
   std::vector<klee::ref<klee::Expr>> evalExprs;
   std::vector<const klee::Array *> evalArrays;
 
-  for (auto ci : state.callPath) {
+  std::vector<const CallInfo *> calls = callPath.getCalls();
+  for (const CallInfo *call : calls) {
+    const CallInfo &ci = *call;
     for (auto a : ci.args) {
       evalExprs.push_back(a.expr);
 
@@ -995,7 +1205,7 @@ void KleeHandler::dumpCallPath(const ExecutionState &state,
   ExprBuilder *exprBuilder = createDefaultExprBuilder();
   std::string kleaverStr;
   llvm::raw_string_ostream kleaverROS(kleaverStr);
-  ExprPPrinter::printQuery(kleaverROS, state.constraints, exprBuilder->False(),
+  ExprPPrinter::printQuery(kleaverROS, constraints, exprBuilder->False(),
                            &evalExprs[0], &evalExprs[0] + evalExprs.size(),
                            &evalArrays[0], &evalArrays[0] + evalArrays.size(),
                            true);
@@ -1005,22 +1215,97 @@ void KleeHandler::dumpCallPath(const ExecutionState &state,
   *file << kleaverROS.str();
 
   *file << ";;-- Calls --\n";
-  for (std::vector<CallInfo>::const_iterator iter = state.callPath.begin(),
-                                             end = state.callPath.end();
+  for (std::vector<const CallInfo *>::const_iterator iter = calls.begin(),
+                                                     end = calls.end();
        iter != end; ++iter) {
-    const CallInfo &ci = *iter;
+    const CallInfo &ci = **iter;
     bool dumped = dumpCallInfo(ci, *file);
     if (!dumped)
       break;
   }
   *file << ";;-- Constraints --\n";
-  for (ConstraintManager::constraint_iterator ci = state.constraints.begin(),
-                                              cEnd = state.constraints.end();
+  for (ConstraintManager::constraint_iterator ci = constraints.begin(),
+                                              cEnd = constraints.end();
        ci != cEnd; ++ci) {
     *file << **ci << "\n";
   }
 }
 
+// Write the same information load_call_path extracts from the text form: the
+// expression and array tables followed by the constraints and the calls, see
+// load-call-paths.cpp for the layout.
+void KleeHandler::dumpCallPathBinary(const ConstraintManager &constraints,
+                                     const CallPath &callPath,
+                                     llvm::raw_ostream *file) {
+  ExprBinaryWriter writer;
+  std::string body;
+  llvm::raw_string_ostream os(body);
+
+  ExprBinaryWriter::writeU32(os, constraints.size());
+  for (ConstraintManager::constraint_iterator ci = constraints.begin(),
+                                              cEnd = constraints.end();
+       ci != cEnd; ++ci)
+    ExprBinaryWriter::writeU32(os, writer.addExpr(*ci));
+
+  // Like the text form, stop at the first call with a missing output value.
+  std::vector<const CallInfo *> calls = callPath.getCalls();
+  unsigned numCalls = 0;
+  while (numCalls < calls.size() && calls[numCalls]->hasAllOutValues())
+    ++numCalls;
+
+  ExprBinaryWriter::writeU32(os, numCalls);
+  for (unsigned i = 0; i < numCalls; ++i) {
+    const CallInfo &ci = *calls[i];
+    assert(ci.returned);
+    ExprBinaryWriter::writeString(os, ci.f->getName().str());
+
+    ExprBinaryWriter::writeU32(os, ci.args.size());
+    for (const CallArg &arg : ci.args) {
+      ExprBinaryWriter::writeString(os, arg.name);
+      ExprBinaryWriter::writeU32(os, writer.addExpr(arg.expr));
+      if (arg.isPtr && arg.funPtr) {
+        ExprBinaryWriter::writeU8(os, 1);
+        ExprBinaryWriter::writeString(os, arg.funPtr->getName().str());
+      } else if (arg.isPtr && (arg.pointee.doTraceValueIn ||
+                               arg.pointee.doTraceValueOut)) {
+        ExprBinaryWriter::writeU8(os, 2);
+        ExprBinaryWriter::writeU32(
+            os, arg.pointee.doTraceValueIn ? writer.addExpr(arg.pointee.inVal)
+                                           : ExprBinaryWriter::NoId);
+        ExprBinaryWriter::writeU32(
+            os, arg.pointee.doTraceValueOut ? writer.addExpr(arg.pointee.outVal)
+                                            : ExprBinaryWriter::NoId);
+      } else {
+        ExprBinaryWriter::writeU8(os, 0);
+      }
+    }
+
+    unsigned numExtraPtrs = 0;
+    for (auto &ep : ci.extraPtrs)
+      if (ep.second.pointee.doTraceValueIn || ep.second.pointee.doTraceValueOut)
+        ++numExtraPtrs;
+    ExprBinaryWriter::writeU32(os, numExtraPtrs);
+    for (auto &ep : ci.extraPtrs) {
+      const FieldDescr &pointee = ep.second.pointee;
+      if (!pointee.doTraceValueIn && !pointee.doTraceValueOut)
+        continue;
+      ExprBinaryWriter::writeString(os, ep.second.name);
+      ExprBinaryWriter::writeU32(os, pointee.doTraceValueIn
+                                         ? writer.addExpr(pointee.inVal)
+                                         : ExprBinaryWriter::NoId);
+      ExprBinaryWriter::writeU32(os, pointee.doTraceValueOut
+                                         ? writer.addExpr(pointee.outVal)
+                                         : ExprBinaryWriter::NoId);
+    }
+
+    ExprBinaryWriter::writeU32(os, writer.addExpr(ci.ret.expr));
+  }
+  os.flush();
+
+  writer.write(*file);
+  *file << body;
+}
+
 // load a .path file
 void KleeHandler::loadPathFile(std::string name, std::vector<bool> &buffer) {
   std::ifstream f(name.c_str(), std::ios::in | std::ios::binary);
@@ -1097,49 +1382,51 @@ std::string KleeHandler::getRunTimeLibraryPath(const char *argv0) {
   return libDir.str();
 }
 
-void CallTree::addCallPath(std::vector<CallInfo>::const_iterator path_begin,
-                           std::vector<CallInfo>::const_iterator path_end,
-                           unsigned path_id) {
+void CallTree::addCallPath(
+    std::vector<const CallInfo *>::const_iterator path_begin,
+    std::vector<const CallInfo *>::const_iterator path_end,
+    unsigned path_id) {
   // TODO: do we process constraints (what if they are different from the old
   // ones?)
   // TODO: record assumptions for each item in the call-path, because, when
   // comparing two paths in the tree they may differ only by the assumptions.
-  if (path_begin == path_end)
-    return;
-  std::vector<CallInfo>::const_iterator next = path_begin;
-  ++next;
-  std::vector<CallTree *>::iterator i = children.begin(), ie = children.end();
-  for (; i != ie; ++i) {
-    if ((*i)->tip.call.eq(*path_begin)) {
-      (*i)->addCallPath(next, path_end, path_id);
-      return;
-    }
-  }
-  children.push_back(new CallTree());
-  CallTree *n = children.back();
-  n->tip.call = *path_begin;
-  n->tip.path_id = path_id;
-  n->addCallPath(next, path_end, path_id);
+  CallTree *node = this;
+  for (; path_begin != path_end; ++path_begin)
+    node = node->getChild(**path_begin, path_id);
 }
 
-std::vector<std::vector<CallPathTip *>> CallTree::groupChildren() {
-  std::vector<std::vector<CallPathTip *>> ret;
-  for (unsigned ci = 0; ci < children.size(); ++ci) {
-    CallPathTip *current = &children[ci]->tip;
-    bool groupNotFound = true;
-    for (unsigned gi = 0; gi < ret.size(); ++gi) {
-      if (current->call.sameInvocation(&ret[gi][0]->call)) {
-        ret[gi].push_back(current);
-        groupNotFound = false;
-        break;
-      }
-    }
-    if (groupNotFound) {
-      ret.push_back(std::vector<CallPathTip *>());
-      ret.back().push_back(current);
-    }
-  }
-  return ret;
+CallTree *CallTree::getChild(const CallInfo &call, unsigned path_id) {
+  // Of the children equal to the call, the one added first is taken.
+  unsigned hash = call.hash();
+  unsigned pos = children.size();
+  auto range = childIndex.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it)
+    if (it->second < pos && children[it->second]->tip.call.eq(call))
+      pos = it->second;
+  if (pos < children.size())
+    return children[pos];
+
+  CallTree *n = new CallTree();
+  n->tip.call = call;
+  n->tip.path_id = path_id;
+  childIndex.insert(std::make_pair(hash, (unsigned)children.size()));
+  children.push_back(n);
+
+  // Likewise, the new tip joins the first group of the same invocation.
+  CallPathTip *current = &n->tip;
+  unsigned invocationHash = call.invocationHash();
+  unsigned group = groups.size();
+  range = groupIndex.equal_range(invocationHash);
+  for (auto it = range.first; it != range.second; ++it)
+    if (it->second < group &&
+        current->call.sameInvocation(&groups[it->second][0]->call))
+      group = it->second;
+  if (group == groups.size()) {
+    groupIndex.insert(std::make_pair(invocationHash, group));
+    groups.push_back(std::vector<CallPathTip *>());
+  }
+  groups[group].push_back(current);
+  return n;
 }
 
 void dumpCallGroup(const std::vector<CallInfo *> group,
@@ -1257,9 +1544,8 @@ void CallTree::dumpCallPrefixes(
     std::list<CallInfo> accumulated_prefix,
     std::list<const std::vector<ref<Expr>> *> accumulated_context,
     KleeHandler *fileOpener) {
-  std::vector<std::vector<CallPathTip *>> tipCalls = groupChildren();
-  std::vector<std::vector<CallPathTip *>>::iterator ti = tipCalls.begin(),
-                                                    te = tipCalls.end();
+  std::vector<std::vector<CallPathTip *>>::const_iterator ti = groups.begin(),
+                                                          te = groups.end();
   for (; ti != te; ++ti) {
     llvm::raw_ostream *file = fileOpener->openNextCallPathPrefixFile();
     std::list<CallInfo>::iterator ai = accumulated_prefix.begin(),
@@ -1321,9 +1607,8 @@ void CallTree::dumpCallPrefixes(
 
 void CallTree::dumpCallPrefixesSExpr(std::list<CallInfo> accumulated_prefix,
                                      KleeHandler *fileOpener) {
-  std::vector<std::vector<CallPathTip *>> tipCalls = groupChildren();
-  std::vector<std::vector<CallPathTip *>>::iterator ti = tipCalls.begin(),
-                                                    te = tipCalls.end();
+  std::vector<std::vector<CallPathTip *>>::const_iterator ti = groups.begin(),
+                                                          te = groups.end();
   for (; ti != te; ++ti) {
     llvm::raw_ostream *file = fileOpener->openNextCallPathPrefixFile();
     std::list<CallInfo>::iterator ai = accumulated_prefix.begin(),
@@ -2130,6 +2415,8 @@ int main(int argc, char **argv, char **envp) {
                    << " (" << ++i << "/" << kTestFiles.size() << ")\n";
       // XXX should put envp in .ktest ?
       interpreter->runFunctionAsMain(mainFn, out->numArgs, out->args, pEnvp);
+      // Queued call paths refer to the module and arrays of the interpreter.
+      handler->finishPendingOutput();
       if (interrupted)
         break;
     }
@@ -2180,6 +2467,8 @@ int main(int argc, char **argv, char **envp) {
       }
     }
     interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+    // Queued call paths refer to the module and arrays of the interpreter.
+    handler->finishPendingOutput();
     handler->getInfoStream() << "KLEE: saving call prefixes \n";
 
     if (DumpCallTracePrefixes)
@@ -9,18 +9,30 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "klee/Config/Version.h"
 #include "klee/ExprBuilder.h"
 #include "klee/perf-contracts.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/ExprBinary.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include <klee/Constraints.h>
 #include <klee/Solver.h>
 
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
 #include <dlfcn.h>
 #include <expr/Parser.h>
 #include <fstream>
 #include <iostream>
+#include <thread>
 #include <vector>
 
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Support/system_error.h"
+#endif
+
 #include "load-call-paths.h"
 
 #define DEBUG
@@ -37,12 +49,128 @@ bool call_paths_t::is_skip_function(const std::string &fname) {
   return found_it != call_paths_t::skip_functions.end();
 }
 
-call_path_t *load_call_path(std::string file_name,
-                            std::vector<std::string> expressions_str,
-                            std::deque<klee::ref<klee::Expr>> &expressions) {
+// Shared by every call path so that the same expressions (and especially the
+// long chains of packet byte reads) are only kept once in memory.
+static klee::ExprBuilder *get_expr_builder() {
+  static klee::ExprBuilder *builder =
+      klee::createHashConsingExprBuilder(klee::createDefaultExprBuilder());
+  return builder;
+}
+
+// Shared by every call path so that arrays with the same name and size are
+// the same object in all of them. Never freed, the arrays have to outlive
+// the call paths.
+static klee::ArrayCache *get_array_cache() {
+  static klee::ArrayCache *array_cache = new klee::ArrayCache();
+  return array_cache;
+}
+
+// Reads the binary form written by klee --call-path-format=binary: the
+// expression and array tables of klee::ExprBinaryWriter followed by
+//
+//   u32:numConstraints { u32:expr }*
+//   u32:numCalls { str:function
+//                  u32:numArgs { str:name u32:expr u8:kind
+//                                kind 1: str:fnPtrName
+//                                kind 2: u32:in u32:out }*
+//                  u32:numExtraVars { str:name u32:in u32:out }*
+//                  u32:ret }*
+//
+// where a missing expression is stored as ExprBinaryWriter::NoId.
+static call_path_t *
+load_binary_call_path(const std::string &file_name,
+                      std::vector<std::string> &expressions_str,
+                      klee::ExprBuilder *builder,
+                      klee::ArrayCache *array_cache) {
+  assert(expressions_str.empty() &&
+         "Extra expressions are only supported for text call paths.");
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  llvm::OwningPtr<llvm::MemoryBuffer> MB;
+  llvm::error_code ec = llvm::MemoryBuffer::getFile(file_name, MB);
+  assert(!ec && "Unable to open call path file.");
+#else
+  auto MBResult = llvm::MemoryBuffer::getFile(file_name);
+  assert(MBResult && "Unable to open call path file.");
+  std::unique_ptr<llvm::MemoryBuffer> &MB = *MBResult;
+#endif
+
+  call_path_t *call_path = new call_path_t;
+  call_path->file_name = file_name;
+
+  klee::ExprBinaryReader reader(MB->getBufferStart(), MB->getBufferEnd(),
+                                builder, array_cache);
+  bool ok = reader.readTables();
+  assert(ok && "Invalid binary call path file.");
+
+  for (auto array : reader.getArrays()) {
+    call_path->arrays[array->name] = array;
+  }
+
+  uint32_t num_constraints;
+  ok = reader.readU32(num_constraints);
+  std::vector<klee::ref<klee::Expr>> constraints(num_constraints);
+  for (uint32_t i = 0; ok && i < num_constraints; i++) {
+    ok = reader.readExpr(constraints[i]);
+  }
+  call_path->constraints = klee::ConstraintManager(constraints);
+
+  uint32_t num_calls = 0;
+  ok = ok && reader.readU32(num_calls);
+  for (uint32_t i = 0; ok && i < num_calls; i++) {
+    call_path->calls.emplace_back();
+    call_t &call = call_path->calls.back();
+
+    uint32_t num_args = 0;
+    ok = reader.readString(call.function_name) && reader.readU32(num_args);
+    for (uint32_t j = 0; ok && j < num_args; j++) {
+      std::string name;
+      uint8_t kind = 0;
+      ok = reader.readString(name);
+      arg_t &arg = call.args[name];
+      ok = ok && reader.readExpr(arg.expr) && reader.readU8(kind);
+      if (kind == 1) {
+        arg.fn_ptr_name.first = true;
+        ok = ok && reader.readString(arg.fn_ptr_name.second);
+      } else if (kind == 2) {
+        ok = ok && reader.readExpr(arg.in) && reader.readExpr(arg.out);
+      }
+    }
+
+    uint32_t num_extra_vars = 0;
+    ok = ok && reader.readU32(num_extra_vars);
+    for (uint32_t j = 0; ok && j < num_extra_vars; j++) {
+      std::string name;
+      ok = reader.readString(name);
+      auto &extra_var = call.extra_vars[name];
+      ok = ok && reader.readExpr(extra_var.first) &&
+           reader.readExpr(extra_var.second);
+    }
+
+    ok = ok && reader.readExpr(call.ret);
+  }
+
+  assert(ok && reader.atEnd() && "Invalid binary call path file.");
+  return call_path;
+}
+
+static call_path_t *
+load_call_path(const std::string &file_name,
+               std::vector<std::string> &expressions_str,
+               std::deque<klee::ref<klee::Expr>> &expressions,
+               klee::ExprBuilder *builder, klee::ArrayCache *array_cache) {
   std::ifstream call_path_file(file_name);
   assert(call_path_file.is_open() && "Unable to open call path file.");
 
+  char magic[4] = {};
+  call_path_file.read(magic, sizeof(magic));
+  if (klee::ExprBinaryReader::isExprBinary(magic, magic + sizeof(magic))) {
+    return load_binary_call_path(file_name, expressions_str, builder,
+                                 array_cache);
+  }
+  call_path_file.clear();
+  call_path_file.seekg(0);
+
   call_path_t *call_path = new call_path_t;
   call_path->file_name = file_name;
 
@@ -97,9 +225,8 @@ call_path_t *load_call_path(std::string file_name,
         }
 
         llvm::MemoryBuffer *MB = llvm::MemoryBuffer::getMemBuffer(kQuery);
-        klee::ExprBuilder *Builder = klee::createDefaultExprBuilder();
-        klee::expr::Parser *P =
-            klee::expr::Parser::Create("", MB, Builder, false);
+        klee::expr::Parser *P = klee::expr::Parser::Create(
+            "", MB, builder, array_cache, false);
         while (klee::expr::Decl *D = P->ParseTopLevelDecl()) {
           assert(!P->GetNumErrors() &&
                  "Error parsing kquery in call path file.");
@@ -440,3 +567,84 @@ call_path_t *load_call_path(std::string file_name,
 
   return call_path;
 }
+
+call_path_t *load_call_path(std::string file_name,
+                            std::vector<std::string> expressions_str,
+                            std::deque<klee::ref<klee::Expr>> &expressions) {
+  return load_call_path(file_name, expressions_str, expressions,
+                        get_expr_builder(), get_array_cache());
+}
+
+static bool is_call_path_file(const std::string &file_name) {
+  const std::string suffix = ".call_path";
+  return file_name.size() > suffix.size() &&
+         file_name.compare(file_name.size() - suffix.size(), suffix.size(),
+                           suffix) == 0;
+}
+
+std::vector<call_path_t *>
+load_call_paths(const std::vector<std::string> &inputs, unsigned num_threads) {
+  std::vector<std::string> files;
+
+  for (auto input : inputs) {
+    DIR *dir = opendir(input.c_str());
+    if (!dir) {
+      files.push_back(input);
+      continue;
+    }
+
+    std::vector<std::string> dir_files;
+    while (struct dirent *entry = readdir(dir)) {
+      if (is_call_path_file(entry->d_name)) {
+        dir_files.push_back(input + "/" + entry->d_name);
+      }
+    }
+    closedir(dir);
+
+    std::sort(dir_files.begin(), dir_files.end());
+    files.insert(files.end(), dir_files.begin(), dir_files.end());
+  }
+
+  if (!klee::Expr::threadSafe) {
+    // Expression reference counts and Expr::count are plain integers in
+    // this build, so expressions must stay on one thread.
+    num_threads = 1;
+  } else if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min<size_t>(num_threads, files.size());
+
+  std::vector<call_path_t *> call_paths(files.size());
+  std::atomic<size_t> next_file(0);
+
+  // Expressions are not thread-safe, so every thread builds its own; only
+  // the array cache is shared.
+  auto load = [&](klee::ExprBuilder *builder) {
+    for (size_t i = next_file++; i < files.size(); i = next_file++) {
+      std::vector<std::string> expressions_str;
+      std::deque<klee::ref<klee::Expr>> expressions;
+      call_paths[i] = load_call_path(files[i], expressions_str, expressions,
+                                     builder, get_array_cache());
+    }
+  };
+
+  if (num_threads <= 1) {
+    load(get_expr_builder());
+    return call_paths;
+  }
+
+  std::vector<klee::ExprBuilder *> builders;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < num_threads; i++) {
+    builders.push_back(
+        klee::createHashConsingExprBuilder(klee::createDefaultExprBuilder()));
+    threads.emplace_back(load, builders.back());
+  }
+
+  for (unsigned i = 0; i < num_threads; i++) {
+    threads[i].join();
+    delete builders[i];
+  }
+
+  return call_paths;
+}
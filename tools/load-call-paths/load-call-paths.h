@@ -72,6 +72,15 @@ call_path_t *load_call_path(std::string file_name,
                             std::vector<std::string> expressions_str,
                             std::deque<klee::ref<klee::Expr>> &expressions);
 
+// Loads every call path in inputs, in order, using num_threads threads (one
+// per core if 0), or a single thread unless expressions are thread-safe
+// (ENABLE_THREADSAFE_EXPR). Directories are replaced by the .call_path files they
+// contain, sorted by name. Arrays with the same name and size are shared by
+// all the call paths.
+std::vector<call_path_t *>
+load_call_paths(const std::vector<std::string> &inputs,
+                unsigned num_threads = 0);
+
 inline std::ostream &operator<<(std::ostream &os, const arg_t &arg) {
   if (arg.fn_ptr_name.first) {
     os << arg.fn_ptr_name.second;
@@ -27,15 +27,9 @@ llvm::cl::list<std::string> InputCallPathFiles(llvm::cl::desc("<call paths>"),
 int main(int argc, char **argv, char **envp) {
   llvm::cl::ParseCommandLineOptions(argc, argv);
 
-  std::vector<call_path_t *> call_paths;
-
-  for (auto file : InputCallPathFiles) {
-    std::cerr << "Loading: " << file << std::endl;
-
-    std::vector<std::string> expressions_str;
-    std::deque<klee::ref<klee::Expr>> expressions;
-    call_paths.push_back(load_call_path(file, expressions_str, expressions));
-  }
+  std::vector<call_path_t *> call_paths =
+      load_call_paths(std::vector<std::string>(InputCallPathFiles.begin(),
+                                               InputCallPathFiles.end()));
 
   for (unsigned i = 0; i < call_paths.size(); i++) {
     std::cerr << "Call Path " << i << std::endl;
@@ -153,17 +153,10 @@ int main(int argc, char **argv) {
   llvm::cl::ParseCommandLineOptions(argc, argv);
 
   BDD::solver_toolbox.build();
-  std::vector<call_path_t *> call_paths;
-
-  for (auto file : InputCallPathFiles) {
-    std::cerr << "Loading: " << file << std::endl;
-
-    std::vector<std::string> expressions_str;
-    std::deque<klee::ref<klee::Expr>> expressions;
-
-    auto call_path = load_call_path(file, expressions_str, expressions);
-    call_paths.push_back(call_path);
-  }
+  std::vector<call_path_t *> call_paths =
+      load_call_paths(std::vector<std::string>(InputCallPathFiles.begin(),
+                                               InputCallPathFiles.end()));
+  std::cerr << "Loaded " << call_paths.size() << " call paths" << std::endl;
 
   auto call_paths_chunks = get_chunks_per_call_path(call_paths);
 
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+namespace synapse {
+
+// Runs a best-first search the way popping and expanding one plan at a time
+// would, but expands up to batch_size plans together.
+//
+// The next batch_size plans of the frontier are expanded at once, possibly on
+// several threads, and merged in pop order. A result is only merged while its
+// plan is still the one the frontier would pop next: once a merged result
+// queues a plan that goes first, or leaves a finished plan in front of a
+// search that stops at the first solution, the rest of the batch is dropped
+// and expanded again later. The search so visits and picks plans exactly as
+// the serial one does, whatever the batch size and number of threads.
+//
+// The frontier provides
+//   bool finished() const;
+//   std::vector<Plan> peek(unsigned n) const; // the next n plans pop() returns
+//                                             // if nothing is added meanwhile
+//   bool is_next(const Plan &plan) const;
+//   Plan pop();
+// expand(batch) returns the results of the batch, and merge(plan, results, i)
+// adds the results of batch[i], which was just popped as plan.
+template <class Frontier, class Expand, class Merge>
+void search_in_batches(Frontier &frontier, unsigned batch_size, Expand expand,
+                       Merge merge) {
+  while (!frontier.finished()) {
+    auto batch = frontier.peek(batch_size);
+    auto results = expand(batch);
+
+    // The first plan of a batch is always the next one, so every batch
+    // merges at least one result.
+    for (unsigned i = 0; i < batch.size(); i++) {
+      if (frontier.finished() || !frontier.is_next(batch[i])) {
+        break;
+      }
+
+      auto plan = frontier.pop();
+      merge(plan, results, i);
+    }
+  }
+}
+
+} // namespace synapse
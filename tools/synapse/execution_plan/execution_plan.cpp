@@ -1,10 +1,82 @@
 #include "execution_plan.h"
 
 #include "visitors/graphviz.h"
+#include "../modules/modules.h"
 
 namespace synapse {
 
-int ExecutionPlanNode::counter = 0;
-int ExecutionPlan::counter = 0;
+std::atomic<int> ExecutionPlanNode::counter(0);
+std::atomic<int> ExecutionPlan::counter(0);
+
+static void hash_combine(std::size_t &seed, std::size_t value) {
+  seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+std::size_t ExecutionPlan::hash() const {
+  std::size_t seed = 0;
+
+  for (const auto &leaf : leaves) {
+    hash_combine(seed, leaf.current_platform.first);
+    hash_combine(seed, leaf.current_platform.second);
+    hash_combine(seed, leaf.next ? leaf.next->get_id() : 0);
+  }
+
+  auto nodes = std::vector<ExecutionPlanNode_ptr>{ root };
+
+  while (nodes.size()) {
+    auto node = nodes.back();
+    nodes.pop_back();
+
+    if (!node) {
+      continue;
+    }
+
+    auto module = node->get_module();
+    auto next = node->get_next();
+
+    hash_combine(seed, module->get_type());
+    hash_combine(seed, next.size());
+
+    nodes.insert(nodes.end(), next.begin(), next.end());
+  }
+
+  auto bdd_nodes = std::vector<BDD::BDDNode_ptr>{ bdd.get_process() };
+
+  while (bdd_nodes.size()) {
+    auto bdd_node = bdd_nodes.back();
+    bdd_nodes.pop_back();
+
+    if (!bdd_node) {
+      continue;
+    }
+
+    hash_combine(seed, bdd_node->get_type());
+    hash_combine(seed, bdd_node->get_id());
+
+    if (bdd_node->get_type() == BDD::Node::NodeType::BRANCH) {
+      auto branch = static_cast<BDD::Branch *>(bdd_node.get());
+
+      bdd_nodes.push_back(branch->get_on_true());
+      bdd_nodes.push_back(branch->get_on_false());
+    } else if (bdd_node->get_type() == BDD::Node::NodeType::CALL) {
+      bdd_nodes.push_back(bdd_node->get_next());
+    }
+  }
+
+  return seed;
+}
+
+unsigned ExecutionPlan::get_merged_tables(const Module_ptr &module) {
+  if (!module || module->get_type() !=
+                     Module::ModuleType::BMv2SimpleSwitchgRPC_TableLookup) {
+    return 0;
+  }
+
+  auto table_lookup =
+      static_cast<targets::BMv2SimpleSwitchgRPC::TableLookup *>(module.get());
+  auto merged = table_lookup->get_keys().size();
+
+  return merged > 1 ? merged : 0;
+}
 
 } // namespace synapse
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "memory_bank.h"
 #include "visitors/visitor.h"
 
+#include <atomic>
 #include <unordered_set>
 
 namespace synapse {
@@ -56,13 +57,22 @@ private:
   unsigned nodes;
   std::map<Target, unsigned> nodes_per_target;
   unsigned reordered_nodes;
+  unsigned merged_tables;
   unsigned id;
 
-  static int counter;
+  // Set by the heuristic when the plan is queued, so that plans are compared
+  // without recomputing their score.
+  std::vector<int> score;
+
+  static std::atomic<int> counter;
+
+  // Merged tables a module contributes to the NumberOfMergedTables score.
+  static unsigned get_merged_tables(const Module_ptr &module);
 
 public:
   ExecutionPlan(const BDD::BDD &_bdd)
-      : bdd(_bdd), depth(0), nodes(0), reordered_nodes(0), id(counter++) {
+      : bdd(_bdd), depth(0), nodes(0), reordered_nodes(0), merged_tables(0),
+        id(counter++) {
     assert(bdd.get_process());
 
     leaf_t leaf(bdd.get_process());
@@ -74,11 +84,12 @@ public:
         memory_bank(ep.memory_bank),
         processed_bdd_nodes(ep.processed_bdd_nodes), depth(ep.depth),
         nodes(ep.nodes), nodes_per_target(ep.nodes_per_target),
-        reordered_nodes(ep.reordered_nodes), id(ep.id) {}
+        reordered_nodes(ep.reordered_nodes), merged_tables(ep.merged_tables),
+        id(ep.id), score(ep.score) {}
 
   ExecutionPlan(const ExecutionPlan &ep, ExecutionPlanNode_ptr _root)
       : root(_root), bdd(ep.bdd), depth(0), nodes(0), reordered_nodes(0),
-        id(counter++) {
+        merged_tables(0), id(counter++) {
     if (!_root) {
       return;
     }
@@ -90,6 +101,7 @@ public:
       branches.erase(branches.begin());
 
       nodes++;
+      merged_tables += get_merged_tables(node->get_module());
 
       auto next = node->get_next();
       branches.insert(branches.end(), next.begin(), next.end());
@@ -125,9 +137,11 @@ private:
 
     // Different pointers!
     // We probably cloned the entire BDD in the past, we should update
-    // this node to point to our new BDD.
+    // this node to point to our new BDD. The module is shared with the plan
+    // we are cloning, so it gets its own copy first.
     auto found_bdd_node = ep.bdd.get_node_by_id(bdd_node->get_id());
     if (found_bdd_node && found_bdd_node != bdd_node) {
+      copy->replace_module(module->clone());
       copy->replace_node(found_bdd_node);
     }
 
@@ -178,9 +192,18 @@ public:
   }
 
   unsigned get_id() const { return id; }
+  void set_id(unsigned _id) { id = _id; }
 
   unsigned get_reordered_nodes() const { return reordered_nodes; }
-  void inc_reordered_nodes() { reordered_nodes++; }
+  void inc_reordered_nodes() {
+    reordered_nodes++;
+    score.clear();
+  }
+
+  unsigned get_merged_tables() const { return merged_tables; }
+
+  const std::vector<int> &get_score() const { return score; }
+  void set_score(const std::vector<int> &_score) { score = _score; }
 
   const ExecutionPlanNode_ptr &get_root() const { return root; }
 
@@ -248,6 +271,9 @@ public:
       new_ep.nodes_per_target[new_module->get_target()]++;
     }
 
+    new_ep.merged_tables -= get_merged_tables(old_module);
+    new_ep.merged_tables += get_merged_tables(new_module);
+
     new_ep.leaves[0].current_platform.first = true;
     new_ep.leaves[0].current_platform.second = new_module->get_next_target();
 
@@ -301,6 +327,7 @@ public:
 
       auto module = _leaves[0].leaf->get_module();
       new_ep.nodes_per_target[module->get_target()]++;
+      new_ep.merged_tables += get_merged_tables(module);
     } else {
       assert(new_ep.root);
       assert(new_ep.leaves.size());
@@ -316,6 +343,7 @@ public:
 
         auto module = leaf.leaf->get_module();
         new_ep.nodes_per_target[module->get_target()]++;
+        new_ep.merged_tables += get_merged_tables(module);
       }
 
       new_ep.leaves[0].leaf->set_next(branches);
@@ -399,10 +427,15 @@ public:
 
   void visit(ExecutionPlanVisitor &visitor) const { visitor.visit(*this); }
 
+  // Structural hash, consistent with operator==: covers the module types and
+  // shape of the plan, its leaves and the ids of the BDD nodes.
+  std::size_t hash() const;
+
   ExecutionPlan clone(BDD::BDD new_bdd) const {
     ExecutionPlan copy = *this;
 
     copy.id = counter++;
+    copy.score.clear();
     copy.bdd = new_bdd;
 
     if (root) {
@@ -429,6 +462,7 @@ public:
     ExecutionPlan copy = *this;
 
     copy.id = counter++;
+    copy.score.clear();
 
     if (deep) {
       copy.bdd = copy.bdd.clone();
@@ -2,6 +2,8 @@
 
 #include "call-paths-to-bdd.h"
 
+#include <atomic>
+
 #include "../log.h"
 #include "../modules/module.h"
 #include "visitors/visitor.h"
@@ -21,7 +23,7 @@ private:
   ExecutionPlanNode_ptr prev;
   int id;
 
-  static int counter;
+  static std::atomic<int> counter;
 
 private:
   ExecutionPlanNode(Module_ptr _module) : module(_module), id(counter++) {}
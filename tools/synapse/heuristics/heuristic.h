@@ -4,15 +4,18 @@
 #include "score.h"
 
 #include <set>
+#include <unordered_map>
 
 namespace synapse {
 
 struct HeuristicConfiguration {
   virtual Score get_score(const ExecutionPlan &e) const = 0;
 
+  // Plans are scored once, when they are added to the heuristic.
   virtual bool operator()(const ExecutionPlan &e1,
                           const ExecutionPlan &e2) const {
-    return get_score(e1) > get_score(e2);
+    assert(e1.get_score().size() && e2.get_score().size());
+    return e1.get_score() > e2.get_score();
   }
   virtual bool terminate_on_first_solution() const = 0;
 };
@@ -22,27 +25,48 @@ template <class T> class Heuristic {
                 "T must inherit from HeuristicConfiguration");
 
 protected:
-  std::multiset<ExecutionPlan, T> execution_plans;
+  struct plan_entry_t {
+    ExecutionPlan plan;
+    // ExecutionPlan::hash() of the plan, computed once when it is added.
+    std::size_t hash;
+  };
+
+  struct plan_entry_order_t {
+    T order;
+
+    bool operator()(const plan_entry_t &e1, const plan_entry_t &e2) const {
+      return order(e1.plan, e2.plan);
+    }
+  };
+
+  typedef typename std::multiset<plan_entry_t, plan_entry_order_t>::iterator
+      plan_it_t;
+
+  std::multiset<plan_entry_t, plan_entry_order_t> execution_plans;
   T configuration;
 
+  // The plans above indexed by their hash, to find duplicates without
+  // comparing against the whole frontier.
+  std::unordered_multimap<std::size_t, plan_it_t> hashed_plans;
+
 private:
-  typename std::set<ExecutionPlan, T>::iterator get_best_it() const {
+  plan_it_t get_best_it() const {
     assert(execution_plans.size());
     return execution_plans.begin();
   }
 
-  typename std::set<ExecutionPlan, T>::iterator get_next_it() const {
+  plan_it_t get_next_it() const {
     assert(execution_plans.size());
 
     auto conf = static_cast<const HeuristicConfiguration *>(&configuration);
     auto it = execution_plans.begin();
 
     while (!conf->terminate_on_first_solution() &&
-           it != execution_plans.end() && !it->get_next_node()) {
+           it != execution_plans.end() && !it->plan.get_next_node()) {
       ++it;
     }
 
-    if (it != execution_plans.end() && !it->get_next_node()) {
+    if (it != execution_plans.end() && !it->plan.get_next_node()) {
       it = execution_plans.end();
     }
 
@@ -52,19 +76,55 @@ private:
 public:
   bool finished() const { return get_next_it() == execution_plans.end(); }
 
-  ExecutionPlan get() { return *get_best_it(); }
+  ExecutionPlan get() { return get_best_it()->plan; }
 
   std::vector<ExecutionPlan> get_all() const {
     std::vector<ExecutionPlan> eps;
-    eps.assign(execution_plans.begin(), execution_plans.end());
+    for (const auto &entry : execution_plans) {
+      eps.push_back(entry.plan);
+    }
     return eps;
   }
 
+  // The next n plans pop() returns if no plan is added in between.
+  std::vector<ExecutionPlan> peek(unsigned n) const {
+    auto conf = static_cast<const HeuristicConfiguration *>(&configuration);
+    std::vector<ExecutionPlan> eps;
+
+    for (auto it = execution_plans.begin();
+         it != execution_plans.end() && eps.size() < n; ++it) {
+      if (it->plan.get_next_node()) {
+        eps.push_back(it->plan);
+      } else if (conf->terminate_on_first_solution()) {
+        break;
+      }
+    }
+
+    return eps;
+  }
+
+  // Whether ep is the plan pop() returns next. Plans in the heuristic have
+  // distinct ids.
+  bool is_next(const ExecutionPlan &ep) const {
+    auto it = get_next_it();
+    return it != execution_plans.end() && it->plan.get_id() == ep.get_id();
+  }
+
   ExecutionPlan pop() {
     auto it = get_next_it();
     assert(it != execution_plans.end());
 
-    auto copy = *it;
+    auto copy = it->plan;
+
+    auto range = hashed_plans.equal_range(it->hash);
+    for (auto hashed_it = range.first; hashed_it != range.second;
+         ++hashed_it) {
+      if (hashed_it->second == it) {
+        hashed_plans.erase(hashed_it);
+        break;
+      }
+    }
+
     execution_plans.erase(it);
 
     return copy;
@@ -74,10 +134,13 @@ public:
     assert(next_eps.size());
 
     for (auto ep : next_eps) {
+      auto hash = ep.hash();
+      auto range = hashed_plans.equal_range(hash);
       auto found = false;
 
-      for (auto saved_ep : execution_plans) {
-        if (saved_ep == ep) {
+      for (auto hashed_it = range.first; hashed_it != range.second;
+           ++hashed_it) {
+        if (hashed_it->second->plan == ep) {
           found = true;
           break;
         }
@@ -87,7 +150,9 @@ public:
         continue;
       }
 
-      execution_plans.insert(ep);
+      ep.set_score(get_score(ep).get_values());
+      auto it = execution_plans.insert(plan_entry_t{ep, hash});
+      hashed_plans.emplace(hash, it);
     }
   }
 
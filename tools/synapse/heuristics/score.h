@@ -34,6 +34,10 @@ private:
   // It defines a lexicographic order.
   std::vector<std::pair<Category, Objective>> categories;
 
+  // One value per category, computed when the category is added and negated
+  // for the ones being minimized, so that scores compare as plain vectors.
+  std::vector<int> values;
+
   int get_nr_nodes() const;
   int get_nr_merged_tables() const;
   int get_depth() const;
@@ -53,7 +57,7 @@ public:
   }
   Score(const Score &score)
       : execution_plan(score.execution_plan), computers(score.computers),
-        categories(score.categories) {}
+        categories(score.categories), values(score.values) {}
 
   void add(Category category, Objective objective = Objective::MAXIMIZE) {
     auto found_it =
@@ -65,6 +69,14 @@ public:
     assert(found_it == categories.end() && "Category already inserted");
 
     categories.emplace_back(category, objective);
+
+    auto value = get(category);
+
+    if (objective == Objective::MINIMIZE) {
+      value *= -1;
+    }
+
+    values.push_back(value);
   }
 
   int get(Category category) const {
@@ -80,59 +92,29 @@ public:
     return (this->*computer)();
   }
 
-  inline bool operator<(const Score &other) {
-    for (auto category_objective : categories) {
-      auto category = category_objective.first;
-      auto objective = category_objective.second;
+  const std::vector<int> &get_values() const { return values; }
 
-      auto this_score = get(category);
-      auto other_score = other.get(category);
-
-      if (objective == Objective::MINIMIZE) {
-        this_score *= -1;
-        other_score *= -1;
-      }
-
-      if (this_score > other_score) {
-        return false;
-      }
-
-      if (this_score < other_score) {
-        return true;
-      }
-    }
-
-    return false;
+  inline bool operator<(const Score &other) const {
+    return values < other.values;
   }
 
-  inline bool operator==(const Score &other) {
-    for (auto category_objective : categories) {
-      auto category = category_objective.first;
-      auto objective = category_objective.second;
-
-      auto this_score = get(category);
-      auto other_score = other.get(category);
-
-      if (objective == Objective::MINIMIZE) {
-        this_score *= -1;
-        other_score *= -1;
-      }
-
-      if (this_score != other_score) {
-        return false;
-      }
-    }
-
-    return true;
+  inline bool operator==(const Score &other) const {
+    return values == other.values;
   }
 
-  inline bool operator>(const Score &other) {
-    return !((*this) < other) && !((*this) == other);
+  inline bool operator>(const Score &other) const {
+    return values > other.values;
   }
 
-  inline bool operator<=(const Score &other) { return !((*this) > other); }
-  inline bool operator>=(const Score &other) { return !((*this) < other); }
-  inline bool operator!=(const Score &other) { return !((*this) == other); }
+  inline bool operator<=(const Score &other) const {
+    return !((*this) > other);
+  }
+  inline bool operator>=(const Score &other) const {
+    return !((*this) < other);
+  }
+  inline bool operator!=(const Score &other) const {
+    return !((*this) == other);
+  }
 
   friend std::ostream &operator<<(std::ostream &os, const Score &dt);
 };
@@ -141,16 +123,7 @@ inline std::ostream &operator<<(std::ostream &os, const Score &score) {
   os << "<";
 
   bool first = true;
-  for (auto category_objective : score.categories) {
-    auto category = category_objective.first;
-    auto objective = category_objective.second;
-
-    auto value = score.get(category);
-
-    if (objective == Score::Objective::MINIMIZE) {
-      value *= -1;
-    }
-
+  for (auto value : score.values) {
     if (!first) {
       os << ",";
     }
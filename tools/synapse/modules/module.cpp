@@ -20,13 +20,18 @@ std::vector<ExecutionPlan> get_reordered(const ExecutionPlan &ep) {
     return reordered;
   }
 
-  auto current_node = next_node->get_prev();
+  auto prev_node = next_node->get_prev();
 
-  if (!current_node) {
+  if (!prev_node) {
     return reordered;
   }
 
+  // Nodes shared between reordered BDDs keep the parents they had in the BDD
+  // they were created in, so look the parent up in this plan's BDD.
   auto current_bdd = ep.get_bdd();
+  auto current_node = current_bdd.get_node_by_id(prev_node->get_id());
+  assert(current_node);
+
   auto reordered_bdds = BDD::reorder(current_bdd, current_node);
 
   for (auto reordered_bdd : reordered_bdds) {
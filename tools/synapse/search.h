@@ -1,11 +1,15 @@
 #pragma once
 
+#include "batched_search.h"
 #include "execution_plan/execution_plan.h"
 #include "execution_plan/visitors/graphviz.h"
 #include "heuristics/heuristic.h"
 #include "log.h"
 #include "search_space.h"
 
+#include <atomic>
+#include <thread>
+
 namespace synapse {
 
 class SearchEngine {
@@ -13,9 +17,58 @@ private:
   std::vector<synapse::Module_ptr> modules;
   BDD::BDD bdd;
 
+  // Plans expanded together, and threads expanding them. Neither changes
+  // the plans the search visits or picks, see search_in_batches.
+  unsigned batch_size;
+  unsigned num_threads;
+
+  // Runs every module on every plan, result i * modules.size() + j is the
+  // one of module j on plan i.
+  std::vector<processing_result_t>
+  expand(const std::vector<ExecutionPlan> &eps) const {
+    unsigned tasks = eps.size() * modules.size();
+    std::vector<processing_result_t> results(tasks);
+
+    auto process = [&](unsigned task) {
+      const auto &ep = eps[task / modules.size()];
+      const auto &module = modules[task % modules.size()];
+      results[task] = module->process_node(ep, ep.get_next_node());
+    };
+
+    if (num_threads <= 1 || tasks <= 1) {
+      for (unsigned task = 0; task < tasks; task++) {
+        process(task);
+      }
+
+      return results;
+    }
+
+    std::atomic<unsigned> next_task(0);
+    std::vector<std::thread> workers;
+
+    for (unsigned i = 0; i < std::min(num_threads, tasks); i++) {
+      workers.emplace_back([&]() {
+        unsigned task;
+        while ((task = next_task++) < tasks) {
+          process(task);
+        }
+      });
+    }
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    return results;
+  }
+
 public:
-  SearchEngine(BDD::BDD _bdd) : bdd(_bdd) {}
-  SearchEngine(const SearchEngine &se) : SearchEngine(se.bdd) {
+  SearchEngine(BDD::BDD _bdd, unsigned _batch_size = 1,
+               unsigned _num_threads = 1)
+      : bdd(_bdd), batch_size(std::max(_batch_size, 1u)),
+        num_threads(_num_threads) {}
+  SearchEngine(const SearchEngine &se)
+      : SearchEngine(se.bdd, se.batch_size, se.num_threads) {
     modules = se.modules;
   }
 
@@ -46,14 +99,19 @@ public:
 
   template <class T> ExecutionPlan search(Heuristic<T> h) {
     auto first_execution_plan = ExecutionPlan(bdd);
+
+    // Plans are numbered in the order they are merged rather than created,
+    // which depends on the threads.
+    unsigned next_id = 0;
+    first_execution_plan.set_id(next_id++);
     SearchSpace search_space(h.get_cfg(), first_execution_plan);
 
     h.add(std::vector<ExecutionPlan>{first_execution_plan});
 
     puts("");
-    while (!h.finished()) {
-      auto available = h.size();
-      auto next_ep = h.pop();
+    auto merge = [&](const ExecutionPlan &next_ep,
+                     std::vector<processing_result_t> &results, unsigned i) {
+      auto available = h.size() + 1;
       auto next_node = next_ep.get_next_node();
       assert(next_node);
 
@@ -70,14 +128,19 @@ public:
 
       report_t report;
 
-      for (auto module : modules) {
-        auto result = module->process_node(next_ep, next_node);
+      for (unsigned j = 0; j < modules.size(); j++) {
+        auto &module = modules[j];
+        auto &result = results[i * modules.size() + j];
 
         if (result.next_eps.size()) {
           report.target_name.push_back(module->get_target_name());
           report.name.push_back(module->get_name());
           report.generated_contexts.push_back(result.next_eps.size());
 
+          for (auto &ep : result.next_eps) {
+            ep.set_id(next_id++);
+          }
+
           h.add(result.next_eps);
           search_space.add_leaves(next_ep, result.module, result.next_eps);
         }
@@ -98,14 +161,14 @@ public:
 
         if (next_ep.get_current_platform().first) {
           auto platform = next_ep.get_current_platform().second;
-          Log::dbg() << "Current target " << Module::target_to_string(platform)
-                     << "\n";
+          Log::dbg() << "Current target "
+                     << Module::target_to_string(platform) << "\n";
         }
 
-        for (unsigned i = 0; i < report.target_name.size(); i++) {
-          Log::dbg() << "MATCH          " << report.target_name[i]
-                     << "::" << report.name[i] << " -> "
-                     << report.generated_contexts[i] << " exec plans"
+        for (unsigned k = 0; k < report.target_name.size(); k++) {
+          Log::dbg() << "MATCH          " << report.target_name[k]
+                     << "::" << report.name[k] << " -> "
+                     << report.generated_contexts[k] << " exec plans"
                      << "\n";
         }
 
@@ -120,8 +183,8 @@ public:
 
         if (next_ep.get_current_platform().first) {
           auto platform = next_ep.get_current_platform().second;
-          Log::dbg() << "Current target " << Module::target_to_string(platform)
-                     << "\n";
+          Log::dbg() << "Current target "
+                     << Module::target_to_string(platform) << "\n";
         }
 
         Log::wrn() << "No module can handle this BDD node"
@@ -131,7 +194,12 @@ public:
         Log::dbg()
             << "=======================================================\n";
       }
-    }
+    };
+
+    search_in_batches(
+        h, batch_size,
+        [&](const std::vector<ExecutionPlan> &eps) { return expand(eps); },
+        merge);
 
     std::cerr << "solutions: " << h.get_all().size() << "\n";
     std::cerr << "winner:    " << h.get_score(h.get()) << "\n";
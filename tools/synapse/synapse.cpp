@@ -57,6 +57,20 @@ llvm::cl::opt<std::string>
 llvm::cl::opt<std::string>
     Out("out", llvm::cl::desc("Output directory for every generated file."),
         llvm::cl::cat(SyNAPSE));
+
+llvm::cl::opt<unsigned> SearchThreads(
+    "search-threads",
+    llvm::cl::desc("Number of threads expanding execution plans. Needs a "
+                   "build with -DENABLE_THREADSAFE_EXPR=ON, otherwise plans "
+                   "are expanded on one thread (default=1)."),
+    llvm::cl::init(1), llvm::cl::cat(SyNAPSE));
+
+llvm::cl::opt<unsigned> SearchBatch(
+    "search-batch",
+    llvm::cl::desc("Number of execution plans expanded together. Plans "
+                   "are still visited and picked as with 1, but expansions "
+                   "overtaken by a better plan are redone (default=1)."),
+    llvm::cl::init(1), llvm::cl::cat(SyNAPSE));
 } // namespace
 
 BDD::BDD build_bdd() {
@@ -67,17 +81,10 @@ BDD::BDD build_bdd() {
     return BDD::BDD(InputBDDFile);
   }
 
-  std::vector<call_path_t *> call_paths;
-
-  for (auto file : InputCallPathFiles) {
-    std::cerr << "Loading: " << file << std::endl;
-
-    std::vector<std::string> expressions_str;
-    std::deque<klee::ref<klee::Expr>> expressions;
-
-    call_path_t *call_path = load_call_path(file, expressions_str, expressions);
-    call_paths.push_back(call_path);
-  }
+  std::vector<call_path_t *> call_paths =
+      load_call_paths(std::vector<std::string>(InputCallPathFiles.begin(),
+                                               InputCallPathFiles.end()));
+  std::cerr << "Loaded " << call_paths.size() << " call paths" << std::endl;
 
   return BDD::BDD(call_paths);
 }
@@ -93,7 +100,15 @@ int main(int argc, char **argv) {
 
   BDD::BDD bdd = build_bdd();
 
-  synapse::SearchEngine search_engine(bdd);
+  unsigned search_threads = SearchThreads;
+  if (search_threads > 1 && !klee::Expr::threadSafe) {
+    std::cerr << "Expressions are not thread-safe in this build "
+                 "(ENABLE_THREADSAFE_EXPR), expanding plans on one thread"
+              << std::endl;
+    search_threads = 1;
+  }
+
+  synapse::SearchEngine search_engine(bdd, SearchBatch, search_threads);
   synapse::CodeGenerator code_generator(Out);
 
   for (unsigned i = 0; i != TargetList.size(); ++i) {
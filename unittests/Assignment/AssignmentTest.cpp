@@ -1,5 +1,6 @@
 #include "klee/util/ArrayCache.h"
 #include "klee/util/Assignment.h"
+#include "klee/util/CompiledExpr.h"
 #include "gtest/gtest.h"
 #include <iostream>
 #include <vector>
@@ -33,3 +34,55 @@ TEST(AssignmentTest, FoldNotOptimized)
   ASSERT_TRUE(asConstant != NULL);
   ASSERT_EQ(asConstant->getZExtValue(), (unsigned) 128);
 }
+
+TEST(AssignmentTest, CompiledEvaluationMatches)
+{
+  ArrayCache ac;
+  const Array* array = ac.CreateArray("compiled_array", /*size=*/ 4);
+  std::vector<const Array*> objects;
+  std::vector< std::vector<unsigned char> > values;
+  objects.push_back(array);
+  unsigned char bytes[4] = { 0x80, 0x01, 0xff, 0x07 };
+  values.push_back(std::vector<unsigned char>(bytes, bytes + 4));
+  Assignment assignment(objects, values);
+
+  ref<Expr> b0 = Expr::createTempRead(array, Expr::Int8);
+  ref<Expr> word = Expr::createTempRead(array, Expr::Int32);
+  UpdateList ul(array, 0);
+  ul.extend(ConstantExpr::alloc(1, Expr::Int32), ConstantExpr::alloc(42, Expr::Int8));
+  ref<Expr> updated = ReadExpr::create(ul, ConstantExpr::alloc(1, Expr::Int32));
+
+  std::vector< ref<Expr> > exprs;
+  exprs.push_back(SExtExpr::create(b0, Expr::Int32));
+  exprs.push_back(SltExpr::create(b0, ConstantExpr::alloc(0, Expr::Int8)));
+  exprs.push_back(AShrExpr::create(word, ConstantExpr::alloc(3, Expr::Int32)));
+  exprs.push_back(SDivExpr::create(word, ConstantExpr::alloc(-7, Expr::Int32)));
+  exprs.push_back(SRemExpr::create(word, ConstantExpr::alloc(-7, Expr::Int32)));
+  exprs.push_back(ShlExpr::create(word, ZExtExpr::create(
+      ExtractExpr::create(word, 24, Expr::Int8), Expr::Int32)));
+  exprs.push_back(ConcatExpr::create(updated, b0));
+  exprs.push_back(SelectExpr::create(EqExpr::create(updated, b0), b0, updated));
+
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    CompiledExpr *ce = CompiledExpr::compile(exprs[i]);
+    ASSERT_TRUE(ce != NULL);
+    uint64_t value;
+    ASSERT_TRUE(ce->evaluate(assignment, value));
+    ref<Expr> evaluated = assignment.evaluate(exprs[i]);
+    const ConstantExpr* asConstant = dyn_cast<ConstantExpr>(evaluated);
+    ASSERT_TRUE(asConstant != NULL);
+    EXPECT_EQ(asConstant->getZExtValue(), value);
+    delete ce;
+  }
+
+  // Division by zero leaves the tree walker with a symbolic result, so the
+  // compiled form must refuse to produce a value.
+  CompiledExpr *ce = CompiledExpr::compile(
+      UDivExpr::create(word, ZExtExpr::create(
+          SubExpr::create(b0, ConstantExpr::alloc(0x80, Expr::Int8)),
+          Expr::Int32)));
+  ASSERT_TRUE(ce != NULL);
+  uint64_t value;
+  EXPECT_FALSE(ce->evaluate(assignment, value));
+  delete ce;
+}
@@ -0,0 +1,151 @@
+#include "klee/ExecutionState.h"
+#include "klee/Internal/Module/KModule.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+uint64_t valueOf(const Cell &c) {
+  return cast<ConstantExpr>(c.value)->getZExtValue();
+}
+
+/// A function of one argument with \a numRegisters registers in all.
+class TestFunction {
+  llvm::LLVMContext context;
+  llvm::Module module;
+
+public:
+  KFunction *kf;
+
+  TestFunction(unsigned numRegisters) : module("test", context) {
+    llvm::Type *i32 = llvm::Type::getInt32Ty(context);
+    std::vector<llvm::Type *> args(1, i32);
+    llvm::Function *f = llvm::Function::Create(
+        llvm::FunctionType::get(i32, args, false),
+        llvm::Function::ExternalLinkage, "f", &module);
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", f));
+    llvm::Value *v = &*f->arg_begin();
+    // The argument and the return take a register each.
+    for (unsigned i = 2; i < numRegisters; ++i)
+      v = builder.CreateAdd(v, v);
+    builder.CreateRet(v);
+    // Without constant operands the module is not needed.
+    kf = new KFunction(f, 0);
+  }
+
+  ~TestFunction() { delete kf; }
+};
+
+TEST(ExecutionStateTest, RegistersAreAllocatedOnFirstWrite) {
+  TestFunction tf(8);
+  ASSERT_EQ(8u, tf.kf->numRegisters);
+
+  ExecutionState state(tf.kf);
+  StackFrame &sf = state.stack.back();
+  for (unsigned i = 0; i < tf.kf->numRegisters; ++i)
+    ASSERT_TRUE(sf.getLocal(i).value.isNull());
+
+  sf.getWriteableLocal(3).value = ConstantExpr::alloc(3, Expr::Int32);
+  ASSERT_TRUE(sf.getLocal(2).value.isNull());
+  ASSERT_EQ(3u, valueOf(sf.getLocal(3)));
+}
+
+TEST(ExecutionStateTest, ForkedFramesShareRegistersUntilWritten) {
+  TestFunction tf(8);
+  ExecutionState state(tf.kf);
+  state.pushFrame(0, tf.kf);
+  for (unsigned i = 0; i < state.stack.size(); ++i)
+    state.stack[i].getWriteableLocal(1).value =
+        ConstantExpr::alloc(i, Expr::Int32);
+
+  ExecutionState *child = state.branch();
+  for (unsigned i = 0; i < state.stack.size(); ++i)
+    ASSERT_EQ(&state.stack[i].getLocal(1), &child->stack[i].getLocal(1));
+
+  // Only the written frame of the child gets its own registers.
+  child->stack.back().getWriteableLocal(1).value =
+      ConstantExpr::alloc(42, Expr::Int32);
+  ASSERT_NE(&state.stack[1].getLocal(1), &child->stack[1].getLocal(1));
+  ASSERT_EQ(&state.stack[0].getLocal(1), &child->stack[0].getLocal(1));
+  ASSERT_EQ(1u, valueOf(state.stack[1].getLocal(1)));
+  ASSERT_EQ(42u, valueOf(child->stack[1].getLocal(1)));
+
+  // Neither copy depends on the other once one of them is gone.
+  delete child;
+  ASSERT_EQ(1u, valueOf(state.stack[1].getLocal(1)));
+}
+
+TEST(ExecutionStateTest, CallsStopAtAMissingOutValue) {
+  CallArg arg;
+  arg.expr = ConstantExpr::alloc(0x1000, Expr::Int64);
+  arg.isPtr = true;
+  arg.funPtr = 0;
+  arg.pointee.doTraceValueIn = true;
+  arg.pointee.doTraceValueOut = false;
+  FieldDescr field;
+  field.doTraceValueIn = false;
+  field.doTraceValueOut = true;
+  arg.pointee.fields[0] = field;
+
+  CallInfo ci;
+  ci.args.push_back(arg);
+  // The output value of a traced field counts as well as the pointee's.
+  ASSERT_FALSE(ci.hasAllOutValues());
+  ci.args[0].pointee.fields[0].outVal = ConstantExpr::alloc(1, Expr::Int8);
+  ASSERT_TRUE(ci.hasAllOutValues());
+
+  ci.args[0].pointee.doTraceValueOut = true;
+  ASSERT_FALSE(ci.hasAllOutValues());
+  // A pointee which is not traced at all is not checked.
+  ci.args[0].pointee.doTraceValueIn = ci.args[0].pointee.doTraceValueOut =
+      false;
+  ASSERT_TRUE(ci.hasAllOutValues());
+}
+
+TEST(ExecutionStateTest, ForksCopyStacksAtAnyDepth) {
+  TestFunction tf(4);
+  for (unsigned depth = 1; depth <= 16; depth *= 2) {
+    ExecutionState state(tf.kf);
+    while (state.stack.size() < depth)
+      state.pushFrame(0, tf.kf);
+    for (unsigned f = 0; f < depth; ++f)
+      state.stack[f].getWriteableLocal(1).value =
+          ConstantExpr::alloc(f, Expr::Int32);
+
+    ExecutionState *child = state.branch();
+    ASSERT_EQ(depth, child->stack.size());
+    for (unsigned f = 0; f < depth; ++f) {
+      ASSERT_EQ(state.stack[f].kf, child->stack[f].kf);
+      ASSERT_EQ(f, valueOf(child->stack[f].getLocal(1)));
+      ASSERT_TRUE(child->stack[f].getLocal(2).value.isNull());
+    }
+
+    // Writes on either side, in any frame, stay on that side.
+    for (unsigned f = 0; f < depth; ++f)
+      child->stack[f].getWriteableLocal(1).value =
+          ConstantExpr::alloc(100 + f, Expr::Int32);
+    state.stack.back().getWriteableLocal(2).value =
+        ConstantExpr::alloc(200, Expr::Int32);
+    for (unsigned f = 0; f < depth; ++f) {
+      ASSERT_EQ(f, valueOf(state.stack[f].getLocal(1)));
+      ASSERT_EQ(100 + f, valueOf(child->stack[f].getLocal(1)));
+    }
+    ASSERT_TRUE(child->stack.back().getLocal(2).value.isNull());
+
+    delete child;
+    for (unsigned f = 0; f < depth; ++f)
+      ASSERT_EQ(f, valueOf(state.stack[f].getLocal(1)));
+    ASSERT_EQ(200u, valueOf(state.stack.back().getLocal(2)));
+  }
+}
+}
@@ -0,0 +1,199 @@
+#include "Context.h"
+#include "CoreStats.h"
+#include "Memory.h"
+#include "MemoryManager.h"
+#include "TimingSolver.h"
+
+#include "klee/CommandLine.h"
+#include "klee/ExecutionState.h"
+#include "klee/Solver.h"
+#include "klee/util/ArrayCache.h"
+
+#include "gtest/gtest.h"
+
+using namespace klee;
+
+namespace {
+
+class MemoryTest : public ::testing::Test {
+protected:
+  ArrayCache cache;
+  MemoryManager memory;
+
+  MemoryTest() : memory(&cache) {}
+
+  // Symbolic writes are split into bytes by the endianness of the context,
+  // and object bases have the width of its pointers.
+  static void SetUpTestCase() {
+    static bool initialized = false;
+    if (!initialized)
+      Context::initialize(true, Expr::Int64);
+    initialized = true;
+  }
+
+  const MemoryObject *allocate(unsigned size) {
+    return memory.allocate(size, false, false, 0, 8);
+  }
+
+  ref<Expr> symbolicByte(const char *name) {
+    return ReadExpr::create(UpdateList(cache.CreateArray(name, 1), 0),
+                            ConstantExpr::alloc(0, Expr::Int32));
+  }
+};
+
+uint64_t valueOf(ref<Expr> e) {
+  return cast<ConstantExpr>(e)->getZExtValue();
+}
+
+TEST_F(MemoryTest, CopiesOfInlineObjectsAreIndependent) {
+  // Sixteen bytes and their masks fit in the object state itself.
+  ObjectState *os = new ObjectState(allocate(16));
+  for (unsigned i = 0; i < 16; ++i)
+    os->write8(i, i);
+
+  ObjectState *copy = new ObjectState(*os);
+  copy->write8(3, 42);
+  os->write8(5, 43);
+
+  for (unsigned i = 0; i < 16; ++i) {
+    EXPECT_EQ(i == 5 ? 43u : i, valueOf(os->read8(i)));
+    EXPECT_EQ(i == 3 ? 42u : i, valueOf(copy->read8(i)));
+  }
+
+  delete copy;
+  delete os;
+}
+
+TEST_F(MemoryTest, CopiesKeepTheirOwnMasks) {
+  // A symbolic object uses both masks from the start.
+  const Array *array = cache.CreateArray("arr", 8);
+  ObjectState *os = new ObjectState(allocate(8), array);
+  os->write8(1, 1);
+
+  ObjectState *copy = new ObjectState(*os);
+  copy->write8(2, 2);
+
+  EXPECT_EQ(1u, valueOf(os->read8(1)));
+  EXPECT_FALSE(isa<ConstantExpr>(os->read8(2)));
+  EXPECT_EQ(1u, valueOf(copy->read8(1)));
+  EXPECT_EQ(2u, valueOf(copy->read8(2)));
+
+  delete copy;
+  delete os;
+}
+
+TEST_F(MemoryTest, SymbolicSlotsKeepTheBytesAndMasks) {
+  // The eight slots do not fit inline, so the first known symbolic moves
+  // the bytes and masks into a pool block.
+  const Array *array = cache.CreateArray("arr", 8);
+  ObjectState *os = new ObjectState(allocate(8), array);
+  for (unsigned i = 0; i < 6; ++i)
+    os->write8(i, 10 + i);
+
+  ref<Expr> value = symbolicByte("value");
+  os->write(6, value);
+
+  for (unsigned i = 0; i < 6; ++i)
+    EXPECT_EQ(10 + i, valueOf(os->read8(i)));
+  EXPECT_EQ(value, os->read8(6));
+  ref<Expr> unwritten = os->read8(7);
+  ASSERT_TRUE(isa<ReadExpr>(unwritten));
+  EXPECT_EQ(array, cast<ReadExpr>(unwritten)->updates.root);
+
+  // The copy gets a block with slots straight away.
+  ObjectState *copy = new ObjectState(*os);
+  copy->write8(0, 20);
+  EXPECT_EQ(10u, valueOf(os->read8(0)));
+  EXPECT_EQ(20u, valueOf(copy->read8(0)));
+  EXPECT_EQ(value, copy->read8(6));
+
+  delete copy;
+  delete os;
+}
+
+TEST_F(MemoryTest, FreedStorageIsReused) {
+  for (unsigned shift = 6; shift <= 12; ++shift) {
+    size_t bytes = (size_t)1 << shift;
+    void *block = memory.allocateStorage(bytes);
+    void *other = memory.allocateStorage(bytes);
+    ASSERT_NE(block, other);
+    memory.releaseStorage(block, bytes);
+
+    // Any size of the same class gets the freed block back.
+    void *reused = memory.allocateStorage(bytes / 2 + 1);
+    EXPECT_EQ(block, reused);
+    memory.releaseStorage(reused, bytes / 2 + 1);
+    memory.releaseStorage(other, bytes);
+  }
+}
+
+class ResolveTest : public MemoryTest {
+protected:
+  TimingSolver solver;
+  ref<Expr> index;
+
+  ResolveTest()
+      : solver(createCoreSolver(CoreSolverToUse)),
+        index(symbolicByte("index")) {}
+
+  /// 0x1000 + index, which getBounds() puts in [0x1000, 0x10ff].
+  ref<Expr> pointer() {
+    return AddExpr::create(ConstantExpr::alloc(0x1000, Expr::Int64),
+                           ZExtExpr::create(index, Expr::Int64));
+  }
+
+  const MemoryObject *bind(ExecutionState &state, uint64_t address,
+                           unsigned size) {
+    const MemoryObject *mo = memory.allocateFixed(address, size, 0);
+    state.addressSpace.bindObject(mo, new ObjectState(mo));
+    return mo;
+  }
+};
+
+TEST_F(ResolveTest, ObjectsBelowTheBoundsAreNotQueried) {
+  // The pointer falls in between an object below its bounds and one
+  // within them.
+  ExecutionState state(std::vector<ref<Expr> >(
+      1, UltExpr::create(index, ConstantExpr::alloc(0x80, Expr::Int8))));
+  bind(state, 0x800, 0x10);
+  bind(state, 0x1080, 0x80);
+
+  // Only p < 0x1080 goes to the solver.
+  uint64_t queries = stats::resolveQueries.getValue();
+  ResolutionList rl;
+  EXPECT_FALSE(state.addressSpace.resolve(state, &solver, pointer(), rl));
+  EXPECT_TRUE(rl.empty());
+  EXPECT_EQ(queries + 1, stats::resolveQueries.getValue());
+
+  queries = stats::resolveQueries.getValue();
+  ObjectPair op;
+  bool success;
+  EXPECT_TRUE(
+      state.addressSpace.resolveOne(state, &solver, pointer(), op, success));
+  EXPECT_FALSE(success);
+  EXPECT_EQ(queries + 1, stats::resolveQueries.getValue());
+}
+
+TEST_F(ResolveTest, ObjectAtTheLowerBoundEndsTheSearch) {
+  ExecutionState state((std::vector<ref<Expr> >()));
+  bind(state, 0x800, 0x10);
+  const MemoryObject *low = bind(state, 0x1000, 0x80);
+  const MemoryObject *high = bind(state, 0x1080, 0x80);
+  bind(state, 0x2000, 0x10);
+
+  // Both objects in the bounds are found with four queries, whichever of
+  // them the search starts from. Nothing is asked about the object that
+  // starts at the lower bound once it is known to be hit, nor about the
+  // objects outside of the bounds.
+  uint64_t queries = stats::resolveQueries.getValue();
+  uint64_t saved = stats::resolveQueriesSaved.getValue();
+  ResolutionList rl;
+  EXPECT_FALSE(state.addressSpace.resolve(state, &solver, pointer(), rl));
+  ASSERT_EQ(2u, rl.size());
+  EXPECT_TRUE((rl[0].first == low && rl[1].first == high) ||
+              (rl[0].first == high && rl[1].first == low));
+  EXPECT_EQ(queries + 4, stats::resolveQueries.getValue());
+  EXPECT_EQ(saved + 2, stats::resolveQueriesSaved.getValue());
+}
+
+}
@@ -0,0 +1,155 @@
+#include "AddressSpace.h"
+#include "Memory.h"
+
+#include "gtest/gtest.h"
+
+using namespace klee;
+
+namespace {
+
+// The index never looks into the object states.
+char stateTokens[4];
+const ObjectState *state(unsigned i) {
+  return reinterpret_cast<const ObjectState *>(&stateTokens[i]);
+}
+
+MemoryObject *object(uint64_t address, unsigned size) {
+  return new MemoryObject(address, size, false, true, false, 0, 0);
+}
+
+const MemoryObject *lookup(const PageIndex &index, uint64_t address) {
+  ObjectPair op;
+  return index.lookup(address, op) ? op.first : 0;
+}
+
+TEST(PageIndexTest, LookupAcrossPages) {
+  MemoryObject *a = object(0x10000ff0, 0x20); // on two pages
+  MemoryObject *b = object(0x10001010, 0x10);
+  MemoryObject *c = object(0x20000000, 0);
+  {
+    PageIndex index;
+    index.insert(a, state(0));
+    index.insert(b, state(1));
+    index.insert(c, state(2));
+
+    ASSERT_EQ(a, lookup(index, 0x10000ff0));
+    ASSERT_EQ(a, lookup(index, 0x1000100f));
+    ASSERT_EQ(b, lookup(index, 0x10001010));
+    ASSERT_EQ(b, lookup(index, 0x1000101f));
+    ASSERT_FALSE(lookup(index, 0x10001020));
+    ASSERT_FALSE(lookup(index, 0x10000fef));
+    ASSERT_EQ(c, lookup(index, 0x20000000));
+    ASSERT_FALSE(lookup(index, 0x20000001));
+
+    ObjectPair op;
+    index.insert(a, state(3));
+    ASSERT_TRUE(index.lookup(0x10001000, op));
+    ASSERT_EQ(state(3), op.second);
+
+    index.remove(a);
+    ASSERT_FALSE(lookup(index, 0x10000ff0));
+    ASSERT_FALSE(lookup(index, 0x10001000));
+    ASSERT_EQ(b, lookup(index, 0x10001010));
+  }
+  delete a;
+  delete b;
+  delete c;
+}
+
+TEST(PageIndexTest, LeavesOutUnindexableObjects) {
+  MemoryObject *huge = object(0x10000000, 2048 * 4096);
+  MemoryObject *high = object(UINT64_C(1) << 50, 16);
+  {
+    PageIndex index;
+    index.insert(huge, state(0));
+    index.insert(high, state(1));
+    ASSERT_FALSE(lookup(index, 0x10000000));
+    ASSERT_FALSE(lookup(index, UINT64_C(1) << 50));
+  }
+  delete huge;
+  delete high;
+}
+
+TEST(PageIndexTest, CopiesAreIndependent) {
+  MemoryObject *a = object(0x10000000, 0x10);
+  MemoryObject *b = object(0x10000010, 0x10);
+  MemoryObject *c = object(0x7fff0000, 0x10);
+  unsigned allocated = PageIndex::getNumAllocated();
+  {
+    PageIndex original;
+    original.insert(a, state(0));
+    original.insert(c, state(0));
+    unsigned shared = PageIndex::getNumAllocated();
+
+    PageIndex copy(original);
+    ASSERT_EQ(shared, PageIndex::getNumAllocated());
+
+    // The first change copies the path to the page: six nodes of 64 slots
+    // and the page itself.
+    copy.insert(b, state(1));
+    ASSERT_EQ(shared + 7, PageIndex::getNumAllocated());
+    copy.remove(c);
+
+    ASSERT_EQ(a, lookup(original, 0x10000000));
+    ASSERT_FALSE(lookup(original, 0x10000010));
+    ASSERT_EQ(c, lookup(original, 0x7fff0000));
+    ASSERT_EQ(a, lookup(copy, 0x10000000));
+    ASSERT_EQ(b, lookup(copy, 0x10000010));
+    ASSERT_FALSE(lookup(copy, 0x7fff0000));
+
+    PageIndex assigned;
+    assigned = copy;
+    original = assigned;
+    ASSERT_EQ(b, lookup(original, 0x10000010));
+  }
+  // Dropping the last reference frees the nodes.
+  ASSERT_EQ(allocated, PageIndex::getNumAllocated());
+  delete a;
+  delete b;
+  delete c;
+}
+
+TEST(PageIndexTest, WritesCopyOnlyTheSharedPath) {
+  MemoryObject *a = object(0x10000000, 0x10);
+  MemoryObject *b = object(0x10001000, 0x10); // next page, same leaf node
+  MemoryObject *c = object(0x7fff0000, 0x10); // apart from the third level
+  unsigned allocated = PageIndex::getNumAllocated();
+  {
+    PageIndex original;
+    original.insert(a, state(0));
+    original.insert(b, state(0));
+    unsigned shared = PageIndex::getNumAllocated();
+
+    PageIndex copy(original);
+    copy.insert(a, state(1));
+    ASSERT_EQ(shared + 7, PageIndex::getNumAllocated());
+
+    // The path is owned now: updating the page again copies nothing, and the
+    // page next to it only copies that page.
+    copy.insert(a, state(2));
+    ASSERT_EQ(shared + 7, PageIndex::getNumAllocated());
+    copy.insert(b, state(1));
+    ASSERT_EQ(shared + 8, PageIndex::getNumAllocated());
+
+    // A new page below an owned node only adds the three nodes under it and
+    // the page.
+    copy.insert(c, state(1));
+    ASSERT_EQ(shared + 12, PageIndex::getNumAllocated());
+
+    ObjectPair op;
+    ASSERT_TRUE(original.lookup(0x10000000, op));
+    ASSERT_EQ(state(0), op.second);
+    ASSERT_TRUE(original.lookup(0x10001000, op));
+    ASSERT_EQ(state(0), op.second);
+    ASSERT_FALSE(lookup(original, 0x7fff0000));
+    ASSERT_TRUE(copy.lookup(0x10000000, op));
+    ASSERT_EQ(state(2), op.second);
+    ASSERT_TRUE(copy.lookup(0x10001000, op));
+    ASSERT_EQ(state(1), op.second);
+  }
+  ASSERT_EQ(allocated, PageIndex::getNumAllocated());
+  delete a;
+  delete b;
+  delete c;
+}
+}
@@ -10,8 +10,13 @@
 #include <iostream>
 #include "gtest/gtest.h"
 
+#include "klee/Constraints.h"
 #include "klee/Expr.h"
+#include "klee/ExprBuilder.h"
 #include "klee/util/ArrayCache.h"
+#include "klee/util/ExprBinary.h"
+
+#include "llvm/Support/raw_ostream.h"
 
 using namespace klee;
 
@@ -264,4 +269,223 @@ TEST(ExprTest, ReadExprFoldingSymbolicIndexUpdate) {
     EXPECT_EQ(Expr::Read, read.get()->getKind());
   }
 }
+
+TEST(ExprTest, HashConsingBuilder) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  ExprBuilder *builder =
+      createHashConsingExprBuilder(createDefaultExprBuilder());
+
+  // Two separately built little endian 16-bit reads.
+  ref<Expr> reads[2];
+  for (unsigned i = 0; i < 2; ++i) {
+    UpdateList ul(array, 0);
+    ref<Expr> lo = builder->Read(ul, builder->Constant(0, Expr::Int32));
+    ref<Expr> hi = builder->Read(ul, builder->Constant(1, Expr::Int32));
+    reads[i] = builder->Concat(hi, lo);
+  }
+  EXPECT_EQ(reads[0].get(), reads[1].get());
+  EXPECT_EQ(reads[0]->getKid(0).get(), reads[1]->getKid(0).get());
+
+  // Structurally different expressions stay apart.
+  ref<Expr> sum = builder->Add(reads[0], builder->Constant(1, Expr::Int16));
+  ref<Expr> diff = builder->Sub(reads[0], builder->Constant(1, Expr::Int16));
+  EXPECT_NE(sum.get(), diff.get());
+  EXPECT_EQ(sum->getKid(1).get(), diff->getKid(1).get());
+
+  delete builder;
+}
+
+TEST(ExprTest, BinaryRoundTrip) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  ref<ConstantExpr> values[2] = { ConstantExpr::create(7, Expr::Int8),
+                                  ConstantExpr::create(9, Expr::Int8) };
+  const Array *constArray =
+      ac.CreateArray("const", 2, &values[0], &values[0] + 2);
+
+  UpdateList ul(array, 0);
+  ul.extend(getConstant(3, Expr::Int32), getConstant(42, Expr::Int8));
+  ref<Expr> read = ReadExpr::create(ul, getConstant(4, Expr::Int32));
+  ref<Expr> wide = ConcatExpr::create(read, read);
+  ref<Expr> e1 = AddExpr::create(ZExtExpr::create(wide, Expr::Int64),
+                                 ConstantExpr::alloc(llvm::APInt(128, 1)
+                                                         .shl(100)
+                                                         .trunc(64)));
+  ref<Expr> e2 = SelectExpr::create(
+      UltExpr::create(ExtractExpr::create(e1, 8, Expr::Int8),
+                      ReadExpr::create(UpdateList(constArray, 0),
+                                       ZExtExpr::create(read, Expr::Int32))),
+      read, NotExpr::create(read));
+
+  std::string data;
+  llvm::raw_string_ostream os(data);
+  ExprBinaryWriter writer;
+  uint32_t id1 = writer.addExpr(e1);
+  uint32_t id2 = writer.addExpr(e2);
+  EXPECT_EQ(id1, writer.addExpr(e1));
+  EXPECT_EQ(ExprBinaryWriter::NoId, writer.addExpr(ref<Expr>()));
+  writer.write(os);
+  ExprBinaryWriter::writeU32(os, id2);
+  ExprBinaryWriter::writeU32(os, id1);
+  ExprBinaryWriter::writeString(os, "tail");
+  os.flush();
+
+  ArrayCache readCache;
+  ExprBuilder *builder = createDefaultExprBuilder();
+  const char *begin = data.data(), *end = begin + data.size();
+  ASSERT_TRUE(ExprBinaryReader::isExprBinary(begin, end));
+  ExprBinaryReader reader(begin, end, builder, &readCache);
+  ASSERT_TRUE(reader.readTables());
+  EXPECT_EQ(2u, reader.getArrays().size());
+
+  ref<Expr> r2, r1;
+  std::string tail;
+  ASSERT_TRUE(reader.readExpr(r2));
+  ASSERT_TRUE(reader.readExpr(r1));
+  ASSERT_TRUE(reader.readString(tail));
+  EXPECT_TRUE(reader.atEnd());
+  EXPECT_EQ("tail", tail);
+  // The decoded arrays are distinct objects, so compare the printed forms.
+  std::string s1, s2, t1, t2;
+  llvm::raw_string_ostream(s1) << e1;
+  llvm::raw_string_ostream(s2) << e2;
+  llvm::raw_string_ostream(t1) << r1;
+  llvm::raw_string_ostream(t2) << r2;
+  EXPECT_EQ(s1, t1);
+  EXPECT_EQ(s2, t2);
+
+  uint8_t extra;
+  EXPECT_FALSE(reader.readU8(extra));
+
+  // A truncated buffer is rejected rather than read past its end.
+  ExprBinaryReader truncated(begin, begin + data.size() / 2, builder,
+                             &readCache);
+  EXPECT_FALSE(truncated.readTables());
+
+  delete builder;
+}
+
+// A missing output value, as of an extra pointer that was not written back,
+// is kept as NoId and read back as a null expression without shifting the
+// fields after it.
+TEST(ExprTest, BinaryRoundTripNullExpr) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 4);
+  ref<Expr> in = ReadExpr::create(UpdateList(array, 0),
+                                  getConstant(0, Expr::Int32));
+  ref<Expr> ret = AddExpr::create(in, getConstant(1, Expr::Int8));
+
+  std::string data;
+  llvm::raw_string_ostream os(data);
+  ExprBinaryWriter writer;
+  uint32_t inId = writer.addExpr(in);
+  uint32_t outId = writer.addExpr(ref<Expr>());
+  uint32_t retId = writer.addExpr(ret);
+  writer.write(os);
+  ExprBinaryWriter::writeString(os, "extra");
+  ExprBinaryWriter::writeU32(os, inId);
+  ExprBinaryWriter::writeU32(os, outId);
+  ExprBinaryWriter::writeU32(os, retId);
+  os.flush();
+
+  ArrayCache readCache;
+  ExprBuilder *builder = createDefaultExprBuilder();
+  ExprBinaryReader reader(data.data(), data.data() + data.size(), builder,
+                          &readCache);
+  ASSERT_TRUE(reader.readTables());
+  std::string name;
+  ref<Expr> rin, rout, rret;
+  ASSERT_TRUE(reader.readString(name));
+  ASSERT_TRUE(reader.readExpr(rin));
+  ASSERT_TRUE(reader.readExpr(rout));
+  ASSERT_TRUE(reader.readExpr(rret));
+  EXPECT_TRUE(reader.atEnd());
+  EXPECT_EQ("extra", name);
+  EXPECT_FALSE(rin.isNull());
+  EXPECT_TRUE(rout.isNull());
+  ASSERT_FALSE(rret.isNull());
+  std::string s, t;
+  llvm::raw_string_ostream(s) << ret;
+  llvm::raw_string_ostream(t) << rret;
+  EXPECT_EQ(s, t);
+
+  delete builder;
+}
+
+TEST(ExprTest, ConstraintFactors) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 16);
+  const Array *b = ac.CreateArray("b", 16);
+  const Array *c = ac.CreateArray("c", 16);
+  UpdateList ua(a, 0), ub(b, 0), uc(c, 0);
+  ref<Expr> a0 = ReadExpr::create(ua, ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> a1 = ReadExpr::create(ua, ConstantExpr::alloc(1, Expr::Int32));
+  ref<Expr> b0 = ReadExpr::create(ub, ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> c0 = ReadExpr::create(uc, ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> c5 = ConstantExpr::alloc(5, Expr::Int8);
+
+  ConstraintManager cm;
+  ref<Expr> ab = UltExpr::create(a0, b0);
+  ref<Expr> a1c = UltExpr::create(c5, a1);
+  ref<Expr> cc = UltExpr::create(c0, c5);
+  cm.addConstraint(ab);
+  cm.addConstraint(a1c);
+  cm.addConstraint(cc);
+
+  std::vector< ref<Expr> > related;
+  ASSERT_TRUE(cm.getRelatedConstraints(UltExpr::create(b0, c5), related));
+  ASSERT_EQ(1u, related.size());
+  EXPECT_EQ(ab, related[0]);
+
+  // A copy shares the partition until it is extended.
+  ConstraintManager copy(cm);
+  ref<Expr> bc = UltExpr::create(b0, c0);
+  copy.addConstraint(bc);
+  related.clear();
+  ASSERT_TRUE(copy.getRelatedConstraints(UltExpr::create(b0, c5), related));
+  ASSERT_EQ(3u, related.size());
+  EXPECT_EQ(ab, related[0]);
+  EXPECT_EQ(cc, related[1]);
+  EXPECT_EQ(bc, related[2]);
+  related.clear();
+  ASSERT_TRUE(cm.getRelatedConstraints(UltExpr::create(b0, c5), related));
+  EXPECT_EQ(1u, related.size());
+
+  // A symbolic index collapses the whole array into one factor.
+  ref<Expr> ax = ReadExpr::create(ua, ZExtExpr::create(c0, Expr::Int32));
+  related.clear();
+  ASSERT_TRUE(cm.getRelatedConstraints(EqExpr::create(ax, c5), related));
+  EXPECT_EQ(3u, related.size());
+
+  // Extending the copy again leaves the original's factors alone.
+  ref<Expr> a1b = UltExpr::create(a1, b0);
+  copy.addConstraint(a1b);
+  related.clear();
+  ASSERT_TRUE(copy.getRelatedConstraints(UltExpr::create(a1, c5), related));
+  EXPECT_EQ(5u, related.size());
+  related.clear();
+  ASSERT_TRUE(cm.getRelatedConstraints(UltExpr::create(a1, c5), related));
+  ASSERT_EQ(1u, related.size());
+  EXPECT_EQ(a1c, related[0]);
+
+  // Fixing c[0] rewrites the constraints reading it, which then no longer
+  // tie b to c.
+  ConstraintManager fixed(cm);
+  fixed.addConstraint(bc);
+  fixed.addConstraint(EqExpr::create(c0, ConstantExpr::alloc(1, Expr::Int8)));
+  ASSERT_EQ(4u, fixed.size());
+  related.clear();
+  ASSERT_TRUE(fixed.getRelatedConstraints(UltExpr::create(b0, c5), related));
+  ASSERT_EQ(2u, related.size());
+  EXPECT_EQ(ab, related[0]);
+  related.clear();
+  ASSERT_TRUE(fixed.getRelatedConstraints(c0, related));
+  EXPECT_EQ(1u, related.size());
+
+  // Without addConstraint there is no partition to consult.
+  ConstraintManager raw(std::vector< ref<Expr> >(1, ab));
+  related.clear();
+  EXPECT_FALSE(raw.getRelatedConstraints(b0, related));
+}
 }
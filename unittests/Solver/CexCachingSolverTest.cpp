@@ -0,0 +1,114 @@
+//===-- CexCachingSolverTest.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "CexCachingSolver.h"
+
+#include "klee/CommandLine.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/util/ArrayCache.h"
+
+using namespace klee;
+
+namespace {
+
+ArrayCache ac;
+
+/// Forwards to another solver, counting the assignments asked for.
+class CountingSolver : public SolverImpl {
+  Solver *solver;
+
+public:
+  unsigned queries;
+
+  CountingSolver(Solver *_solver) : solver(_solver), queries(0) {}
+  ~CountingSolver() { delete solver; }
+
+  bool computeTruth(const Query &query, bool &isValid) {
+    ++queries;
+    return solver->impl->computeTruth(query, isValid);
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    ++queries;
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    ++queries;
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution);
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+};
+
+/// Ask for an assignment satisfying x == value.
+void solveFor(Solver &solver, const Array *array, ref<Expr> x,
+              unsigned value) {
+  ConstraintManager constraints;
+  constraints.addConstraint(EqExpr::create(
+      x, ConstantExpr::create(value, Expr::Int8)));
+  std::vector<const Array*> objects(1, array);
+  std::vector< std::vector<unsigned char> > values;
+  ASSERT_TRUE(solver.getInitialValues(
+      Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
+      values));
+  ASSERT_EQ(value, values[0][0]);
+}
+
+TEST(CexCachingSolverTest, EvictsLeastRecentlyUsed) {
+  const Array *a = ac.CreateArray("a", 1);
+  ref<Expr> x = Expr::createTempRead(a, Expr::Int8);
+
+  CountingSolver *counter =
+    new CountingSolver(createCoreSolver(CoreSolverToUse));
+  CexCachingSolver *cache = new CexCachingSolver(new Solver(counter), 2);
+  Solver solver(cache);
+
+  solveFor(solver, a, x, 1);
+  solveFor(solver, a, x, 2);
+  ASSERT_EQ(2u, counter->queries);
+  ASSERT_EQ(2u, cache->getNumEntries());
+
+  // Using the first query again makes the second the least recently used.
+  solveFor(solver, a, x, 1);
+  ASSERT_EQ(2u, counter->queries);
+
+  solveFor(solver, a, x, 3);
+  ASSERT_EQ(3u, counter->queries);
+  ASSERT_EQ(2u, cache->getNumEntries());
+  ASSERT_EQ(2u, cache->getNumAssignments());
+  ASSERT_EQ(2u, cache->getNumConstraints());
+  ASSERT_EQ(3u, cache->getNumConstraintIds());
+
+  // The evicted query goes back to the solver, the others are still cached.
+  solveFor(solver, a, x, 1);
+  solveFor(solver, a, x, 3);
+  ASSERT_EQ(3u, counter->queries);
+  solveFor(solver, a, x, 2);
+  ASSERT_EQ(4u, counter->queries);
+
+  // However many queries go through, only two are kept and the ids of the
+  // constraints of evicted queries are reused.
+  for (unsigned i = 10; i < 40; ++i)
+    solveFor(solver, a, x, i);
+  ASSERT_EQ(2u, cache->getNumEntries());
+  ASSERT_EQ(2u, cache->getNumAssignments());
+  ASSERT_EQ(2u, cache->getNumConstraints());
+  ASSERT_EQ(3u, cache->getNumConstraintIds());
+}
+
+}
@@ -0,0 +1,113 @@
+//===-- PersistentCachingSolverTest.cpp -----------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/CommandLine.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+#include "klee/util/ArrayCache.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+ArrayCache ac;
+
+std::string getCachePath() {
+  char path[] = "/tmp/klee-persistent-cache-XXXXXX";
+  int fd = mkstemp(path);
+  EXPECT_GE(fd, 0);
+  close(fd);
+  unlink(path);
+  return path;
+}
+
+TEST(PersistentCachingSolverTest, ResultsOutliveTheSolver) {
+  std::string path = getCachePath();
+  ConstraintManager constraints;
+
+  const Array *a = ac.CreateArray("a", 1);
+  ref<Expr> x = Expr::createTempRead(a, Expr::Int8);
+  ref<Expr> small = UltExpr::create(x, ConstantExpr::create(200, Expr::Int8));
+
+  Solver *solver = createPersistentCachingSolver(
+      createCoreSolver(CoreSolverToUse), path);
+  Solver::Validity validity;
+  ASSERT_TRUE(solver->evaluate(Query(constraints, small), validity));
+  ASSERT_EQ(Solver::Unknown, validity);
+  ref<ConstantExpr> value;
+  ASSERT_TRUE(solver->getValue(Query(constraints, x), value));
+  delete solver;
+
+  // The same queries over a differently named array are answered from the
+  // file, the dummy solver fails everything it is asked.
+  const Array *b = ac.CreateArray("b", 1);
+  ref<Expr> y = Expr::createTempRead(b, Expr::Int8);
+  ref<Expr> renamed = UltExpr::create(y, ConstantExpr::create(200, Expr::Int8));
+
+  solver = createPersistentCachingSolver(createDummySolver(), path);
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(Query(constraints, renamed), result));
+  ASSERT_FALSE(result);
+  ref<ConstantExpr> cachedValue;
+  ASSERT_TRUE(solver->getValue(Query(constraints, y), cachedValue));
+  ASSERT_EQ(value->getZExtValue(), cachedValue->getZExtValue());
+
+  ref<Expr> other = UltExpr::create(y, ConstantExpr::create(100, Expr::Int8));
+  ASSERT_FALSE(solver->mustBeTrue(Query(constraints, other), result));
+  delete solver;
+
+  unlink(path.c_str());
+}
+
+TEST(PersistentCachingSolverTest, TornAppendIsCutOff) {
+  std::string path = getCachePath();
+  ConstraintManager constraints;
+
+  const Array *a = ac.CreateArray("a", 1);
+  ref<Expr> x = Expr::createTempRead(a, Expr::Int8);
+  ref<Expr> small = UltExpr::create(x, ConstantExpr::create(200, Expr::Int8));
+  ref<Expr> tiny = UltExpr::create(x, ConstantExpr::create(10, Expr::Int8));
+
+  Solver *solver = createPersistentCachingSolver(
+      createCoreSolver(CoreSolverToUse), path);
+  Solver::Validity validity;
+  ASSERT_TRUE(solver->evaluate(Query(constraints, small), validity));
+  delete solver;
+
+  // A writer killed in the middle of a record.
+  int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(5, write(fd, "\x01\x02\x03\x04\x05", 5));
+  close(fd);
+
+  solver = createPersistentCachingSolver(
+      createCoreSolver(CoreSolverToUse), path);
+  ASSERT_TRUE(solver->evaluate(Query(constraints, tiny), validity));
+  delete solver;
+
+  // Both records are still framed correctly.
+  solver = createPersistentCachingSolver(createDummySolver(), path);
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(Query(constraints, small), result));
+  ASSERT_FALSE(result);
+  ASSERT_TRUE(solver->mustBeTrue(Query(constraints, tiny), result));
+  ASSERT_FALSE(result);
+  delete solver;
+
+  unlink(path.c_str());
+}
+
+}
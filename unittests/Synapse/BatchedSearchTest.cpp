@@ -0,0 +1,150 @@
+#include "batched_search.h"
+
+#include "gtest/gtest.h"
+
+#include <future>
+#include <set>
+#include <vector>
+
+using namespace synapse;
+
+namespace {
+
+const unsigned MaxDepth = 5;
+
+struct Plan {
+  unsigned id;
+  unsigned score;
+  unsigned depth;
+};
+
+struct Child {
+  unsigned score;
+  unsigned depth;
+};
+
+struct BetterPlan {
+  bool operator()(const Plan &p1, const Plan &p2) const {
+    return p1.score > p2.score;
+  }
+};
+
+// A frontier with the same pop order as Heuristic: best score first, ties in
+// the order the plans were added, finished plans skipped unless the search
+// stops at the first one.
+class Frontier {
+  std::multiset<Plan, BetterPlan> plans;
+  bool stop_at_first;
+
+  std::multiset<Plan, BetterPlan>::iterator next_it() const {
+    auto it = plans.begin();
+    while (!stop_at_first && it != plans.end() && it->depth == MaxDepth) {
+      ++it;
+    }
+    if (it != plans.end() && it->depth == MaxDepth) {
+      it = plans.end();
+    }
+    return it;
+  }
+
+public:
+  Frontier(bool _stop_at_first) : stop_at_first(_stop_at_first) {}
+
+  bool finished() const { return next_it() == plans.end(); }
+
+  std::vector<Plan> peek(unsigned n) const {
+    std::vector<Plan> next;
+    for (auto it = plans.begin(); it != plans.end() && next.size() < n;
+         ++it) {
+      if (it->depth < MaxDepth) {
+        next.push_back(*it);
+      } else if (stop_at_first) {
+        break;
+      }
+    }
+    return next;
+  }
+
+  bool is_next(const Plan &plan) const {
+    auto it = next_it();
+    return it != plans.end() && it->id == plan.id;
+  }
+
+  Plan pop() {
+    auto it = next_it();
+    Plan plan = *it;
+    plans.erase(it);
+    return plan;
+  }
+
+  void add(const Plan &plan) { plans.insert(plan); }
+
+  const Plan &best() const { return *plans.begin(); }
+};
+
+// Up to three children with pseudo-random scores, so that children often
+// outrank the rest of a batch.
+std::vector<Child> expand(const Plan &plan) {
+  std::vector<Child> children;
+  unsigned seed = plan.id * 2654435761u + plan.score;
+  for (unsigned k = 0; k < 1 + (seed >> 7) % 3; k++) {
+    seed = seed * 1103515245u + 12345u;
+    children.push_back(Child{(seed >> 16) % 50, plan.depth + 1});
+  }
+  return children;
+}
+
+struct Outcome {
+  std::vector<unsigned> visited;
+  unsigned winner;
+};
+
+Outcome run(bool stop_at_first, unsigned batch_size, bool threaded) {
+  Frontier frontier(stop_at_first);
+  unsigned next_id = 0;
+  frontier.add(Plan{next_id++, 0, 0});
+
+  Outcome outcome;
+  search_in_batches(
+      frontier, batch_size,
+      [&](const std::vector<Plan> &batch) {
+        std::vector<std::future<std::vector<Child>>> futures;
+        for (const auto &plan : batch) {
+          futures.push_back(std::async(
+              threaded ? std::launch::async : std::launch::deferred, expand,
+              plan));
+        }
+        std::vector<std::vector<Child>> results;
+        for (auto &future : futures) {
+          results.push_back(future.get());
+        }
+        return results;
+      },
+      [&](const Plan &plan, std::vector<std::vector<Child>> &results,
+          unsigned i) {
+        outcome.visited.push_back(plan.id);
+        for (const auto &child : results[i]) {
+          frontier.add(Plan{next_id++, child.score, child.depth});
+        }
+      });
+
+  outcome.winner = frontier.best().id;
+  return outcome;
+}
+
+TEST(BatchedSearchTest, SameWinnerAsSerial) {
+  for (bool stop_at_first : {true, false}) {
+    Outcome serial = run(stop_at_first, 1, false);
+    ASSERT_GT(serial.visited.size(), 1u);
+
+    for (unsigned batch_size : {2u, 4u, 16u}) {
+      for (bool threaded : {false, true}) {
+        Outcome batched = run(stop_at_first, batch_size, threaded);
+        EXPECT_EQ(serial.visited, batched.visited);
+        EXPECT_EQ(serial.winner, batched.winner);
+      }
+    }
+  }
+}
+
+}
@@ -1,6 +1,9 @@
 #include "klee/Internal/ADT/TreeStream.h"
 #include <vector>
 #include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
 
 #include "gtest/gtest.h"
 
@@ -46,3 +49,35 @@ TEST(TreeStreamTest, WriteLargerThanBufferSize) {
   for (unsigned i=0; i<out.size(); i++)
     ASSERT_EQ('A', out[i]);
 }
+
+/* A writer continued in a copy of its file keeps the streams opened before,
+   and the original file does not see what is written after the switch.  */
+TEST(TreeStreamTest, ContinueIn) {
+  TreeStreamWriter tsw("tsw3.out");
+  ASSERT_TRUE(tsw.good());
+
+  TreeOStream parent = tsw.open();
+  parent.write("abc", 3);
+  TreeOStream child = tsw.open(parent);
+  child.write("de", 2);
+  tsw.flush();
+
+  ASSERT_TRUE(tsw.continueIn("tsw4.out"));
+  child.write("fg", 2);
+  child.flush();
+
+  std::vector<unsigned char> out;
+  tsw.readStream(child.getID(), out);
+  ASSERT_EQ(7u, out.size());
+  for (unsigned char c = 'a'; c <= 'g'; c++)
+    ASSERT_EQ(c, out[c - 'a']);
+
+  std::ifstream a("tsw3.out", std::ios::binary);
+  std::ifstream b("tsw4.out", std::ios::binary);
+  std::string before((std::istreambuf_iterator<char>(a)),
+                     std::istreambuf_iterator<char>());
+  std::string after((std::istreambuf_iterator<char>(b)),
+                    std::istreambuf_iterator<char>());
+  ASSERT_LT(before.size(), after.size());
+  ASSERT_EQ(before, after.substr(0, before.size()));
+}